@@ -149,6 +149,7 @@ struct ws {
 	char			*f;		/* (F)ree/front pointer */
 	char			*r;		/* (R)eserved length */
 	char			*e;		/* (E)nd of buffer */
+	unsigned		peak;		/* see WS_Peak() */
 };
 
 /*--------------------------------------------------------------------
@@ -216,6 +217,7 @@ struct pool_task {
 	VTAILQ_ENTRY(pool_task)		list;
 	task_func_t			*func;
 	void				*priv;
+	vtim_mono			queued;
 };
 
 /*
@@ -242,6 +244,8 @@ enum task_prio {
 #define TASK_QUEUE_RESERVE TASK_QUEUE_BG
 #define TASK_QUEUE_LIMITED(prio) \
 	(prio == TASK_QUEUE_REQ || prio == TASK_QUEUE_STR)
+#define TASK_QUEUE_STEALABLE(prio) \
+	(prio == TASK_QUEUE_BO || prio == TASK_QUEUE_BG)
 
 /*--------------------------------------------------------------------*/
 
@@ -306,7 +310,9 @@ struct boc {
 	uint64_t		fetched_so_far;
 	uint64_t		delivered_so_far;
 	uint64_t		transit_buffer;
+	unsigned		learned_hfm;	/* see HSH_Lookup() */
 	struct vai_q_head	vai_q_head;
+	struct vai_q_head	park_q_head;
 };
 
 /* Object core structure ---------------------------------------------
@@ -425,6 +431,13 @@ struct busyobj {
 	const char		*err_reason;
 	enum director_state_e	director_state;
 	uint16_t		err_code;
+	unsigned		bereq_borrowed:1;
+	unsigned		gzip_background:1;
+
+	/* See cache_slice.c */
+	unsigned		slice;
+	uint64_t		slice_size;
+	uint64_t		slice_total;
 
 #define BERESP_FLAG(l, r, w, f, d) unsigned	l:1;
 #define BEREQ_FLAG(l, r, w, d) BERESP_FLAG(l, r, w, 0, d)
@@ -479,6 +492,8 @@ struct req {
 #define REQ_MAGIC		0xfb4abf6d
 
 	unsigned		esi_level;
+	unsigned		slice;		/* slice subrequest index */
+	uint64_t		slice_size;
 	body_status_t		req_body_status;
 	stream_close_t		doclose;
 	unsigned		restarts;
@@ -504,6 +519,7 @@ struct req {
 	VTAILQ_ENTRY(req)	w_list;
 
 	struct objcore		*body_oc;
+	ssize_t			body_tee;	/* see VRB_Tee() */
 
 	/* Built Vary string == workspace reservation */
 	uint8_t			*vary_b;
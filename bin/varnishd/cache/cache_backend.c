@@ -48,6 +48,7 @@
 #include "cache_transport.h"
 #include "cache_vcl.h"
 #include "http1/cache_http1.h"
+#include "http2/cache_http2.h"
 #include "proxy/cache_proxy.h"
 
 #include "VSC_vbe.h"
@@ -69,7 +70,17 @@ struct connwait {
 	pthread_cond_t			cw_cond;
 };
 
+VTAILQ_HEAD(vbe_h2_head, vbe_h2);
+
+struct vbe_h2 {
+	unsigned			magic;
+#define VBE_H2_MAGIC			0x1d8a6c4e
+	struct h2f_sess			*sess;
+	VTAILQ_ENTRY(vbe_h2)		list;
+};
+
 static const char * const vbe_proto_ident = "HTTP Backend";
+static const char * const vbe_h2_ident = "HTTP/2 Backend";
 
 static struct lock backends_mtx;
 
@@ -162,7 +173,8 @@ vbe_connwait_signal_locked(const struct backend *bp)
 
 	Lck_AssertHeld(bp->director->mtx);
 
-	if (bp->n_conn < bp->max_connections) {
+	/* On .h2c backends a released stream makes room too */
+	if (bp->h2c || bp->n_conn < bp->max_connections) {
 		cw = VTAILQ_FIRST(&bp->cw_head);
 		if (cw != NULL) {
 			CHECK_OBJ(cw, CONNWAIT_MAGIC);
@@ -181,6 +193,19 @@ vbe_connwait_fini(struct connwait *cw)
 	FINI_OBJ(cw);
 }
 
+static int
+vbe_dir_sick(VRT_CTX, VCL_BACKEND dir, struct backend *bp)
+{
+
+	if (VRT_Healthy(ctx, dir, NULL))
+		return (0);
+	VSLb(ctx->bo->vsl, SLT_FetchError,
+	     "backend %s: unhealthy", VRT_BACKEND_string(dir));
+	bp->vsc->unhealthy++;
+	VSC_C_main->backend_unhealthy++;
+	return (1);
+}
+
 /*--------------------------------------------------------------------
  * Get a connection to the backend
  *
@@ -208,13 +233,8 @@ vbe_dir_getfd(VRT_CTX, struct worker *wrk, VCL_BACKEND dir, struct backend *bp,
 	CHECK_OBJ_NOTNULL(bp, BACKEND_MAGIC);
 	AN(bp->vsc);
 
-	if (!VRT_Healthy(ctx, dir, NULL)) {
-		VSLb(bo->vsl, SLT_FetchError,
-		     "backend %s: unhealthy", VRT_BACKEND_string(dir));
-		bp->vsc->unhealthy++;
-		VSC_C_main->backend_unhealthy++;
+	if (vbe_dir_sick(ctx, dir, bp))
 		return (NULL);
-	}
 	INIT_OBJ(cw, CONNWAIT_MAGIC);
 	PTOK(pthread_cond_init(&cw->cw_cond, NULL));
 	Lck_Lock(bp->director->mtx);
@@ -304,6 +324,8 @@ vbe_dir_getfd(VRT_CTX, struct worker *wrk, VCL_BACKEND dir, struct backend *bp,
 	Lck_Lock(bp->director->mtx);
 	bp->vsc->conn++;
 	bp->vsc->req++;
+	if (PFD_Prewarmed(pfd))
+		bp->vsc->prewarm_hit++;
 	Lck_Unlock(bp->director->mtx);
 
 	CHECK_OBJ_NOTNULL(bo->htc->doclose, STREAM_CLOSE_MAGIC);
@@ -356,6 +378,301 @@ vbe_dir_getfd(VRT_CTX, struct worker *wrk, VCL_BACKEND dir, struct backend *bp,
 	return (pfd);
 }
 
+/*--------------------------------------------------------------------
+ * HTTP/2 backends multiplex fetches over sessions.  A session holds a
+ * connection from the pool for its entire life and counts once towards
+ * .max_connections, no matter how many streams it carries.  When all
+ * sessions are full and no new one may be opened, fetches wait for a
+ * stream or a session in the same queue HTTP/1 fetches wait for a
+ * connection in.
+ */
+
+static void
+vbe_h2_reap(struct backend *bp, struct vbe_h2_head *dead, vtim_dur idle)
+{
+	struct vbe_h2 *h2, *h2n;
+	vtim_real now;
+
+	Lck_AssertHeld(bp->director->mtx);
+	now = VTIM_real();
+	VTAILQ_FOREACH_SAFE(h2, &bp->h2_head, list, h2n) {
+		CHECK_OBJ_NOTNULL(h2, VBE_H2_MAGIC);
+		if (!H2F_Reapable(h2->sess, now, idle))
+			continue;
+		VTAILQ_REMOVE(&bp->h2_head, h2, list);
+		VTAILQ_INSERT_TAIL(dead, h2, list);
+		assert(bp->n_conn > 0);
+		bp->n_conn--;
+		bp->vsc->conn--;
+	}
+}
+
+static void
+vbe_h2_close(struct vbe_h2_head *dead)
+{
+	struct vbe_h2 *h2;
+
+	while ((h2 = VTAILQ_FIRST(dead)) != NULL) {
+		CHECK_OBJ(h2, VBE_H2_MAGIC);
+		VTAILQ_REMOVE(dead, h2, list);
+		H2F_Close(&h2->sess);
+		FREE_OBJ(h2);
+	}
+}
+
+static struct vbe_h2 *
+vbe_h2_reserve(const struct backend *bp, unsigned force_fresh)
+{
+	struct vbe_h2 *h2;
+
+	Lck_AssertHeld(bp->director->mtx);
+	if (force_fresh)
+		return (NULL);
+	VTAILQ_FOREACH(h2, &bp->h2_head, list)
+		if (H2F_Reserve(h2->sess, cache_param->backend_h2_streams))
+			break;
+	return (h2);
+}
+
+static int
+vbe_h2_wait(VRT_CTX, VCL_BACKEND dir, struct backend *bp,
+    unsigned force_fresh, struct vbe_h2 **h2p)
+{
+	unsigned wait_limit;
+	vtim_dur wait_tmod;
+	vtim_real wait_end;
+	struct connwait cw[1];
+	int err, healthy;
+
+	Lck_AssertHeld(bp->director->mtx);
+	AN(h2p);
+	AZ(*h2p);
+	FIND_BE_PARAM(backend_wait_limit, wait_limit, bp);
+	FIND_BE_TMO(backend_wait_timeout, wait_tmod, bp);
+	if (wait_limit == 0 || wait_tmod <= 0.0 || bp->cw_count >= wait_limit)
+		return (-1);
+
+	INIT_OBJ(cw, CONNWAIT_MAGIC);
+	PTOK(pthread_cond_init(&cw->cw_cond, NULL));
+	VTAILQ_INSERT_TAIL(&bp->cw_head, cw, cw_list);
+	bp->cw_count++;
+	VSC_C_main->backend_wait++;
+	cw->cw_state = CW_QUEUED;
+	wait_end = VTIM_real() + wait_tmod;
+	do {
+		err = Lck_CondWaitUntil(&cw->cw_cond, bp->director->mtx,
+		    wait_end);
+		healthy = VRT_Healthy(ctx, dir, NULL);
+		if (healthy)
+			*h2p = vbe_h2_reserve(bp, force_fresh);
+		/* Someone else may have taken the room we were woken for */
+	} while (healthy && *h2p == NULL && BE_BUSY(bp) &&
+	    (err == 0 || err == EINTR));
+	assert(cw->cw_state == CW_QUEUED);
+	VTAILQ_REMOVE(&bp->cw_head, cw, cw_list);
+	cw->cw_state = CW_DEQUEUED;
+	bp->cw_count--;
+	vbe_connwait_fini(cw);
+	if (!healthy || (*h2p == NULL && BE_BUSY(bp))) {
+		VSC_C_main->backend_wait_fail++;
+		return (-1);
+	}
+	/* There may be room for the new head of the waiting queue too */
+	vbe_connwait_signal_locked(bp);
+	return (0);
+}
+
+static struct h2f_stream *
+vbe_h2_getstream(VRT_CTX, struct worker *wrk, VCL_BACKEND dir,
+    struct backend *bp, unsigned force_fresh)
+{
+	struct vbe_h2_head dead = VTAILQ_HEAD_INITIALIZER(dead);
+	struct busyobj *bo;
+	struct vbe_h2 *h2 = NULL;
+	struct h2f_sess *sess;
+	struct h2f_stream *s;
+	struct pfd *pfd;
+	vtim_dur tmod;
+	int busy = 0, err = 0;
+	char abuf1[VTCP_ADDRBUFSIZE], abuf2[VTCP_ADDRBUFSIZE];
+	char pbuf1[VTCP_PORTBUFSIZE], pbuf2[VTCP_PORTBUFSIZE];
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	bo = ctx->bo;
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	CHECK_OBJ_NOTNULL(bp, BACKEND_MAGIC);
+	AN(bp->vsc);
+
+	if (vbe_dir_sick(ctx, dir, bp))
+		return (NULL);
+
+	AZ(bo->htc);
+	bo->htc = WS_Alloc(bo->ws, sizeof *bo->htc);
+	if (bo->htc == NULL) {
+		VSLb(bo->vsl, SLT_FetchError, "out of workspace");
+		return (NULL);
+	}
+	INIT_OBJ(bo->htc, HTTP_CONN_MAGIC);
+	bo->htc->doclose = SC_NULL;
+
+	Lck_Lock(bp->director->mtx);
+	vbe_h2_reap(bp, &dead, cache_param->backend_idle_timeout);
+	if (VTAILQ_EMPTY(&bp->cw_head))
+		h2 = vbe_h2_reserve(bp, force_fresh);
+	if (h2 == NULL && (!VTAILQ_EMPTY(&bp->cw_head) || BE_BUSY(bp)))
+		busy = vbe_h2_wait(ctx, dir, bp, force_fresh, &h2);
+	if (!busy && h2 != NULL)
+		bp->vsc->req++;
+	else if (!busy)
+		bp->n_conn++;
+	Lck_Unlock(bp->director->mtx);
+	vbe_h2_close(&dead);
+
+	if (busy) {
+		VSLb(bo->vsl, SLT_FetchError,
+		     "backend %s: busy", VRT_BACKEND_string(dir));
+		bp->vsc->busy++;
+		VSC_C_main->backend_busy++;
+		bo->htc = NULL;
+		return (NULL);
+	}
+
+	if (h2 == NULL) {
+		FIND_TMO(connect_timeout, tmod, bo, bp);
+		pfd = VCP_Get(bp->conn_pool, tmod, wrk, force_fresh, &err);
+		if (pfd != NULL && PFD_State(pfd) == PFD_STATE_STOLEN &&
+		    VCP_Wait(wrk, pfd, VTIM_real() + tmod)) {
+			VCP_Close(&pfd);
+			err = ETIMEDOUT;
+		}
+		sess = NULL;
+		if (pfd != NULL)
+			sess = H2F_New(pfd);
+		if (sess == NULL) {
+			Lck_Lock(bp->director->mtx);
+			if (pfd == NULL)
+				VBE_Connect_Error(bp->vsc, err);
+			bp->n_conn--;
+			vbe_connwait_signal_locked(bp);
+			Lck_Unlock(bp->director->mtx);
+			if (pfd == NULL)
+				VSLb(bo->vsl, SLT_FetchError,
+				     "backend %s: fail errno %d (%s)",
+				     VRT_BACKEND_string(dir), err,
+				     VAS_errtxt(err));
+			else
+				VSLb(bo->vsl, SLT_FetchError,
+				     "backend %s: h2 preface failed",
+				     VRT_BACKEND_string(dir));
+			VSC_C_main->backend_fail++;
+			bo->htc = NULL;
+			return (NULL);
+		}
+		ALLOC_OBJ(h2, VBE_H2_MAGIC);
+		AN(h2);
+		h2->sess = sess;
+		AN(H2F_Reserve(sess, cache_param->backend_h2_streams));
+		Lck_Lock(bp->director->mtx);
+		VTAILQ_INSERT_HEAD(&bp->h2_head, h2, list);
+		bp->vsc->conn++;
+		bp->vsc->req++;
+		if (PFD_Prewarmed(pfd))
+			bp->vsc->prewarm_hit++;
+		/* The new session has room for those waiting */
+		vbe_connwait_signal_locked(bp);
+		Lck_Unlock(bp->director->mtx);
+	}
+
+	s = H2F_Stream(h2->sess);
+	pfd = H2F_Pfd(s);
+	VSLb_ts_busyobj(bo, "Connected", W_TIM_real(wrk));
+	PFD_LocalName(pfd, abuf1, sizeof abuf1, pbuf1, sizeof pbuf1);
+	PFD_RemoteName(pfd, abuf2, sizeof abuf2, pbuf2, sizeof pbuf2);
+	if (H2F_Reused(s) == 0) {
+		VSLb(bo->vsl, SLT_BackendOpen, "%d %s %s %s %s %s connect",
+		    *PFD_Fd(pfd), VRT_BACKEND_string(dir), abuf2, pbuf2,
+		    abuf1, pbuf1);
+	} else {
+		VSLb(bo->vsl, SLT_BackendOpen,
+		    "%d %s %s %s %s %s reuse %.6f %ju", *PFD_Fd(pfd),
+		    VRT_BACKEND_string(dir), abuf2, pbuf2, abuf1, pbuf1,
+		    PFD_Age(pfd), (uintmax_t)H2F_Reused(s));
+	}
+
+	bo->htc->priv = s;
+	bo->htc->rfd = PFD_Fd(pfd);
+	FIND_TMO(first_byte_timeout,
+	    bo->htc->first_byte_timeout, bo, bp);
+	FIND_TMO(between_bytes_timeout,
+	    bo->htc->between_bytes_timeout, bo, bp);
+	return (s);
+}
+
+static void
+vbe_h2_finish(struct busyobj *bo, VCL_BACKEND d, struct backend *bp)
+{
+	struct vbe_h2_head dead = VTAILQ_HEAD_INITIALIZER(dead);
+	struct h2f_stream *s;
+
+	s = bo->htc->priv;
+	bo->htc->priv = NULL;
+	if (bo->htc->doclose != SC_NULL)
+		VSLb(bo->vsl, SLT_BackendClose, "%d %s close %s",
+		    *bo->htc->rfd, VRT_BACKEND_string(d),
+		    bo->htc->doclose->name);
+	else
+		VSLb(bo->vsl, SLT_BackendClose, "%d %s recycle",
+		    *bo->htc->rfd, VRT_BACKEND_string(d));
+	H2F_Release(&s);
+
+	Lck_Lock(bp->director->mtx);
+	if (bo->htc->doclose == SC_NULL)
+		VSC_C_main->backend_recycle++;
+	vbe_h2_reap(bp, &dead, cache_param->backend_idle_timeout);
+#define ACCT(foo)	bp->vsc->foo += bo->acct.foo;
+#include "tbl/acct_fields_bereq.h"
+	vbe_connwait_signal_locked(bp);
+	Lck_Unlock(bp->director->mtx);
+	vbe_h2_close(&dead);
+	bo->htc = NULL;
+}
+
+static int
+vbe_h2_gethdrs(VRT_CTX, VCL_BACKEND d, struct backend *bp)
+{
+	struct busyobj *bo;
+	struct worker *wrk;
+	int i, retry = 1;
+
+	bo = ctx->bo;
+	wrk = bo->wrk;
+	do {
+		if (vbe_h2_getstream(ctx, wrk, d, bp, retry == 0) == NULL)
+			return (-1);
+		i = H2F_SendReq(wrk, bo, &bo->acct.bereq_hdrbytes,
+		    &bo->acct.bereq_bodybytes);
+		if (i == 0)
+			i = H2F_FetchRespHdr(bo);
+		if (i == 0) {
+			http_VSL_log(bo->beresp);
+			return (0);
+		}
+
+		/*
+		 * The stream was refused or the reused session died under
+		 * it, try once more on a fresh session if req.body allows.
+		 */
+		vbe_h2_finish(bo, d, bp);
+		AZ(bo->htc);
+		if (i < 0 || bo->no_retry != NULL)
+			break;
+		VSC_C_main->backend_retry++;
+	} while (retry--);
+	return (-1);
+}
+
+/*--------------------------------------------------------------------*/
+
 static void v_matchproto_(vdi_finish_f)
 vbe_dir_finish(VRT_CTX, VCL_BACKEND d)
 {
@@ -372,6 +689,11 @@ vbe_dir_finish(VRT_CTX, VCL_BACKEND d)
 	CHECK_OBJ_NOTNULL(bo->htc, HTTP_CONN_MAGIC);
 	CHECK_OBJ_NOTNULL(bo->htc->doclose, STREAM_CLOSE_MAGIC);
 
+	if (bp->h2c) {
+		vbe_h2_finish(bo, d, bp);
+		return;
+	}
+
 	pfd = bo->htc->priv;
 	bo->htc->priv = NULL;
 	if (bo->htc->doclose != SC_NULL || bp->proxy_header != 0) {
@@ -427,6 +749,9 @@ vbe_dir_gethdrs(VRT_CTX, VCL_BACKEND d)
 	if (!http_GetHdr(bo->bereq, H_Host, NULL) && bp->hosthdr != NULL)
 		http_PrintfHeader(bo->bereq, "Host: %s", bp->hosthdr);
 
+	if (bp->h2c)
+		return (vbe_h2_gethdrs(ctx, d, bp));
+
 	do {
 		if (bo->htc != NULL)
 			CHECK_OBJ_NOTNULL(bo->htc->doclose, STREAM_CLOSE_MAGIC);
@@ -482,13 +807,18 @@ vbe_dir_gethdrs(VRT_CTX, VCL_BACKEND d)
 static VCL_IP v_matchproto_(vdi_getip_f)
 vbe_dir_getip(VRT_CTX, VCL_BACKEND d)
 {
+	struct backend *bp;
 	struct pfd *pfd;
 
 	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
 	CHECK_OBJ_NOTNULL(d, DIRECTOR_MAGIC);
 	CHECK_OBJ_NOTNULL(ctx->bo, BUSYOBJ_MAGIC);
 	CHECK_OBJ_NOTNULL(ctx->bo->htc, HTTP_CONN_MAGIC);
-	pfd = ctx->bo->htc->priv;
+	CAST_OBJ_NOTNULL(bp, d->priv, BACKEND_MAGIC);
+	if (bp->h2c)
+		pfd = H2F_Pfd(ctx->bo->htc->priv);
+	else
+		pfd = ctx->bo->htc->priv;
 
 	return (VCP_GetIp(pfd));
 }
@@ -511,6 +841,12 @@ vbe_dir_http1pipe(VRT_CTX, VCL_BACKEND d)
 	CHECK_OBJ_NOTNULL(ctx->bo, BUSYOBJ_MAGIC);
 	CAST_OBJ_NOTNULL(bp, d->priv, BACKEND_MAGIC);
 
+	if (bp->h2c) {
+		VSLb(ctx->bo->vsl, SLT_FetchError,
+		    "backend %s: no pipe over h2c", VRT_BACKEND_string(d));
+		return (SC_TX_ERROR);
+	}
+
 	memset(&v1a, 0, sizeof v1a);
 
 	/* This is hackish... */
@@ -559,7 +895,12 @@ vbe_dir_event(const struct director *d, enum vcl_event_e ev)
 		VRT_VSC_Reveal(bp->vsc_seg);
 		if (bp->probe != NULL)
 			VBP_Control(bp, 1);
+		if (bp->min_idle_connections > 0)
+			VCP_Prewarm(bp->conn_pool, bp->min_idle_connections);
 	} else if (ev == VCL_EVENT_COLD) {
+		if (bp->min_idle_connections > 0)
+			VCP_Prewarm(bp->conn_pool,
+			    -(int)bp->min_idle_connections);
 		if (bp->probe != NULL)
 			VBP_Control(bp, 0);
 		VRT_VSC_Hide(bp->vsc_seg);
@@ -578,9 +919,18 @@ vbe_dir_event(const struct director *d, enum vcl_event_e ev)
 static void
 vbe_free(struct backend *be)
 {
+	struct vbe_h2_head dead = VTAILQ_HEAD_INITIALIZER(dead);
 
 	CHECK_OBJ_NOTNULL(be, BACKEND_MAGIC);
 
+	if (!VTAILQ_EMPTY(&be->h2_head)) {
+		Lck_Lock(be->director->mtx);
+		vbe_h2_reap(be, &dead, -1.0);
+		Lck_Unlock(be->director->mtx);
+		vbe_h2_close(&dead);
+		assert(VTAILQ_EMPTY(&be->h2_head));
+	}
+
 	if (be->probe != NULL)
 		VBP_Remove(be);
 
@@ -847,6 +1197,7 @@ VRT_new_backend_clustered(VRT_CTX, struct vsmw_cluster *vc,
 	if (be == NULL)
 		return (NULL);
 	VTAILQ_INIT(&be->cw_head);
+	VTAILQ_INIT(&be->h2_head);
 
 #define DA(x)	do { if (vrt->x != NULL) REPLACE((be->x), (vrt->x)); } while (0)
 #define DN(x)	do { be->x = vrt->x; } while (0)
@@ -894,7 +1245,7 @@ VRT_new_backend_clustered(VRT_CTX, struct vsmw_cluster *vc,
 		vep = be->endpoint = VRT_Endpoint_Clone(vep);
 
 	AN(vep);
-	be->conn_pool = VCP_Ref(vep, vbe_proto_ident);
+	be->conn_pool = VCP_Ref(vep, be->h2c ? vbe_h2_ident : vbe_proto_ident);
 	AN(be->conn_pool);
 
 	vbp = vrt->probe;
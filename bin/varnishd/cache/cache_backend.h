@@ -44,6 +44,7 @@ struct vrt_ctx;
 struct vrt_backend_probe;
 struct conn_pool;
 struct connwait;
+struct vbe_h2;
 
 /*--------------------------------------------------------------------
  * An instance of a backend from a VCL program.
@@ -73,6 +74,8 @@ struct backend {
 
 	VTAILQ_HEAD(, connwait)	cw_head;
 	unsigned		cw_count;
+
+	VTAILQ_HEAD(, vbe_h2)	h2_head;
 };
 
 /*---------------------------------------------------------------------
@@ -262,6 +262,31 @@ BAN_NewObjCore(struct objcore *oc)
 	Lck_Unlock(&ban_mtx);
 }
 
+/*--------------------------------------------------------------------
+ * A new object replaces an existing one with the same content, grab a
+ * reference to the ban the old one was last checked against, so bans
+ * which have been added since still get tested.
+ */
+
+void
+BAN_InheritObjCore(struct objcore *oc, const struct objcore *from)
+{
+	struct ban *b;
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	CHECK_OBJ_NOTNULL(from, OBJCORE_MAGIC);
+	AZ(oc->ban);
+	AN(oc->objhead);
+	Lck_Lock(&ban_mtx);
+	b = from->ban;
+	if (b == NULL)
+		b = ban_start;
+	oc->ban = b;
+	b->refcount++;
+	VTAILQ_INSERT_TAIL(&b->objcore, oc, ban_list);
+	Lck_Unlock(&ban_mtx);
+}
+
 /*--------------------------------------------------------------------
  * An object is destroyed, release its ban reference
  */
@@ -50,7 +50,7 @@ VBO_Init(void)
 {
 
 	vbopool = MPL_New("busyobj", &cache_param->pool_vbo,
-	    &cache_param->workspace_backend);
+	    &cache_param->workspace_backend, WS_SizeAuto(WS_K_BACKEND));
 	AN(vbopool);
 }
 
@@ -155,6 +155,7 @@ VBO_ReleaseBusyObj(struct worker *wrk, struct busyobj **pbo)
 
 	if (WS_Overflowed(bo->ws))
 		wrk->stats->ws_backend_overflow++;
+	WS_SizeSample(WS_K_BACKEND, bo->ws, pdiff(bo, bo->ws->s));
 
 	if (bo->fetch_objcore != NULL) {
 		(void)HSH_DerefObjCore(wrk, &bo->fetch_objcore);
@@ -167,7 +168,54 @@ VBO_ReleaseBusyObj(struct worker *wrk, struct busyobj **pbo)
 	WS_Rollback(bo->ws, 0);
 #endif
 
-	MPL_Free(vbopool, bo);
+	/* Nothing expects the workspace to be zero */
+	MPL_FreeDirty(vbopool, bo, pdiff(bo, bo->ws->s));
+}
+
+/*--------------------------------------------------------------------
+ * With bereq_borrow, the bereq of a foreground fetch refers to headers
+ * of the client request, which goes on once the busy object streams or
+ * is done.
+ *
+ * The fetch processors see the bereq until the fetch is done, so before
+ * the busy object streams, the bereq is copied to the workspace.  The
+ * bereq0 is only needed to start over, which a streaming fetch no longer
+ * does, so it is cleared.  Returns non-zero if the workspace overflowed,
+ * in which case the bereq is still borrowed.
+ *
+ * A fetch which did not stream clears both once it is done.
+ */
+
+int
+VBO_BereqHome(struct busyobj *bo)
+{
+	const struct http *hp;
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	if (!bo->bereq_borrowed)
+		return (0);
+	hp = bo->bereq;
+	http_CopyHome(hp);
+	for (u = 0; u < hp->nhd; u++) {
+		if (hp->hd[u].b != NULL &&
+		    !WS_Allocated(hp->ws, hp->hd[u].b, Tlen(hp->hd[u])))
+			return (-1);
+	}
+	bo->bereq_borrowed = 0;
+	http_Teardown(bo->bereq0);
+	return (0);
+}
+
+static void
+vbo_bereq_return(struct busyobj *bo)
+{
+
+	if (!bo->bereq_borrowed)
+		return;
+	bo->bereq_borrowed = 0;
+	http_Teardown(bo->bereq0);
+	http_Teardown(bo->bereq);
 }
 
 void
@@ -187,6 +235,7 @@ VBO_SetState(struct worker *wrk, struct busyobj *bo, enum boc_state_e next)
 	case BOS_STREAM:
 		AN(bo->do_stream);
 		AZ(bo->req);
+		AZ(bo->bereq_borrowed);
 		broadcast = 1;
 		break;
 	case BOS_FINISHED:
@@ -200,6 +249,7 @@ VBO_SetState(struct worker *wrk, struct busyobj *bo, enum boc_state_e next)
 		 * to vcl_backend_error instead of a failed fetch attempt.
 		 */
 		bo->req = NULL;
+		vbo_bereq_return(bo);
 		broadcast = 1;
 		break;
 	default:
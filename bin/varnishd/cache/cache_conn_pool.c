@@ -51,6 +51,7 @@
 
 struct conn_pool;
 static inline int vcp_cmp(const struct conn_pool *a, const struct conn_pool *b);
+static void vcp_warm_poke(void);
 
 /*--------------------------------------------------------------------
  */
@@ -62,6 +63,7 @@ struct pfd {
 	VTAILQ_ENTRY(pfd)	list;
 	VCL_IP			addr;
 	uint8_t			state;
+	uint8_t			prewarmed;
 	struct waited		waited[1];
 	struct conn_pool	*conn_pool;
 
@@ -105,13 +107,25 @@ struct conn_pool {
 
 	int					n_used;
 
+	int					min_idle;
+	int					n_warm;
+
 	vtim_mono				holddown;
 	int					holddown_errno;
 };
 
+struct vcp_warm {
+	unsigned				magic;
+#define VCP_WARM_MAGIC				0x3f0b7d52
+	struct conn_pool			*cp;
+	struct pool_task			task[1];
+	VTAILQ_ENTRY(vcp_warm)			list;
+};
+
 static struct lock conn_pools_mtx;
 static struct lock dead_pools_mtx;
 static struct VSC_vcp *vsc;
+static pthread_cond_t vcp_warm_cond;
 
 VRBT_HEAD(vrb, conn_pool);
 VRBT_GENERATE_REMOVE_COLOR(vrb, conn_pool, entry, static)
@@ -161,6 +175,13 @@ PFD_Reused(const struct pfd *p)
 	return (p->reused);
 }
 
+unsigned
+PFD_Prewarmed(const struct pfd *p)
+{
+	CHECK_OBJ_NOTNULL(p, PFD_MAGIC);
+	return (p->prewarmed);
+}
+
 void
 PFD_LocalName(const struct pfd *p, char *abuf, unsigned alen, char *pbuf,
 	      unsigned plen)
@@ -354,6 +375,33 @@ VCP_RelPoll(void)
 	Lck_Unlock(&dead_pools_mtx);
 }
 
+/*--------------------------------------------------------------------
+ * Hand an idle connection to the waiter.
+ */
+
+static int
+vcp_park(const struct worker *wrk, struct conn_pool *cp, struct pfd *pfd)
+{
+
+	Lck_AssertHeld(&cp->mtx);
+	pfd->waited->priv1 = pfd;
+	pfd->waited->fd = pfd->fd;
+	pfd->waited->idle = VTIM_real();
+	pfd->state = PFD_STATE_AVAIL;
+	pfd->waited->func = vcp_handle;
+	pfd->waited->tmo = cache_param->backend_idle_timeout;
+	if (Wait_Enter(wrk->pool->waiter, pfd->waited)) {
+		cp->methods->close(pfd);
+		memset(pfd, 0x33, sizeof *pfd);
+		free(pfd);
+		// XXX: stats
+		return (0);
+	}
+	VTAILQ_INSERT_HEAD(&cp->connlist, pfd, list);
+	cp->n_conn++;
+	return (1);
+}
+
 /*--------------------------------------------------------------------
  * Recycle a connection.
  */
@@ -363,7 +411,7 @@ VCP_Recycle(const struct worker *wrk, struct pfd **pfdp)
 {
 	struct pfd *pfd;
 	struct conn_pool *cp;
-	int i = 0;
+	int i;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	TAKE_OBJ_NOTNULL(pfd, pfdp, PFD_MAGIC);
@@ -375,26 +423,8 @@ VCP_Recycle(const struct worker *wrk, struct pfd **pfdp)
 
 	Lck_Lock(&cp->mtx);
 	cp->n_used--;
-
-	pfd->waited->priv1 = pfd;
-	pfd->waited->fd = pfd->fd;
-	pfd->waited->idle = VTIM_real();
-	pfd->state = PFD_STATE_AVAIL;
-	pfd->waited->func = vcp_handle;
-	pfd->waited->tmo = cache_param->backend_idle_timeout;
-	if (Wait_Enter(wrk->pool->waiter, pfd->waited)) {
-		cp->methods->close(pfd);
-		memset(pfd, 0x33, sizeof *pfd);
-		free(pfd);
-		// XXX: stats
-		pfd = NULL;
-	} else {
-		VTAILQ_INSERT_HEAD(&cp->connlist, pfd, list);
-		i++;
-	}
-
-	if (pfd != NULL)
-		cp->n_conn++;
+	pfd->prewarmed = 0;
+	i = vcp_park(wrk, cp, pfd);
 	Lck_Unlock(&cp->mtx);
 
 	if (i && DO_DEBUG(DBG_VTC_MODE)) {
@@ -543,6 +573,7 @@ VCP_Get(struct conn_pool *cp, vtim_dur tmo, struct worker *wrk,
     unsigned force_fresh, int *err)
 {
 	struct pfd *pfd;
+	int warm;
 
 	CHECK_OBJ_NOTNULL(cp, CONN_POOL_MAGIC);
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
@@ -566,8 +597,11 @@ VCP_Get(struct conn_pool *cp, vtim_dur tmo, struct worker *wrk,
 		pfd->reused++;
 	}
 	cp->n_used++;			// Opening mostly works
+	warm = cp->n_conn + cp->n_warm < cp->min_idle;
 	Lck_Unlock(&cp->mtx);
 
+	if (warm)
+		vcp_warm_poke();
 	if (pfd != NULL)
 		return (pfd);
 
@@ -590,6 +624,131 @@ VCP_Get(struct conn_pool *cp, vtim_dur tmo, struct worker *wrk,
 	return (pfd);
 }
 
+/*--------------------------------------------------------------------
+ * Pre-warming keeps pools topped up with min_idle idle connections.
+ * A scheduler thread works out the shortfall and each missing
+ * connection is opened by a worker, so slow origins are connected
+ * to in parallel.  The pool reference held by each task keeps it
+ * from being destroyed under the connect.
+ */
+
+static void
+vcp_warm_poke(void)
+{
+
+	Lck_Lock(&conn_pools_mtx);
+	PTOK(pthread_cond_signal(&vcp_warm_cond));
+	Lck_Unlock(&conn_pools_mtx);
+}
+
+static void
+vcp_warm_done(struct vcp_warm *vw, struct pfd *pfd, const struct worker *wrk)
+{
+	struct conn_pool *cp;
+
+	CHECK_OBJ_NOTNULL(vw, VCP_WARM_MAGIC);
+	cp = vw->cp;
+	CHECK_OBJ_NOTNULL(cp, CONN_POOL_MAGIC);
+
+	Lck_Lock(&cp->mtx);
+	assert(cp->n_warm > 0);
+	cp->n_warm--;
+	if (pfd != NULL && vcp_park(wrk, cp, pfd))
+		VSC_C_main->backend_prewarm++;
+	Lck_Unlock(&cp->mtx);
+	VCP_Rel(&vw->cp);
+	FREE_OBJ(vw);
+}
+
+static void v_matchproto_(task_func_t)
+vcp_warm_task(struct worker *wrk, void *priv)
+{
+	struct vcp_warm *vw;
+	struct conn_pool *cp;
+	struct pfd *pfd;
+	int err;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CAST_OBJ_NOTNULL(vw, priv, VCP_WARM_MAGIC);
+	cp = vw->cp;
+	CHECK_OBJ_NOTNULL(cp, CONN_POOL_MAGIC);
+
+	ALLOC_OBJ(pfd, PFD_MAGIC);
+	AN(pfd);
+	INIT_OBJ(pfd->waited, WAITED_MAGIC);
+	pfd->conn_pool = cp;
+	pfd->fd = VCP_Open(cp, cache_param->connect_timeout, &pfd->addr, &err);
+	if (pfd->fd < 0) {
+		FREE_OBJ(pfd);
+	} else {
+		pfd->created = VTIM_mono();
+		pfd->prewarmed = 1;
+		VSC_C_main->backend_conn++;
+	}
+	vcp_warm_done(vw, pfd, wrk);
+}
+
+static void * v_matchproto_(bgthread_t)
+vcp_warmer(struct worker *wrk, void *priv)
+{
+	VTAILQ_HEAD(, vcp_warm) todo = VTAILQ_HEAD_INITIALIZER(todo);
+	struct conn_pool *cp;
+	struct vcp_warm *vw;
+	vtim_mono now;
+	int n;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	AZ(priv);
+	Lck_Lock(&conn_pools_mtx);
+	while (1) {
+		now = VTIM_mono();
+		VRBT_FOREACH(cp, vrb, &conn_pools) {
+			CHECK_OBJ_NOTNULL(cp, CONN_POOL_MAGIC);
+			Lck_Lock(&cp->mtx);
+			n = cp->min_idle - (cp->n_conn + cp->n_warm);
+			if (cp->holddown > 0 && now < cp->holddown)
+				n = 0;
+			for (; n > 0; n--) {
+				ALLOC_OBJ(vw, VCP_WARM_MAGIC);
+				AN(vw);
+				assert(cp->refcnt > 0);
+				cp->refcnt++;
+				cp->n_warm++;
+				vw->cp = cp;
+				VTAILQ_INSERT_TAIL(&todo, vw, list);
+			}
+			Lck_Unlock(&cp->mtx);
+		}
+		Lck_Unlock(&conn_pools_mtx);
+
+		while ((vw = VTAILQ_FIRST(&todo)) != NULL) {
+			VTAILQ_REMOVE(&todo, vw, list);
+			vw->task->func = vcp_warm_task;
+			vw->task->priv = vw;
+			if (Pool_Task_Any(vw->task, TASK_QUEUE_REQ))
+				vcp_warm_done(vw, NULL, wrk);
+		}
+
+		Lck_Lock(&conn_pools_mtx);
+		(void)Lck_CondWaitUntil(&vcp_warm_cond, &conn_pools_mtx,
+		    VTIM_real() + 1.0);
+	}
+	NEEDLESS(Lck_Unlock(&conn_pools_mtx));
+	NEEDLESS(return (NULL));
+}
+
+void
+VCP_Prewarm(struct conn_pool *cp, int n)
+{
+
+	CHECK_OBJ_NOTNULL(cp, CONN_POOL_MAGIC);
+	Lck_Lock(&cp->mtx);
+	cp->min_idle += n;
+	assert(cp->min_idle >= 0);
+	Lck_Unlock(&cp->mtx);
+	vcp_warm_poke();
+}
+
 /*--------------------------------------------------------------------
  */
 
@@ -678,12 +837,17 @@ VCP_Panic(struct vsb *vsb, struct conn_pool *cp)
 void
 VCP_Init(void)
 {
+	pthread_t thr;
+
 	Lck_New(&conn_pools_mtx, lck_conn_pool);
 	Lck_New(&dead_pools_mtx, lck_dead_pool);
 
 	AZ(vsc);
 	vsc = VSC_vcp_New(NULL, NULL, "");
 	AN(vsc);
+
+	PTOK(pthread_cond_init(&vcp_warm_cond, NULL));
+	WRK_BgThread(&thr, "backend-prewarm", vcp_warmer, NULL);
 }
 
 /**********************************************************************/
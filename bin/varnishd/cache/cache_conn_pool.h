@@ -47,6 +47,7 @@ unsigned PFD_State(const struct pfd *);
 int *PFD_Fd(struct pfd *);
 vtim_dur PFD_Age(const struct pfd *);
 uint64_t PFD_Reused(const struct pfd *);
+unsigned PFD_Prewarmed(const struct pfd *);
 void PFD_LocalName(const struct pfd *, char *, unsigned, char *, unsigned);
 void PFD_RemoteName(const struct pfd *, char *, unsigned, char *, unsigned);
 
@@ -105,3 +106,9 @@ int VCP_Wait(struct worker *, struct pfd *, vtim_real tmo);
 
 VCL_IP VCP_GetIp(struct pfd *);
 
+void VCP_Prewarm(struct conn_pool *, int n);
+	/*
+	 * Adjust the number of idle connections the pool keeps open
+	 * ahead of demand by n.
+	 */
+
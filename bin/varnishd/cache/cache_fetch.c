@@ -33,7 +33,10 @@
 
 #include "cache_varnishd.h"
 #include "cache_filter.h"
+#include "cache_obj.h"
 #include "cache_objhead.h"
+#include "cache_transport.h"
+#include "cache_vgz.h"
 #include "storage/storage.h"
 #include "vcl.h"
 #include "vtim.h"
@@ -222,6 +225,9 @@ vbf_beresp2obj(struct busyobj *bo)
 
 	AZ(ObjSetXID(bo->wrk, oc, bo->vsl->wid));
 
+	if (bo->slice_total > 0)
+		SLI_SetAttr(bo);
+
 	/* for HTTP_Encode() VSLH call */
 	bo->beresp->logtag = SLT_ObjMethod;
 
@@ -240,6 +246,56 @@ vbf_beresp2obj(struct busyobj *bo)
 	return (0);
 }
 
+/*--------------------------------------------------------------------
+ * With gzip_background, beresp.do_gzip is carried out by VGZ_Background()
+ * once the object is complete, instead of by the gzip VFP.
+ *
+ * The filter list is built before the object gets its storage, so this
+ * anticipates vbf_allocobj(): objects headed for Transient keep the gzip
+ * VFP, as nothing would ever compress them afterwards.
+ */
+
+int
+VBF_Gzip_Background(const struct busyobj *bo)
+{
+	const struct objcore *oc;
+
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	oc = bo->fetch_objcore;
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	return (bo->do_gzip && !bo->do_esi && !bo->uncacheable &&
+	    cache_param->gzip_background &&
+	    cache_param->http_gzip_support &&
+	    !(oc->flags & OC_F_TRANSIENT) &&
+	    bo->storage != NULL && bo->storage != stv_transient &&
+	    oc->ttl + oc->grace + oc->keep >= cache_param->shortlived &&
+	    !http_GetHdr(bo->beresp, H_Content_Encoding, NULL));
+}
+
+/*--------------------------------------------------------------------
+ * Send a cached req.body from its objcore and release req.  A body
+ * which was cached while it was sent (VRB_Tee) may have arrived
+ * chunked, so the bereq can lack a Content-Length header.
+ */
+
+static void
+vbf_cached_body(struct worker *wrk, struct busyobj *bo)
+{
+
+	CHECK_OBJ_NOTNULL(bo->req, REQ_MAGIC);
+	assert(bo->req->req_body_status == BS_CACHED);
+	AN(bo->req->body_oc);
+	AZ(bo->bereq_body);
+
+	bo->bereq_body = bo->req->body_oc;
+	HSH_Ref(bo->bereq_body);
+	http_Unset(bo->bereq, H_Transfer_Encoding);
+	if (!http_GetHdr(bo->bereq, H_Content_Length, NULL))
+		http_PrintfHeader(bo->bereq, "Content-Length: %ju",
+		    (uintmax_t)ObjGetLen(wrk, bo->bereq_body));
+	VBO_SetState(wrk, bo, BOS_REQ_DONE);
+}
+
 /*--------------------------------------------------------------------
  * Copy req->bereq and release req if no body
  */
@@ -272,7 +328,10 @@ vbf_stp_mkbereq(struct worker *wrk, struct busyobj *bo)
 	}
 	http_ForceField(bo->bereq0, HTTP_HDR_PROTO, "HTTP/1.1");
 
-	if (bo->stale_oc != NULL && !(bo->stale_oc->flags & OC_F_DYING) &&
+	SLI_Bereq(bo);
+
+	if (bo->slice_size == 0 &&
+	    bo->stale_oc != NULL && !(bo->stale_oc->flags & OC_F_DYING) &&
 	    ObjCheckFlag(bo->wrk, bo->stale_oc, OF_IMSCAND) &&
 	    (bo->stale_oc->boc != NULL || ObjGetLen(wrk, bo->stale_oc) != 0)) {
 		AZ(bo->stale_oc->flags & (OC_F_HFM|OC_F_PRIVATE));
@@ -286,7 +345,11 @@ vbf_stp_mkbereq(struct worker *wrk, struct busyobj *bo)
 			    "If-None-Match: %s", q);
 	}
 
-	http_CopyHome(bo->bereq0);
+	/* See VBO_SetState() for when borrowed headers are given back */
+	if (bo->is_bgfetch || !cache_param->bereq_borrow)
+		http_CopyHome(bo->bereq0);
+	else
+		bo->bereq_borrowed = 1;
 	HTTP_Setup(bo->bereq, bo->ws, bo->vsl, SLT_BereqMethod);
 	bo->ws_bo = WS_Snapshot(bo->ws);
 	HTTP_Clone(bo->bereq, bo->bereq0);
@@ -294,10 +357,7 @@ vbf_stp_mkbereq(struct worker *wrk, struct busyobj *bo)
 	if (bo->req->req_body_status->avail == 0) {
 		VBO_SetState(bo->wrk, bo, BOS_REQ_DONE);
 	} else if (bo->req->req_body_status == BS_CACHED) {
-		AN(bo->req->body_oc);
-		bo->bereq_body = bo->req->body_oc;
-		HSH_Ref(bo->bereq_body);
-		VBO_SetState(bo->wrk, bo, BOS_REQ_DONE);
+		vbf_cached_body(wrk, bo);
 	}
 	return (F_STP_STARTFETCH);
 }
@@ -331,6 +391,7 @@ vbf_stp_retry(struct worker *wrk, struct busyobj *bo)
 	bo->do_esi = 0;
 	bo->do_stream = 1;
 	bo->was_304 = 0;
+	bo->gzip_background = 0;
 	bo->err_code = 0;
 	bo->err_reason = NULL;
 	bo->connect_timeout = NAN;
@@ -339,6 +400,11 @@ vbf_stp_retry(struct worker *wrk, struct busyobj *bo)
 	if (bo->htc != NULL)
 		bo->htc->doclose = SC_NULL;
 
+	/* The req.body may have been cached while it was sent */
+	if (bo->req != NULL && bo->bereq_body == NULL &&
+	    bo->req->req_body_status == BS_CACHED)
+		vbf_cached_body(wrk, bo);
+
 	// XXX: BereqEnd + BereqAcct ?
 	VSL_ChgId(bo->vsl, "bereq", "retry", VXID_Get(wrk, VSL_BACKENDMARKER));
 	VSLb_ts_busyobj(bo, "Start", bo->t_prev);
@@ -456,6 +522,20 @@ vbf_stp_startfetch(struct worker *wrk, struct busyobj *bo)
 		return (F_STP_ERROR);
 	}
 
+	i = SLI_CheckBo(bo);
+	if (i != 0) {
+		if (bo->htc != NULL && bo->htc->body_status != BS_NONE)
+			bo->htc->doclose = SC_RESP_CLOSE;
+		vbf_cleanup(bo);
+		if (i > 0)
+			return (F_STP_FAIL);
+		/* Fetch the whole object instead */
+		bo->slice_size = 0;
+		http_Unset(bo->bereq0, H_Range);
+		http_Unset(bo->bereq, H_Range);
+		return (F_STP_RETRY);
+	}
+
 	if (!http_GetHdr(bo->beresp, H_Date, NULL)) {
 		/*
 		 * RFC 2616 14.18 Date: The Date general-header field
@@ -601,6 +681,12 @@ vbf_stp_startfetch(struct worker *wrk, struct busyobj *bo)
 	if (oc->boc->state != BOS_REQ_DONE)
 		VBO_SetState(wrk, bo, BOS_REQ_DONE);
 
+	if (bo->slice_total > 0) {
+		/* Slices are put together from the stored bytes */
+		bo->do_esi = 0;
+		bo->do_gzip = 0;
+		bo->do_gunzip = 0;
+	}
 	if (bo->do_esi)
 		bo->do_stream = 0;
 	if (wrk->vpi->handling == VCL_RET_PASS) {
@@ -743,6 +829,15 @@ vbf_stp_fetch(struct worker *wrk, struct busyobj *bo)
 		return (F_STP_ERROR);
 	}
 
+	/* Latch the decision, vbf_allocobj() clears bo->storage */
+	bo->gzip_background = !(bo->vfc->obj_flags & OF_GZIPED) &&
+	    VBF_Gzip_Background(bo);
+	if (bo->gzip_background) {
+		/* As the gzip VFP would, for the copy made later */
+		RFC2616_Weaken_Etag(bo->beresp);
+		RFC2616_Vary_AE(bo->beresp);
+	}
+
 	if (vbf_beresp2obj(bo)) {
 		bo->htc->doclose = SC_RX_BODY;
 		vbf_cleanup(bo);
@@ -764,6 +859,13 @@ vbf_stp_fetch(struct worker *wrk, struct busyobj *bo)
 
 	assert(oc->boc->state == BOS_REQ_DONE);
 
+	if (bo->do_stream && VBO_BereqHome(bo)) {
+		(void)VFP_Error(bo->vfc, "Out of workspace for the bereq");
+		bo->htc->doclose = SC_RX_BODY;
+		vbf_cleanup(bo);
+		return (F_STP_ERROR);
+	}
+
 	if (bo->do_stream)
 		VBO_SetState(wrk, bo, BOS_STREAM);
 
@@ -811,6 +913,8 @@ vbf_stp_fetchend(struct worker *wrk, struct busyobj *bo)
 		    VXID(ObjGetXID(wrk, bo->fetch_objcore)));
 		HSH_Replace(bo->stale_oc, bo->fetch_objcore);
 	}
+	if (bo->gzip_background)
+		VGZ_Background(wrk, oc);
 	return (F_STP_DONE);
 }
 
@@ -924,20 +1028,26 @@ vbf_stp_condfetch(struct worker *wrk, struct busyobj *bo)
 
 	if (ObjHasAttr(bo->wrk, stale_oc, OA_ESIDATA))
 		AZ(ObjCopyAttr(bo->wrk, oc, stale_oc, OA_ESIDATA));
+	if (ObjHasAttr(bo->wrk, stale_oc, OA_IDENTITY))
+		(void)ObjCopyAttr(bo->wrk, oc, stale_oc, OA_IDENTITY);
 
 	AZ(ObjCopyAttr(bo->wrk, oc, stale_oc, OA_FLAGS));
 	if (oc->flags & OC_F_HFM)
 		ObjSetFlag(bo->wrk, oc, OF_IMSCAND, 0);
 	AZ(ObjCopyAttr(bo->wrk, oc, stale_oc, OA_GZIPBITS));
 
-	if (bo->do_stream)
-		VBO_SetState(wrk, bo, BOS_STREAM);
-
-	INIT_OBJ(vop, VBF_OBITER_PRIV_MAGIC);
-	vop->bo = bo;
-	vop->l = ObjGetLen(bo->wrk, stale_oc);
-	if (ObjIterate(wrk, stale_oc, vop, vbf_objiterate, 0))
-		(void)VFP_Error(bo->vfc, "Template object failed");
+	if (bo->do_stream && VBO_BereqHome(bo))
+		(void)VFP_Error(bo->vfc, "Out of workspace for the bereq");
+	else {
+		if (bo->do_stream)
+			VBO_SetState(wrk, bo, BOS_STREAM);
+
+		INIT_OBJ(vop, VBF_OBITER_PRIV_MAGIC);
+		vop->bo = bo;
+		vop->l = ObjGetLen(bo->wrk, stale_oc);
+		if (ObjIterate(wrk, stale_oc, vop, vbf_objiterate, 0))
+			(void)VFP_Error(bo->vfc, "Template object failed");
+	}
 
 	if (bo->vfc->failed) {
 		vbf_cleanup(bo);
@@ -1184,7 +1294,6 @@ void
 VBF_Fetch(struct worker *wrk, struct req *req, struct objcore *oc,
     struct objcore *oldoc, enum vbf_fetch_mode_e mode)
 {
-	enum boc_state_e state;
 	struct boc *boc;
 	struct busyobj *bo;
 	enum task_prio prio;
@@ -1269,15 +1378,14 @@ VBF_Fetch(struct worker *wrk, struct req *req, struct objcore *oc,
 	} else {
 		THR_SetBusyobj(NULL);
 		bo = NULL; /* ref transferred to fetch thread */
-		if (mode == VBF_BACKGROUND) {
-			(void)ObjWaitState(oc, BOS_REQ_DONE);
-			(void)VRB_Ignore(req);
-		} else {
-			state = ObjWaitState(oc, BOS_STREAM);
-			AZ(oc->flags & OC_F_BUSY);
-			if (state == BOS_FAILED)
-				AN(oc->flags & OC_F_FAILED);
+		if (mode != VBF_BACKGROUND) {
+			/* The boc ref is released by VBF_Wait() */
+			AZ(req->boc);
+			req->boc = boc;
+			return;
 		}
+		(void)ObjWaitState(oc, BOS_REQ_DONE);
+		(void)VRB_Ignore(req);
 	}
 	AZ(bo);
 	VSLb_ts_req(req, "Fetch", W_TIM_real(wrk));
@@ -1286,3 +1394,67 @@ VBF_Fetch(struct worker *wrk, struct req *req, struct objcore *oc,
 	if (mode == VBF_BACKGROUND)
 		(void)HSH_DerefObjCore(wrk, &oc);
 }
+
+/*--------------------------------------------------------------------
+ * Wait for a foreground fetch to start delivering
+ *
+ * With req_park, a request which has nothing left to hand to the fetch
+ * disembarks instead of holding on to its worker, and is rescheduled
+ * when the busy object reaches BOS_STREAM or fails.  Returns non-zero
+ * if the request was parked.
+ */
+
+static void v_matchproto_(vai_notify_cb)
+vbf_unpark(vai_hdl hdl, void *priv)
+{
+	struct req *req;
+
+	(void)hdl;
+	CAST_OBJ_NOTNULL(req, priv, REQ_MAGIC);
+	AZ(req->wrk);
+	/* Like the waiting list rush, this ignores the queue limits */
+	AZ(Pool_Task(req->sp->pool, req->task, TASK_QUEUE_RUSH));
+}
+
+int
+VBF_Wait(struct worker *wrk, struct req *req)
+{
+	enum boc_state_e state;
+	struct objcore *oc;
+	struct vai_qe *qe;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	oc = req->objcore;
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	CHECK_OBJ_NOTNULL(req->boc, BOC_MAGIC);
+	assert(oc->boc == req->boc);
+
+	/* NB: unlocked peek, ObjParkState() looks again */
+	if (cache_param->req_park && req->boc->state < BOS_STREAM &&
+	    req->transport->reembark == NULL &&
+	    (req->req_body_status->avail == 0 ||
+	    req->req_body_status == BS_CACHED)) {
+		qe = WS_Alloc(req->ws, sizeof *qe);
+		if (qe != NULL) {
+			INIT_OBJ(qe, VAI_Q_MAGIC);
+			qe->cb = vbf_unpark;
+			qe->priv = req;
+			req->wrk = NULL;
+			if (ObjParkState(oc, qe)) {
+				wrk->stats->req_parked++;
+				return (1);
+			}
+			req->wrk = wrk;
+		}
+	}
+
+	state = ObjWaitState(oc, BOS_STREAM);
+	AZ(oc->flags & OC_F_BUSY);
+	if (state == BOS_FAILED)
+		AN(oc->flags & OC_F_FAILED);
+	VSLb_ts_req(req, "Fetch", W_TIM_real(wrk));
+	req->boc = NULL;
+	HSH_DerefBoc(wrk, oc);
+	return (0);
+}
@@ -69,6 +69,8 @@ struct vgz {
 
 	intmax_t		bits;
 
+	struct vsb		*ident;
+
 	z_stream		vz;
 };
 
@@ -118,8 +120,8 @@ VGZ_NewTestGunzip(struct vsl_log *vsl, const char *id)
 	return (vgz_gunzip(vsl, id));
 }
 
-struct vgz *
-VGZ_NewGzip(struct vsl_log *vsl, const char *id)
+static struct vgz *
+vgz_gzip(struct vsl_log *vsl, const char *id, unsigned level)
 {
 	struct vgz *vg;
 	int i;
@@ -142,7 +144,7 @@ VGZ_NewGzip(struct vsl_log *vsl, const char *id)
 	 * memLevel [1..9] (-> 1K->256K)
 	 */
 	i = deflateInit2(&vg->vz,
-	    cache_param->gzip_level,		/* Level */
+	    level,				/* Level */
 	    Z_DEFLATED,				/* Method */
 	    16 + 15,				/* Window bits (16=gzip) */
 	    cache_param->gzip_memlevel,		/* memLevel */
@@ -151,6 +153,13 @@ VGZ_NewGzip(struct vsl_log *vsl, const char *id)
 	return (vg);
 }
 
+struct vgz *
+VGZ_NewGzip(struct vsl_log *vsl, const char *id)
+{
+
+	return (vgz_gzip(vsl, id, cache_param->gzip_level));
+}
+
 /*--------------------------------------------------------------------
  */
 
@@ -628,10 +637,101 @@ const struct vdp VDP_gunzip = {
 	.io_fini =	vdpio_gunzip_fini,
 };
 
+/*--------------------------------------------------------------------
+ * VDP_IDENTITY
+ *
+ * Send the uncompressed copy collected by the gzip and testgunzip VFPs
+ * in place of the gzip'ed body.
+ */
+
+struct vdp_identity {
+	unsigned		magic;
+#define VDP_IDENTITY_MAGIC	0x5c1d4e29
+	const void		*ptr;
+	ssize_t			len;
+};
+
+static int v_matchproto_(vdp_init_f)
+vdp_identity_init(VRT_CTX, struct vdp_ctx *vdc, void **priv)
+{
+	struct vdp_identity *vid;
+	struct boc *boc;
+	const void *p;
+	ssize_t l;
+
+	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
+	CHECK_OBJ_NOTNULL(vdc, VDP_CTX_MAGIC);
+	CHECK_OBJ_ORNULL(vdc->oc, OBJCORE_MAGIC);
+	CHECK_OBJ_NOTNULL(vdc->hp, HTTP_MAGIC);
+	AN(vdc->clen);
+	AN(priv);
+
+	/* Only the complete body of the object itself will do */
+	if (vdc->oc == NULL || !ObjCheckFlag(vdc->wrk, vdc->oc, OF_GZIPED))
+		return (1);
+	boc = HSH_RefBoc(vdc->oc);
+	if (boc != NULL) {
+		HSH_DerefBoc(vdc->wrk, vdc->oc);
+		return (1);
+	}
+	p = ObjGetAttr(vdc->wrk, vdc->oc, OA_IDENTITY, &l);
+	if (p == NULL || l <= 0)
+		return (1);
+
+	vid = WS_Alloc(ctx->ws, sizeof *vid);
+	if (vid == NULL)
+		return (-1);
+	INIT_OBJ(vid, VDP_IDENTITY_MAGIC);
+	vid->ptr = p;
+	vid->len = l;
+	*priv = vid;
+
+	http_Unset(vdc->hp, H_Content_Encoding);
+	*vdc->clen = l;
+	return (0);
+}
+
+static int v_matchproto_(vdp_fini_f)
+vdp_identity_fini(struct vdp_ctx *vdc, void **priv)
+{
+
+	(void)vdc;
+	AN(priv);
+	*priv = NULL;
+	return (0);
+}
+
+static int v_matchproto_(vdp_bytes_f)
+vdp_identity_bytes(struct vdp_ctx *vdc, enum vdp_action act, void **priv,
+    const void *ptr, ssize_t len)
+{
+	struct vdp_identity *vid;
+
+	CHECK_OBJ_NOTNULL(vdc, VDP_CTX_MAGIC);
+	(void)act;
+	(void)ptr;
+	(void)len;
+
+	TAKE_OBJ_NOTNULL(vid, priv, VDP_IDENTITY_MAGIC);
+	vdc->bytes_done = vid->len;
+	if (VDP_bytes(vdc, VDP_END, vid->ptr, vid->len))
+		return (vdc->retval);
+	/* Stop the iteration over the gzip'ed body */
+	return (1);
+}
+
+const struct vdp VDP_identity = {
+	.name =		"identity",
+	.init =		vdp_identity_init,
+	.bytes =	vdp_identity_bytes,
+	.fini =		vdp_identity_fini,
+};
+
 /*--------------------------------------------------------------------*/
 
-void
-VGZ_UpdateObj(const struct vfp_ctx *vc, struct vgz *vg, enum vgzret_e e)
+static void
+vgz_setbits(struct worker *wrk, struct objcore *oc, struct vgz *vg,
+    enum vgzret_e e)
 {
 	char *p;
 	intmax_t ii;
@@ -643,7 +743,7 @@ VGZ_UpdateObj(const struct vfp_ctx *vc, struct vgz *vg, enum vgzret_e e)
 	if (e != VGZ_END && ii == vg->bits)
 		return;
 	vg->bits = ii;
-	p = ObjSetAttr(vc->wrk, vc->oc, OA_GZIPBITS, 32, NULL);
+	p = ObjSetAttr(wrk, oc, OA_GZIPBITS, 32, NULL);
 	AN(p);
 	vbe64enc(p, vg->vz.start_bit);
 	vbe64enc(p + 8, vg->vz.last_bit);
@@ -656,6 +756,14 @@ VGZ_UpdateObj(const struct vfp_ctx *vc, struct vgz *vg, enum vgzret_e e)
 		vbe64enc(p + 24, vg->vz.total_out);
 }
 
+void
+VGZ_UpdateObj(const struct vfp_ctx *vc, struct vgz *vg, enum vgzret_e e)
+{
+
+	CHECK_OBJ_NOTNULL(vc, VFP_CTX_MAGIC);
+	vgz_setbits(vc->wrk, vc->oc, vg, e);
+}
+
 /*--------------------------------------------------------------------
  */
 
@@ -687,6 +795,8 @@ VGZ_Destroy(struct worker *wrk, struct vgz **vgp)
 		STV_FreeBuf(wrk, &vg->stvbuf);
 	}
 	AZ(vg->stvbuf);
+	if (vg->ident != NULL)
+		VSB_destroy(&vg->ident);
 	if (i == Z_OK)
 		vr = VGZ_OK;
 	else if (i == Z_STREAM_END)
@@ -741,6 +851,11 @@ vfp_gzip_init(VRT_CTX, struct vfp_ctx *vc, struct vfp_entry *vfe)
 	vfe->priv1 = vg;
 	if (vgz_getmbuf(vc->wrk, vg))
 		return (VFP_ERROR);
+	if (vfe->vfp != &VFP_gunzip && cache_param->gzip_identity_max > 0 &&
+	    !(vc->oc->flags & OC_F_TRANSIENT)) {
+		vg->ident = VSB_new_auto();
+		AN(vg->ident);
+	}
 	VGZ_Ibuf(vg, vg->m_buf, 0);
 	AZ(vg->m_len);
 
@@ -759,6 +874,43 @@ vfp_gzip_init(VRT_CTX, struct vfp_ctx *vc, struct vfp_entry *vfe)
 	return (VFP_OK);
 }
 
+/*--------------------------------------------------------------------
+ * Collect an uncompressed copy of the body while gzip'ing or testing it,
+ * the VDP_identity below delivers it to clients which do not accept gzip.
+ */
+
+static void
+vgz_ident_add(struct vgz *vg, const void *ptr, ssize_t len)
+{
+
+	CHECK_OBJ_NOTNULL(vg, VGZ_MAGIC);
+	if (vg->ident == NULL || len <= 0)
+		return;
+	if (VSB_len(vg->ident) + len > cache_param->gzip_identity_max ||
+	    VSB_bcat(vg->ident, ptr, len))
+		VSB_destroy(&vg->ident);
+}
+
+static void
+vgz_ident_commit(const struct vfp_ctx *vc, const struct vfp_entry *vfe,
+    struct vgz *vg)
+{
+
+	CHECK_OBJ_NOTNULL(vc, VFP_CTX_MAGIC);
+	CHECK_OBJ_NOTNULL(vfe, VFP_ENTRY_MAGIC);
+	CHECK_OBJ_NOTNULL(vg, VGZ_MAGIC);
+	if (vg->ident == NULL)
+		return;
+	/* Only valid if we produce what ends up in storage */
+	if (VTAILQ_FIRST(&vc->vfp) == vfe && !VSB_finish(vg->ident) &&
+	    VSB_len(vg->ident) > 0 &&
+	    ObjSetAttr(vc->wrk, vc->oc, OA_IDENTITY,
+	    VSB_len(vg->ident), VSB_data(vg->ident)) == NULL)
+		VSLb(vc->wrk->vsl, SLT_Debug,
+		    "Could not allocate storage for identity copy");
+	VSB_destroy(&vg->ident);
+}
+
 /*--------------------------------------------------------------------
  * VFP_GUNZIP
  *
@@ -847,6 +999,7 @@ vfp_gzip_pull(struct vfp_ctx *vc, struct vfp_entry *vfe, void *p,
 			if (vp == VFP_END)
 				vg->flag = VGZ_FINISH;
 			VGZ_Ibuf(vg, vg->m_buf, l);
+			vgz_ident_add(vg, vg->m_buf, l);
 		}
 		if (!VGZ_IbufEmpty(vg) || vg->flag == VGZ_FINISH) {
 			vr = VGZ_Gzip(vg, &dp, &dl, vg->flag);
@@ -866,6 +1019,7 @@ vfp_gzip_pull(struct vfp_ctx *vc, struct vfp_entry *vfe, void *p,
 	if (vr != VGZ_END)
 		return (VFP_Error(vc, "Gzip failed"));
 	VGZ_UpdateObj(vc, vg, VGZ_END);
+	vgz_ident_commit(vc, vfe, vg);
 	return (VFP_END);
 }
 
@@ -904,11 +1058,14 @@ vfp_testgunzip_pull(struct vfp_ctx *vc, struct vfp_entry *vfe, void *p,
 			if (vr < VGZ_OK)
 				return (VFP_Error(vc,
 				    "Invalid Gzip data: %s", vgz_msg(vg)));
+			vgz_ident_add(vg, dp, dl);
 		} while (!VGZ_IbufEmpty(vg));
 	}
 	VGZ_UpdateObj(vc, vg, vr);
 	if (vp == VFP_END && vr != VGZ_END)
 		return (VFP_Error(vc, "tGunzip failed"));
+	if (vp == VFP_END)
+		vgz_ident_commit(vc, vfe, vg);
 	return (vp);
 }
 
@@ -953,3 +1110,212 @@ const struct vfp VFP_testgunzip = {
 	.fini = vfp_gzip_fini,
 	.priv1 = "u F -",
 };
+
+/*--------------------------------------------------------------------
+ * Background gzip
+ *
+ * With the gzip_background parameter, beresp.do_gzip objects are stored
+ * uncompressed and a copy gzip'ed at gzip_background_level replaces them
+ * once the fetch is done.  Clients keep being served the original until
+ * then, compression never adds to the fetch.
+ */
+
+struct vgz_bg {
+	unsigned		magic;
+#define VGZ_BG_MAGIC		0x5e0b7c41
+	struct worker		*wrk;
+	struct objcore		*oc;
+	struct vgz		*vg;
+	enum vgzret_e		vr;
+	struct pool_task	task;
+};
+
+static int v_matchproto_(objiterate_f)
+vgz_bg_iterate(void *priv, unsigned flush, const void *ptr, ssize_t len)
+{
+	struct vgz_bg *bg;
+	struct vgz *vg;
+	enum vgz_flag flg;
+	const void *dp;
+	ssize_t dl, sz;
+	uint8_t *p;
+
+	CAST_OBJ_NOTNULL(bg, priv, VGZ_BG_MAGIC);
+	vg = bg->vg;
+	CHECK_OBJ_NOTNULL(vg, VGZ_MAGIC);
+
+	flg = (flush & OBJ_ITER_END) ? VGZ_FINISH : VGZ_NORMAL;
+	vgz_ident_add(vg, ptr, len);
+	VGZ_Ibuf(vg, ptr, len);
+	do {
+		if (VGZ_ObufFull(vg)) {
+			sz = cache_param->fetch_chunksize;
+			if (!ObjGetSpace(bg->wrk, bg->oc, &sz, &p))
+				return (-1);
+			VGZ_Obuf(vg, p, sz);
+		}
+		bg->vr = VGZ_Gzip(vg, &dp, &dl, flg);
+		if (bg->vr < VGZ_OK)
+			return (-1);
+		if (dl > 0)
+			ObjExtend(bg->wrk, bg->oc, dl, 0);
+	} while (!VGZ_IbufEmpty(vg) ||
+	    (flg == VGZ_FINISH && bg->vr != VGZ_END));
+	return (0);
+}
+
+static int
+vgz_bg_fill(struct vgz_bg *bg, struct objcore *oc)
+{
+	struct worker *wrk;
+	struct objcore *noc;
+	const uint8_t *vary;
+	ssize_t varyl;
+	unsigned l;
+	uint8_t *p;
+
+	CHECK_OBJ_NOTNULL(bg, VGZ_BG_MAGIC);
+	wrk = bg->wrk;
+	noc = bg->oc;
+	CHECK_OBJ_NOTNULL(noc, OBJCORE_MAGIC);
+
+	vary = ObjGetAttr(wrk, oc, OA_VARY, &varyl);
+	if (vary == NULL)
+		varyl = 0;
+	l = HTTP_SetHdrPack(wrk, oc, H_Content_Encoding,
+	    "Content-Encoding: gzip", NULL, 0);
+	noc->t_origin = oc->t_origin;
+	noc->ttl = oc->ttl;
+	noc->grace = oc->grace;
+	noc->keep = oc->keep;
+	if (!STV_NewObject(wrk, noc, oc->stobj->stevedore,
+	    PRNDUP(varyl) + l))
+		return (-1);
+
+	if (varyl > 0)
+		AN(ObjSetAttr(wrk, noc, OA_VARY, varyl, vary));
+	AZ(ObjSetXID(wrk, noc, ObjGetXID(wrk, oc)));
+	p = ObjSetAttr(wrk, noc, OA_HEADERS, l, NULL);
+	AN(p);
+	(void)HTTP_SetHdrPack(wrk, oc, H_Content_Encoding,
+	    "Content-Encoding: gzip", p, l);
+	AZ(ObjCopyAttr(wrk, noc, oc, OA_LASTMODIFIED));
+	AZ(ObjCopyAttr(wrk, noc, oc, OA_FLAGS));
+	ObjSetFlag(wrk, noc, OF_GZIPED, 1);
+	ObjSetFlag(wrk, noc, OF_CHGCE, 1);
+	bg->vg = vgz_gzip(wrk->vsl, "G B -",
+	    cache_param->gzip_background_level);
+	AN(bg->vg);
+	if (cache_param->gzip_identity_max > 0) {
+		bg->vg->ident = VSB_new_auto();
+		AN(bg->vg->ident);
+	}
+	bg->vr = VGZ_OK;
+	if (ObjIterate(wrk, oc, bg, vgz_bg_iterate, 0) ||
+	    bg->vr != VGZ_END) {
+		(void)VGZ_Destroy(wrk, &bg->vg);
+		return (-1);
+	}
+	ObjExtend(wrk, noc, 0, 1);
+	vgz_setbits(wrk, noc, bg->vg, VGZ_END);
+	if (bg->vg->ident != NULL && !VSB_finish(bg->vg->ident) &&
+	    ObjSetAttr(wrk, noc, OA_IDENTITY, VSB_len(bg->vg->ident),
+	    VSB_data(bg->vg->ident)) == NULL)
+		VSLb(wrk->vsl, SLT_Debug,
+		    "Could not allocate storage for identity copy");
+	if (VGZ_Destroy(wrk, &bg->vg) != VGZ_END)
+		return (-1);
+	AZ(ObjSetU64(wrk, noc, OA_LEN, noc->boc->fetched_so_far));
+	return (0);
+}
+
+static void v_matchproto_(task_func_t)
+vgz_bg_task(struct worker *wrk, void *priv)
+{
+	struct vgz_bg *bg;
+	struct objcore *oc, *noc;
+	struct vsl_log vsl;
+	uint32_t vsl_buf[256];
+	uint8_t *vary = NULL;
+	const uint8_t *vp;
+	ssize_t l;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CAST_OBJ_NOTNULL(bg, priv, VGZ_BG_MAGIC);
+	TAKE_OBJ_NOTNULL(oc, &bg->oc, OBJCORE_MAGIC);
+
+	VSL_Setup(&vsl, vsl_buf, sizeof vsl_buf);
+	AZ(wrk->vsl);
+	wrk->vsl = &vsl;
+
+	/* Keep lookups for other variants from waiting on the copy */
+	vp = ObjGetAttr(wrk, oc, OA_VARY, &l);
+	if (vp != NULL) {
+		vary = malloc(l);
+		AN(vary);
+		memcpy(vary, vp, l);
+	}
+
+	noc = HSH_NewSibling(wrk, oc, vary);
+	if (noc != NULL) {
+		bg->wrk = wrk;
+		bg->oc = noc;
+		if (vgz_bg_fill(bg, oc)) {
+			ObjSetState(wrk, noc, BOS_FAILED, 1);
+			HSH_Kill(noc);
+		} else {
+			BAN_InheritObjCore(noc, oc);
+			ObjSetState(wrk, noc, BOS_FINISHED, 1);
+			if (!HSH_Supersede(oc, noc)) {
+				VSL(SLT_ExpKill, NO_VXID,
+				    "VBF_Superseded x=%ju n=%ju",
+				    VXID(ObjGetXID(wrk, oc)),
+				    VXID(ObjGetXID(wrk, noc)));
+				VSC_C_main->n_gzip_background++;
+			}
+		}
+		HSH_DerefBoc(wrk, noc);
+		(void)HSH_DerefObjCore(wrk, &noc);
+	}
+	(void)HSH_DerefObjCore(wrk, &oc);
+	FREE_OBJ(bg);
+
+	VSL_Flush(&vsl, 0);
+	wrk->vsl = NULL;
+}
+
+/*
+ * The object was stored with the headers the gzip VFP would have given
+ * it, so it must be compressed even if no other worker is available: the
+ * calling fetch worker then does it itself.  Clients are already served
+ * the finished original in the meantime.
+ */
+
+void
+VGZ_Background(struct worker *wrk, struct objcore *oc)
+{
+	struct vgz_bg *bg;
+	struct vsl_log *vsl;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+
+	if (oc->flags & OC_F_TRANSIENT ||
+	    ObjCheckFlag(wrk, oc, OF_GZIPED) ||
+	    ObjCheckFlag(wrk, oc, OF_ESIPROC) ||
+	    ObjGetLen(wrk, oc) == 0)
+		return;
+
+	ALLOC_OBJ(bg, VGZ_BG_MAGIC);
+	AN(bg);
+	HSH_Ref(oc);
+	bg->oc = oc;
+	bg->task.func = vgz_bg_task;
+	bg->task.priv = bg;
+	if (Pool_Task(wrk->pool, &bg->task, TASK_QUEUE_BG) == 0)
+		return;
+	vsl = wrk->vsl;
+	wrk->vsl = NULL;
+	vgz_bg_task(wrk, bg);
+	wrk->vsl = vsl;
+}
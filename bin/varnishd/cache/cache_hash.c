@@ -64,6 +64,8 @@
 
 #include "hash/hash_slinger.h"
 
+#include "vend.h"
+#include "vrnd.h"
 #include "vsha256.h"
 
 struct rush {
@@ -76,7 +78,7 @@ static const struct hash_slinger *hash;
 #define PRIVATE_OH_EXP 7
 static struct objhead private_ohs[1 << PRIVATE_OH_EXP];
 
-static void hsh_rush1(const struct worker *, struct objcore *,
+static void hsh_rush1(struct worker *, struct objcore *,
     struct rush *);
 static void hsh_rush2(struct worker *, struct rush *);
 static int hsh_deref_objhead(struct worker *wrk, struct objhead **poh);
@@ -212,6 +214,135 @@ HSH_DeleteObjHead(const struct worker *wrk, struct objhead *oh)
 	FREE_OBJ(oh);
 }
 
+/*---------------------------------------------------------------------
+ * The fast digest runs four independent 64 bit multiply-rotate lanes
+ * over 32 byte stripes, in the style of xxHash, and derives each of
+ * the four output words from all lanes and the length.  The lanes are
+ * seeded randomly at startup so that collisions cannot be precomputed.
+ */
+
+#define HF_P1	0x9e3779b185ebca87ULL
+#define HF_P2	0xc2b2ae3d27d4eb4fULL
+#define HF_P3	0x165667b19e3779f9ULL
+#define HF_P4	0x85ebca77c2b2ae63ULL
+#define HF_P5	0x27d4eb2f165667c5ULL
+
+static unsigned hsh_fast_digest;
+static uint64_t hsh_fast_seed[4];
+
+static inline uint64_t
+hf_rotl(uint64_t x, unsigned r)
+{
+	return ((x << r) | (x >> (64 - r)));
+}
+
+static inline uint64_t
+hf_round(uint64_t acc, uint64_t in)
+{
+	acc += in * HF_P2;
+	acc = hf_rotl(acc, 31);
+	return (acc * HF_P1);
+}
+
+static inline uint64_t
+hf_avalanche(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= HF_P2;
+	h ^= h >> 29;
+	h *= HF_P3;
+	h ^= h >> 32;
+	return (h);
+}
+
+static void
+hf_stripe(struct hsh_fast *hf, const uint8_t *p)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		hf->v[i] = hf_round(hf->v[i], vle64dec(p + i * 8));
+}
+
+static void
+hf_update(struct hsh_fast *hf, const void *ptr, size_t len)
+{
+	const uint8_t *p = ptr;
+	size_t r, l;
+
+	r = hf->len & 0x1f;
+	hf->len += len;
+	if (r > 0) {
+		l = vmin_t(size_t, len, 32 - r);
+		memcpy(hf->buf + r, p, l);
+		p += l;
+		len -= l;
+		if (r + l < 32)
+			return;
+		hf_stripe(hf, hf->buf);
+	}
+	for (; len >= 32; len -= 32, p += 32)
+		hf_stripe(hf, p);
+	memcpy(hf->buf, p, len);
+}
+
+static void
+hf_final(struct hsh_fast *hf, uint8_t *digest)
+{
+	uint64_t h;
+	size_t r;
+	int i;
+
+	r = hf->len & 0x1f;
+	if (r > 0) {
+		memset(hf->buf + r, 0, 32 - r);
+		hf_stripe(hf, hf->buf);
+	}
+	h = hf_rotl(hf->v[0], 1) + hf_rotl(hf->v[1], 7) +
+	    hf_rotl(hf->v[2], 12) + hf_rotl(hf->v[3], 18) + hf->len * HF_P5;
+	for (i = 0; i < 4; i++) {
+		h = hf_avalanche(h ^ hf_round(HF_P4 * (i + 1), hf->v[i]));
+		vle64enc(digest + i * 8, h);
+	}
+}
+
+void
+HSH_DigestInit(struct hsh_ctx *hc)
+{
+
+	AN(hc);
+	INIT_OBJ(hc, HSH_CTX_MAGIC);
+	hc->fast = hsh_fast_digest;
+	if (hc->fast)
+		memcpy(hc->u.fast.v, hsh_fast_seed, sizeof hc->u.fast.v);
+	else
+		VSHA256_Init(&hc->u.sha256);
+}
+
+void
+HSH_DigestFinal(struct hsh_ctx *hc, uint8_t *digest)
+{
+
+	CHECK_OBJ_NOTNULL(hc, HSH_CTX_MAGIC);
+	AN(digest);
+	if (hc->fast)
+		hf_final(&hc->u.fast, digest);
+	else
+		VSHA256_Final(digest, &hc->u.sha256);
+	ZERO_OBJ(hc, sizeof *hc);
+}
+
+static void
+hsh_digest_update(struct hsh_ctx *hc, const void *p, size_t l)
+{
+
+	CHECK_OBJ_NOTNULL(hc, HSH_CTX_MAGIC);
+	if (hc->fast)
+		hf_update(&hc->u.fast, p, l);
+	else
+		VSHA256_Update(&hc->u.sha256, p, l);
+}
+
 void
 HSH_AddString(struct req *req, void *ctx, const char *str)
 {
@@ -219,10 +350,10 @@ HSH_AddString(struct req *req, void *ctx, const char *str)
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
 	AN(ctx);
 	if (str != NULL) {
-		VSHA256_Update(ctx, str, strlen(str));
+		hsh_digest_update(ctx, str, strlen(str));
 		VSLbs(req->vsl, SLT_Hash, TOSTRAND(str));
 	} else
-		VSHA256_Update(ctx, &str, 1);
+		hsh_digest_update(ctx, &str, 1);
 }
 
 /*---------------------------------------------------------------------
@@ -420,6 +551,84 @@ hsh_rush_match(const struct req *req)
 	return (hsh_vry_match(req, oc, NULL));
 }
 
+/*---------------------------------------------------------------------
+ * Have the last fetches for this objhead all been uncacheable?
+ */
+
+static unsigned
+hsh_uncacheable(const struct objhead *oh)
+{
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+
+	return (cache_param->uncacheable_threshold > 0 &&
+	    oh->n_uncacheable >= cache_param->uncacheable_threshold);
+}
+
+/*---------------------------------------------------------------------
+ * Should a hit on a fresh object refresh it ahead of expiry?  Not if
+ * a fetch for this variant is already under way, the lookup loop only
+ * saw the busy objects in front of the hit.
+ */
+
+static unsigned
+hsh_refresh_ahead(const struct req *req, struct objcore *oc)
+{
+	struct objcore *oc2;
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	Lck_AssertHeld(&oc->objhead->mtx);
+
+	if (cache_param->refresh_ahead <= 0.)
+		return (0);
+	if (req->hash_ignore_busy || oc->boc != NULL)
+		return (0);
+	if (oc->hits + 1 < (VCL_INT)cache_param->refresh_ahead_hits)
+		return (0);
+	if (EXP_Ttl(NULL, oc) - req->t_req >= cache_param->refresh_ahead)
+		return (0);
+
+	for (oc2 = VTAILQ_NEXT(oc, hsh_list); oc2 != NULL;
+	    oc2 = VTAILQ_NEXT(oc2, hsh_list)) {
+		CHECK_OBJ_NOTNULL(oc2, OBJCORE_MAGIC);
+		if (!(oc2->flags & OC_F_BUSY) ||
+		    oc2->flags & (OC_F_DYING|OC_F_FAILED))
+			continue;
+		if (oc2->boc != NULL && oc2->boc->vary != NULL &&
+		    !hsh_vry_match(req, oc2, oc2->boc->vary))
+			continue;
+		return (0);
+	}
+	return (1);
+}
+
+/*---------------------------------------------------------------------
+ * Could this lookup end up on the waiting list?  Only the busy objects
+ * are looked at, so this may say yes for a request which would hit.
+ */
+
+static int
+hsh_busy_wait(const struct req *req, const struct objhead *oh)
+{
+	struct objcore *oc;
+
+	if (req->hash_ignore_busy || hsh_uncacheable(oh))
+		return (0);
+	VTAILQ_FOREACH(oc, &oh->objcs, hsh_list) {
+		CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+		if (!(oc->flags & OC_F_BUSY))
+			continue;
+		if (oc->flags & (OC_F_DYING | OC_F_FAILED))
+			continue;
+		if (oc->boc && oc->boc->vary != NULL &&
+		    !hsh_vry_match(req, oc, oc->boc->vary))
+			continue;
+		return (1);
+	}
+	return (0);
+}
+
 /*---------------------------------------------------------------------
  */
 
@@ -501,6 +710,16 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp)
 		return (HSH_MISS);
 	}
 
+	if (req->htc != NULL && req->htc->v1l_batch != NULL &&
+	    hsh_busy_wait(req, oh)) {
+		/*
+		 * Responses held back by the transport must not wait
+		 * with us.  Let cnt_lookup() send them before we look.
+		 */
+		(void)hsh_deref_objhead_unlock(wrk, &oh, NULL);
+		return (HSH_FLUSH);
+	}
+
 	assert(oh->refcnt > 0);
 	busy_found = 0;
 	exp_oc = NULL;
@@ -600,6 +819,17 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp)
 	if (oc != NULL) {
 		*ocp = oc;
 		oc->refcnt++;
+		if (!busy_found && !(oc->flags & OC_F_HFM) &&
+		    hsh_refresh_ahead(req, oc)) {
+			/* Fresh hit, but also refresh it in the background */
+			oc->hits++;
+			boc_progress = -1;
+			*bocp = hsh_insert_busyobj(wrk, oh);
+			/* NB: no deref of objhead, new object inherits reference */
+			Lck_Unlock(&oh->mtx);
+			Req_LogHit(wrk, req, oc, boc_progress);
+			return (HSH_HIT);
+		}
 		if (oc->flags & OC_F_HFM) {
 			xid = VXID(ObjGetXID(wrk, oc));
 			dttl = EXP_Dttl(req, oc);
@@ -665,6 +895,18 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp)
 		return (HSH_GRACE);
 	}
 
+	if (hsh_uncacheable(oh)) {
+		/* Learned hit-for-miss, the busy objects will not help us */
+		*bocp = hsh_insert_busyobj(wrk, oh);
+		CHECK_OBJ_NOTNULL((*bocp)->boc, BOC_MAGIC);
+		(*bocp)->boc->learned_hfm = 1;
+		Lck_Unlock(&oh->mtx);
+		wrk->stats->busy_uncacheable++;
+		wrk->stats->cache_hitmiss++;
+		VSLb(req->vsl, SLT_HitMiss, "%u %.6f", 0U, 0.);
+		return (HSH_HITMISS);
+	}
+
 	/* There are one or more busy objects, wait for them */
 	VTAILQ_INSERT_TAIL(&oh->waitinglist, req, w_list);
 
@@ -691,14 +933,20 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp)
 
 /*---------------------------------------------------------------------
  * Pick the req's we are going to rush from the waiting list
+ *
+ * The exponential rush only protects us from waking up requests that
+ * will not be able to use the object.  Waiters can all be released at
+ * once when the object is uncacheable, since they will all pass, or when
+ * it is still being fetched without a Vary header, since they can all
+ * attach to the boc and stream from it right away.
  */
 
 static void
-hsh_rush1(const struct worker *wrk, struct objcore *oc, struct rush *r)
+hsh_rush1(struct worker *wrk, struct objcore *oc, struct rush *r)
 {
 	struct objhead *oh;
 	struct req *req;
-	int i, max;
+	unsigned i, max;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_ORNULL(oc, OBJCORE_MAGIC);
@@ -717,6 +965,11 @@ hsh_rush1(const struct worker *wrk, struct objcore *oc, struct rush *r)
 	max = cache_param->rush_exponent;
 	if (oc->flags & (OC_F_WITHDRAWN|OC_F_FAILED))
 		max = 1;
+	else if (oc->flags & (OC_F_HFM|OC_F_HFP))
+		max = UINT_MAX;
+	else if (oc->boc != NULL && oc->stobj->stevedore != NULL &&
+	    !ObjHasAttr(wrk, oc, OA_VARY))
+		max = UINT_MAX;
 	assert(max > 0);
 
 	if (oc->waitinglist_gen == 0) {
@@ -1028,6 +1281,41 @@ HSH_Withdraw(struct worker *wrk, struct objcore **ocp)
 	hsh_rush2(wrk, &rush);
 }
 
+/*---------------------------------------------------------------------
+ * Insert a busy objcore next to an existing object, which will replace
+ * it once it is complete.  The vary specification, if any, is owned by
+ * the new boc from here on.
+ */
+
+struct objcore *
+HSH_NewSibling(struct worker *wrk, struct objcore *oc, uint8_t *vary)
+{
+	struct objhead *oh;
+	struct objcore *noc;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	oh = oc->objhead;
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	AZ(oc->flags & (OC_F_BUSY | OC_F_PRIVATE));
+
+	hsh_prealloc(wrk);
+	Lck_Lock(&oh->mtx);
+	if (oc->flags & (OC_F_DYING | OC_F_FAILED)) {
+		Lck_Unlock(&oh->mtx);
+		free(vary);
+		return (NULL);
+	}
+	assert(oh->refcnt > 0);
+	noc = hsh_insert_busyobj(wrk, oh);
+	CHECK_OBJ_NOTNULL(noc->boc, BOC_MAGIC);
+	AZ(noc->boc->vary);
+	noc->boc->vary = vary;
+	oh->refcnt++;
+	Lck_Unlock(&oh->mtx);
+	return (noc);
+}
+
 /*---------------------------------------------------------------------
  * Unbusy an objcore when the object is completely fetched.
  */
@@ -1057,7 +1345,8 @@ HSH_Unbusy(struct worker *wrk, struct objcore *oc)
 	AN(oc->flags & OC_F_BUSY);
 	INIT_OBJ(&rush, RUSH_MAGIC);
 
-	BAN_NewObjCore(oc);
+	if (oc->ban == NULL)
+		BAN_NewObjCore(oc);
 	AN(oc->ban);
 
 	/* XXX: pretouch neighbors on oh->objcs to prevent page-on under mtx */
@@ -1069,6 +1358,19 @@ HSH_Unbusy(struct worker *wrk, struct objcore *oc)
 	VTAILQ_REMOVE(&oh->objcs, oc, hsh_list);
 	VTAILQ_INSERT_HEAD(&oh->objcs, oc, hsh_list);
 	oc->flags &= ~OC_F_BUSY;
+	if (!(oc->flags & OC_F_HFM))
+		oh->n_uncacheable = 0;
+	else if (oh->n_uncacheable < UINT_MAX)
+		oh->n_uncacheable++;
+	if (oc->boc->learned_hfm && hsh_uncacheable(oh) &&
+	    (oc->flags & (OC_F_HFM|OC_F_HFP)) == OC_F_HFM &&
+	    oc->ttl < cache_param->uncacheable_ttl) {
+		/*
+		 * Our own learned hit-for-miss, keep it around for a while.
+		 * What VCL made hit-for-miss keeps the TTL VCL gave it.
+		 */
+		oc->ttl = cache_param->uncacheable_ttl;
+	}
 	if (!VTAILQ_EMPTY(&oh->waitinglist)) {
 		assert(oh->refcnt > 1);
 		hsh_rush1(wrk, oc, &rush);
@@ -1108,6 +1410,39 @@ HSH_Replace(struct objcore *oc, const struct objcore *new_oc)
 	EXP_Remove(oc, new_oc);
 }
 
+/*---------------------------------------------------------------------
+ * Replace an object by a complete sibling from HSH_NewSibling(), unless
+ * it was killed while the sibling was made, in which case the sibling
+ * is killed too.  Returns non-zero if the sibling was killed.
+ */
+
+int
+HSH_Supersede(struct objcore *oc, struct objcore *noc)
+{
+	struct objhead *oh;
+	unsigned dying;
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	CHECK_OBJ_NOTNULL(noc, OBJCORE_MAGIC);
+	oh = oc->objhead;
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	assert(noc->objhead == oh);
+	AZ(noc->flags & OC_F_BUSY);
+
+	Lck_Lock(&oh->mtx);
+	dying = oc->flags & OC_F_DYING;
+	oc->flags |= OC_F_DYING;
+	if (dying)
+		noc->flags |= OC_F_DYING;
+	Lck_Unlock(&oh->mtx);
+	if (dying) {
+		EXP_Remove(noc, NULL);
+		return (1);
+	}
+	EXP_Remove(oc, noc);
+	return (0);
+}
+
 /*====================================================================
  * HSH_Snipe()
  *
@@ -1329,6 +1664,9 @@ HSH_Init(const struct hash_slinger *slinger)
 
 	assert(DIGEST_LEN == VSHA256_LEN);	/* avoid #include pollution */
 	hash = slinger;
+	hsh_fast_digest = cache_param->hash_fast_digest;
+	if (hsh_fast_digest)
+		AZ(VRND_RandomCrypto(hsh_fast_seed, sizeof hsh_fast_seed));
 	if (hash->start != NULL)
 		hash->start();
 	for (struct objhead *oh = private_ohs;
@@ -1396,6 +1396,54 @@ HTTP_GetHdrPack(struct worker *wrk, struct objcore *oc, hdr_t hdr)
 	return (NULL);
 }
 
+/*--------------------------------------------------------------------
+ * Copy the packed headers of an object, replacing any hdr headers with
+ * the single header line given.  Returns the length of the copy, which
+ * is only written if p is not NULL.
+ */
+
+unsigned
+HTTP_SetHdrPack(struct worker *wrk, struct objcore *oc, hdr_t hdr,
+    const char *line, uint8_t *p, unsigned len)
+{
+	const char *ptr, *e;
+	uint16_t n;
+	unsigned l, u, w;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	CHECK_HDR(hdr);
+	AN(line);
+
+	ptr = ObjGetAttr(wrk, oc, OA_HEADERS, NULL);
+	AN(ptr);
+	n = vbe16dec(ptr);
+	ptr += 4;
+	l = 4;
+	for (u = 0; u < 3 || *ptr != '\0'; u++, ptr = e) {
+		e = strchr(ptr, '\0') + 1;
+		w = e - ptr;
+		if (u >= 3 && http_hdr_at(ptr, hdr->str, hdr->len)) {
+			n--;
+			continue;
+		}
+		if (p != NULL) {
+			assert(l + w <= len);
+			memcpy(p + l, ptr, w);
+		}
+		l += w;
+	}
+	w = strlen(line) + 1;
+	if (p != NULL) {
+		assert(l + w + 1 <= len);
+		memcpy(p + l, line, w);
+		p[l + w] = '\0';
+		vbe16enc(p, n + 1);
+		vbe16enc(p + 2, HTTP_GetStatusPack(wrk, oc));
+	}
+	return (l + w + 1);
+}
+
 /*--------------------------------------------------------------------
  * Merge any headers in the oc->OA_HEADER into the struct http if they
  * are not there already.
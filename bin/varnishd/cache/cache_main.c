@@ -511,6 +511,7 @@ child_main(int sigmagic, size_t altstksz)
 	ObjInit();
 
 	WRK_Init();
+	WS_SizeInit();
 
 	VCL_Init();
 	VCL_VRT_Init();
@@ -36,6 +36,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#ifdef HAVE_SCHED_GETCPU
+#  include <sched.h>
+#endif
 
 #include "vtim.h"
 
@@ -51,6 +56,26 @@ struct memitem {
 
 VTAILQ_HEAD(memhead_s, memitem);
 
+/*
+ * Per-CPU magazine of free items in front of the pool.  Counters are
+ * kept here and folded into the pool under its lock.
+ */
+
+#define MPL_MAG_MAX			32
+#define MPL_MAG_NMAX			64
+
+struct mpl_mag {
+	unsigned			magic;
+#define MPL_MAG_MAGIC			0x2c3a51b7
+	unsigned			n;
+	struct lock			mtx;
+	int64_t				live;
+	uint64_t			allocs;
+	uint64_t			frees;
+	uint64_t			recycle;
+	struct memitem			*item[MPL_MAG_MAX];
+};
+
 struct mempool {
 	unsigned			magic;
 #define MEMPOOL_MAGIC			0x37a75a8d
@@ -60,6 +85,7 @@ struct mempool {
 	struct lock			mtx;
 	volatile struct poolparam	*param;
 	volatile unsigned		*cur_size;
+	const volatile unsigned		*auto_size;
 	uint64_t			live;
 	struct vsc_seg			*vsc_seg;
 	struct VSC_mempool		*vsc;
@@ -67,11 +93,44 @@ struct mempool {
 	pthread_t			thread;
 	vtim_real			t_now;	// XXX -> mono?
 	int				self_destruct;
+	unsigned			nmag;
+	struct mpl_mag			**mag;
 };
 
 /*---------------------------------------------------------------------
+ * The item size is the configured size, or the automatic size when that
+ * is smaller (see workspace_sizing).  Items are only recycled if they
+ * are large enough, and with an automatic size not much larger either,
+ * so that shrinking it actually gives memory back.
  */
 
+static unsigned
+mpl_size(const struct mempool *mpl)
+{
+	unsigned sz, asz;
+
+	sz = *mpl->cur_size;
+	if (mpl->auto_size != NULL) {
+		asz = *mpl->auto_size;
+		if (asz > 0 && asz < sz)
+			sz = asz;
+	}
+	return (sz);
+}
+
+static int
+mpl_fits(const struct mempool *mpl, const struct memitem *mi)
+{
+	unsigned sz;
+
+	sz = mpl_size(mpl);
+	if (mi->size < sz)
+		return (0);
+	if (sz < *mpl->cur_size && mi->size > sz + sz / 4)
+		return (0);
+	return (1);
+}
+
 static struct memitem *
 mpl_alloc(const struct mempool *mpl)
 {
@@ -79,7 +138,7 @@ mpl_alloc(const struct mempool *mpl)
 	struct memitem *mi;
 
 	CHECK_OBJ_NOTNULL(mpl, MEMPOOL_MAGIC);
-	tsz = *mpl->cur_size;
+	tsz = mpl_size(mpl);
 	mi = calloc(1, tsz);
 	AN(mi);
 	mi->magic = MEMITEM_MAGIC;
@@ -89,6 +148,119 @@ mpl_alloc(const struct mempool *mpl)
 	return (mi);
 }
 
+/*---------------------------------------------------------------------
+ * Magazines
+ *
+ * Lock order is magazine before pool.
+ */
+
+static struct mpl_mag *
+mpl_mag(const struct mempool *mpl)
+{
+	unsigned u;
+
+#ifdef HAVE_SCHED_GETCPU
+	int i = sched_getcpu();
+	if (i >= 0)
+		u = (unsigned)i;
+	else
+#endif
+		u = (unsigned)((uintptr_t)pthread_self() >> 6);
+	return (mpl->mag[u % mpl->nmag]);
+}
+
+static void
+mpl_mag_fold(struct mempool *mpl, struct mpl_mag *mag)
+{
+
+	Lck_AssertHeld(&mag->mtx);
+	Lck_AssertHeld(&mpl->mtx);
+	mpl->vsc->allocs += mag->allocs;
+	mpl->vsc->frees += mag->frees;
+	mpl->vsc->recycle += mag->recycle;
+	mpl->live += mag->live;
+	mpl->vsc->live = mpl->live;
+	mag->allocs = mag->frees = mag->recycle = 0;
+	mag->live = 0;
+}
+
+/* Move up to half a magazine of usable items from the pool */
+
+static void
+mpl_mag_refill(struct mempool *mpl, struct mpl_mag *mag, unsigned cap)
+{
+	struct memitem *mi;
+
+	Lck_AssertHeld(&mag->mtx);
+	AZ(mag->n);
+	Lck_Lock(&mpl->mtx);
+	mpl_mag_fold(mpl, mag);
+	while (mag->n < (cap + 1) / 2) {
+		mi = VTAILQ_FIRST(&mpl->list);
+		if (mi == NULL)
+			break;
+		CHECK_OBJ(mi, MEMITEM_MAGIC);
+		mpl->vsc->pool = --mpl->n_pool;
+		VTAILQ_REMOVE(&mpl->list, mi, list);
+		if (!mpl_fits(mpl, mi)) {
+			mpl->vsc->toosmall++;
+			VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
+		} else
+			mag->item[mag->n++] = mi;
+	}
+	Lck_Unlock(&mpl->mtx);
+}
+
+/* Return items to the pool until the magazine is down to keep */
+
+static void
+mpl_mag_drain(struct mempool *mpl, struct mpl_mag *mag, unsigned keep)
+{
+	struct memitem *mi;
+
+	Lck_AssertHeld(&mag->mtx);
+	Lck_Lock(&mpl->mtx);
+	mpl_mag_fold(mpl, mag);
+	while (mag->n > keep) {
+		mi = mag->item[--mag->n];
+		CHECK_OBJ(mi, MEMITEM_MAGIC);
+		if (!mpl_fits(mpl, mi)) {
+			mpl->vsc->toosmall++;
+			VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
+		} else {
+			mpl->vsc->pool = ++mpl->n_pool;
+			mi->touched = mpl->t_now;
+			VTAILQ_INSERT_HEAD(&mpl->list, mi, list);
+		}
+	}
+	Lck_Unlock(&mpl->mtx);
+}
+
+/*
+ * Fold the counters of all magazines into the pool, and empty them
+ * when the magazines have been turned off or the pool goes away.
+ */
+
+static void
+mpl_mag_sync(struct mempool *mpl)
+{
+	struct mpl_mag *mag;
+	unsigned u, n = 0, keep;
+
+	keep = cache_param->pool_magazine;
+	if (mpl->self_destruct)
+		keep = 0;
+	for (u = 0; u < mpl->nmag; u++) {
+		mag = mpl->mag[u];
+		CHECK_OBJ_NOTNULL(mag, MPL_MAG_MAGIC);
+		Lck_Lock(&mag->mtx);
+		mpl_mag_drain(mpl, mag, vmin(mag->n, keep));
+		n += mag->n;
+		Lck_Unlock(&mag->mtx);
+	}
+	mpl->vsc->magazine = n;
+}
+
 /*---------------------------------------------------------------------
  * Pool-guard
  *   Attempt to keep number of free items in pool inside bounds with
@@ -103,6 +275,7 @@ mpl_guard(void *priv)
 	struct memitem *mi = NULL;
 	vtim_dur v_statevariable_(mpl_slp);
 	vtim_real last = 0;
+	unsigned u;
 
 	CAST_OBJ_NOTNULL(mpl, priv, MEMPOOL_MAGIC);
 	THR_SetName(mpl->name);
@@ -113,8 +286,10 @@ mpl_guard(void *priv)
 		mpl_slp = 0.814;	// random
 		mpl->t_now = VTIM_real();
 
+		mpl_mag_sync(mpl);
+
 		if (mi != NULL && (mpl->n_pool > mpl->param->max_pool ||
-		    mi->size < *mpl->cur_size)) {
+		    !mpl_fits(mpl, mi))) {
 			CHECK_OBJ(mi, MEMITEM_MAGIC);
 			FREE_OBJ(mi);
 		}
@@ -163,6 +338,12 @@ mpl_guard(void *priv)
 				CHECK_OBJ(mi, MEMITEM_MAGIC);
 				FREE_OBJ(mi);
 			}
+			for (u = 0; u < mpl->nmag; u++) {
+				AZ(mpl->mag[u]->n);
+				Lck_Delete(&mpl->mag[u]->mtx);
+				FREE_OBJ(mpl->mag[u]);
+			}
+			free(mpl->mag);
 			VSC_mempool_Destroy(&mpl->vsc_seg);
 			Lck_Unlock(&mpl->mtx);
 			Lck_Delete(&mpl->mtx);
@@ -171,7 +352,7 @@ mpl_guard(void *priv)
 		}
 
 		if (mpl->n_pool < mpl->param->min_pool &&
-		    mi != NULL && mi->size >= *mpl->cur_size) {
+		    mi != NULL && mpl_fits(mpl, mi)) {
 			CHECK_OBJ(mi, MEMITEM_MAGIC);
 			mpl->vsc->pool = ++mpl->n_pool;
 			mi->touched = mpl->t_now;
@@ -227,19 +408,31 @@ mpl_guard(void *priv)
  */
 
 struct mempool *
-MPL_New(const char *name,
-    volatile struct poolparam *pp, volatile unsigned *cur_size)
+MPL_New(const char *name, volatile struct poolparam *pp,
+    volatile unsigned *cur_size, const volatile unsigned *auto_size)
 {
 	struct mempool *mpl;
+	long ncpu;
+	unsigned u;
 
 	ALLOC_OBJ(mpl, MEMPOOL_MAGIC);
 	AN(mpl);
 	bprintf(mpl->name, "MPL_%s", name);
 	mpl->param = pp;
 	mpl->cur_size = cur_size;
+	mpl->auto_size = auto_size;
 	VTAILQ_INIT(&mpl->list);
 	VTAILQ_INIT(&mpl->surplus);
 	Lck_New(&mpl->mtx, lck_mempool);
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	mpl->nmag = (unsigned)vlimit_t(long, ncpu, 1, MPL_MAG_NMAX);
+	mpl->mag = calloc(mpl->nmag, sizeof *mpl->mag);
+	AN(mpl->mag);
+	for (u = 0; u < mpl->nmag; u++) {
+		ALLOC_OBJ(mpl->mag[u], MPL_MAG_MAGIC);
+		AN(mpl->mag[u]);
+		Lck_New(&mpl->mag[u]->mtx, lck_mempool);
+	}
 	/* XXX: prealloc min_pool */
 	mpl->vsc = VSC_mempool_New(NULL, &mpl->vsc_seg, mpl->name + 4);
 	AN(mpl->vsc);
@@ -257,8 +450,17 @@ void
 MPL_Destroy(struct mempool **mpp)
 {
 	struct mempool *mpl;
+	struct mpl_mag *mag;
+	unsigned u;
 
 	TAKE_OBJ_NOTNULL(mpl, mpp, MEMPOOL_MAGIC);
+	for (u = 0; u < mpl->nmag; u++) {
+		mag = mpl->mag[u];
+		CHECK_OBJ_NOTNULL(mag, MPL_MAG_MAGIC);
+		Lck_Lock(&mag->mtx);
+		mpl_mag_drain(mpl, mag, 0);
+		Lck_Unlock(&mag->mtx);
+	}
 	Lck_Lock(&mpl->mtx);
 	AZ(mpl->live);
 	mpl->self_destruct = 1;
@@ -271,13 +473,46 @@ MPL_Destroy(struct mempool **mpp)
 void *
 MPL_Get(struct mempool *mpl, unsigned *size)
 {
-	struct memitem *mi;
+	struct memitem *mi = NULL;
+	struct mpl_mag *mag;
+	unsigned cap, ok = 0;
 
 	CHECK_OBJ_NOTNULL(mpl, MEMPOOL_MAGIC);
 	AN(size);
 
+	cap = vmin_t(unsigned, cache_param->pool_magazine, MPL_MAG_MAX);
+	if (cap > 0) {
+		mag = mpl_mag(mpl);
+		CHECK_OBJ_NOTNULL(mag, MPL_MAG_MAGIC);
+		Lck_Lock(&mag->mtx);
+		if (mag->n == 0)
+			mpl_mag_refill(mpl, mag, cap);
+		if (mag->n > 0) {
+			mi = mag->item[--mag->n];
+			CHECK_OBJ(mi, MEMITEM_MAGIC);
+			ok = mpl_fits(mpl, mi);
+		}
+		if (ok) {
+			mag->allocs++;
+			mag->recycle++;
+			mag->live++;
+		}
+		Lck_Unlock(&mag->mtx);
+		if (ok) {
+			*size = mi->size - sizeof *mi;
+			return ((void *)(uintptr_t)(mi + 1));
+		}
+	}
+
 	Lck_Lock(&mpl->mtx);
 
+	if (mi != NULL) {
+		/* Magazine item became too small */
+		mpl->vsc->toosmall++;
+		VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
+		mi = NULL;
+	}
+
 	mpl->vsc->allocs++;
 	mpl->vsc->live = ++mpl->live;
 
@@ -290,7 +525,7 @@ MPL_Get(struct mempool *mpl, unsigned *size)
 		mpl->vsc->pool = --mpl->n_pool;
 		CHECK_OBJ(mi, MEMITEM_MAGIC);
 		VTAILQ_REMOVE(&mpl->list, mi, list);
-		if (mi->size < *mpl->cur_size) {
+		if (!mpl_fits(mpl, mi)) {
 			mpl->vsc->toosmall++;
 			VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
 			mi = NULL;
@@ -310,24 +545,47 @@ MPL_Get(struct mempool *mpl, unsigned *size)
 	return ((void *)(uintptr_t)(mi + 1));
 }
 
+/*---------------------------------------------------------------------
+ * Free an item of which only the first dirty bytes need to be zeroed
+ * for the next user, the caller vouches that nobody expects the rest
+ * of it to be zero.
+ */
+
 void
-MPL_Free(struct mempool *mpl, void *item)
+MPL_FreeDirty(struct mempool *mpl, void *item, size_t dirty)
 {
 	struct memitem *mi;
+	struct mpl_mag *mag;
+	unsigned cap;
 
 	CHECK_OBJ_NOTNULL(mpl, MEMPOOL_MAGIC);
 	AN(item);
 
 	mi = (void*)((uintptr_t)item - sizeof(*mi));
 	CHECK_OBJ_NOTNULL(mi, MEMITEM_MAGIC);
-	memset(item, 0, mi->size - sizeof *mi);
+	assert(dirty <= mi->size - sizeof *mi);
+	memset(item, 0, dirty);
+
+	cap = vmin_t(unsigned, cache_param->pool_magazine, MPL_MAG_MAX);
+	if (cap > 0 && mpl_fits(mpl, mi)) {
+		mag = mpl_mag(mpl);
+		CHECK_OBJ_NOTNULL(mag, MPL_MAG_MAGIC);
+		Lck_Lock(&mag->mtx);
+		if (mag->n >= cap)
+			mpl_mag_drain(mpl, mag, cap / 2);
+		mag->item[mag->n++] = mi;
+		mag->frees++;
+		mag->live--;
+		Lck_Unlock(&mag->mtx);
+		return;
+	}
 
 	Lck_Lock(&mpl->mtx);
 
 	mpl->vsc->frees++;
 	mpl->vsc->live = --mpl->live;
 
-	if (mi->size < *mpl->cur_size) {
+	if (!mpl_fits(mpl, mi)) {
 		mpl->vsc->toosmall++;
 		VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
 	} else {
@@ -339,6 +597,17 @@ MPL_Free(struct mempool *mpl, void *item)
 	Lck_Unlock(&mpl->mtx);
 }
 
+void
+MPL_Free(struct mempool *mpl, void *item)
+{
+	struct memitem *mi;
+
+	AN(item);
+	mi = (void*)((uintptr_t)item - sizeof(*mi));
+	CHECK_OBJ_NOTNULL(mi, MEMITEM_MAGIC);
+	MPL_FreeDirty(mpl, item, mi->size - sizeof *mi);
+}
+
 void
 MPL_AssertSane(const void *item)
 {
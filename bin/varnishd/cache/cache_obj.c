@@ -119,6 +119,7 @@ obj_deleteboc(struct boc **p)
 	struct boc *boc;
 
 	TAKE_OBJ_NOTNULL(boc, p, BOC_MAGIC);
+	AZ(VSLIST_FIRST(&boc->park_q_head));
 	Lck_Delete(&boc->mtx);
 	PTOK(pthread_cond_destroy(&boc->cond));
 	free(boc->vary);
@@ -487,6 +488,53 @@ ObjVAICancel(struct worker *wrk, struct boc *boc, struct vai_qe *qe)
 	Lck_Unlock(&boc->mtx);
 }
 
+/*====================================================================
+ * Park on a busy object until it can be delivered from
+ *
+ * Returns zero if the state is already BOS_STREAM or later, otherwise
+ * qe->cb is called once, with the boc mtx held, by whoever moves the
+ * state there.
+ */
+
+int
+ObjParkState(const struct objcore *oc, struct vai_qe *qe)
+{
+	int parked = 0;
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	CHECK_OBJ_NOTNULL(oc->boc, BOC_MAGIC);
+	CHECK_OBJ_NOTNULL(qe, VAI_Q_MAGIC);
+	AZ(qe->flags & VAI_QF_INQUEUE);
+	AN(qe->cb);
+
+	Lck_Lock(&oc->boc->mtx);
+	if (oc->boc->state < BOS_STREAM) {
+		qe->flags |= VAI_QF_INQUEUE;
+		VSLIST_INSERT_HEAD(&oc->boc->park_q_head, qe, list);
+		parked = 1;
+	}
+	Lck_Unlock(&oc->boc->mtx);
+	return (parked);
+}
+
+static void
+obj_boc_unpark(struct boc *boc)
+{
+	struct vai_qe *qe, *next;
+
+	qe = VSLIST_FIRST(&boc->park_q_head);
+	VSLIST_FIRST(&boc->park_q_head) = NULL;
+	while (qe != NULL) {
+		CHECK_OBJ(qe, VAI_Q_MAGIC);
+		AN(qe->flags & VAI_QF_INQUEUE);
+		qe->flags &= ~VAI_QF_INQUEUE;
+		next = VSLIST_NEXT(qe, list);
+		VSLIST_NEXT(qe, list) = NULL;
+		qe->cb(qe->hdl, qe->priv);
+		qe = next;
+	}
+}
+
 /*====================================================================
  */
 
@@ -518,6 +566,8 @@ ObjSetState(struct worker *wrk, struct objcore *oc, enum boc_state_e next,
 	oc->boc->state = next;
 	if (broadcast)
 		obj_boc_notify(oc->boc);
+	if (next >= BOS_STREAM)
+		obj_boc_unpark(oc->boc);
 	Lck_Unlock(&oc->boc->mtx);
 }
 
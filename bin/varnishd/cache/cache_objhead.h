@@ -30,8 +30,31 @@
  *
  */
 
+#include "vsha256.h"
+
 struct hash_slinger;
 
+/*
+ * Context for the lookup digest, which is either SHA256 or, with the
+ * hash_fast_digest parameter, a keyed non-cryptographic 256 bit hash.
+ */
+
+struct hsh_fast {
+	uint64_t		v[4];
+	uint64_t		len;
+	uint8_t			buf[32];
+};
+
+struct hsh_ctx {
+	unsigned		magic;
+#define HSH_CTX_MAGIC		0x3a6d1b0c
+	unsigned		fast;
+	union {
+		VSHA256_CTX	sha256;
+		struct hsh_fast	fast;
+	} u;
+};
+
 struct objhead {
 	unsigned		magic;
 #define OBJHEAD_MAGIC		0x1b96615d
@@ -42,6 +65,7 @@ struct objhead {
 	uint8_t			digest[DIGEST_LEN];
 	unsigned		waitinglist_gen;
 	VTAILQ_HEAD(, req)	waitinglist;
+	unsigned		n_uncacheable;
 
 	/*----------------------------------------------------
 	 * The fields below are for the sole private use of
@@ -64,6 +88,7 @@ enum lookup_e {
 	HSH_HIT,
 	HSH_GRACE,
 	HSH_BUSY,
+	HSH_FLUSH,
 };
 
 void HSH_Kill(struct objcore *);
@@ -73,6 +98,8 @@ void HSH_Insert(struct worker *, const void *hash, struct objcore *,
 void HSH_Withdraw(struct worker *, struct objcore **);
 void HSH_Fail(struct worker *, struct objcore *);
 void HSH_Unbusy(struct worker *, struct objcore *);
+struct objcore *HSH_NewSibling(struct worker *, struct objcore *, uint8_t *);
+int HSH_Supersede(struct objcore *, struct objcore *);
 int HSH_Snipe(const struct worker *, struct objcore *);
 struct boc *HSH_RefBoc(const struct objcore *);
 void HSH_DerefBoc(struct worker *wrk, struct objcore *);
@@ -80,6 +107,8 @@ void HSH_DeleteObjHead(const struct worker *, struct objhead *);
 int HSH_DerefObjCore(struct worker *, struct objcore **);
 enum lookup_e HSH_Lookup(struct req *, struct objcore **, struct objcore **);
 void HSH_Ref(struct objcore *o);
+void HSH_DigestInit(struct hsh_ctx *);
+void HSH_DigestFinal(struct hsh_ctx *, uint8_t *digest);
 void HSH_AddString(struct req *, void *ctx, const char *str);
 unsigned HSH_Purge(struct worker *, struct objhead *, vtim_real ttl_now,
     vtim_dur ttl, vtim_dur grace, vtim_dur keep);
@@ -225,6 +225,7 @@ pan_boc(struct vsb *vsb, const struct boc *boc)
 	VSB_printf(vsb, "delivered_so_far = %ju,\n", (uintmax_t)boc->delivered_so_far);
 	VSB_printf(vsb, "transit_buffer = %ju,\n", (uintmax_t)boc->transit_buffer);
 	VSB_printf(vsb, "VSLIST_FIRST(vai_q_head) = %p,\n", VSLIST_FIRST(&boc->vai_q_head));
+	VSB_printf(vsb, "VSLIST_FIRST(park_q_head) = %p,\n", VSLIST_FIRST(&boc->park_q_head));
 	VSB_indent(vsb, -2);
 	VSB_cat(vsb, "},\n");
 }
@@ -37,17 +37,24 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#  include <sched.h>
+#endif
+
 #include "cache_varnishd.h"
 #include "cache_pool.h"
 
+#include "vfil.h"
 #include "vtim.h"
 
 static pthread_t		thr_pool_herder;
 
 static struct lock		wstat_mtx;
 struct lock			pool_mtx;
+unsigned			pool_steal_hint;
 static VTAILQ_HEAD(,pool)	pools = VTAILQ_HEAD_INITIALIZER(pools);
 
 /*--------------------------------------------------------------------
@@ -97,6 +104,35 @@ Pool_Task_Any(struct pool_task *task, enum task_prio prio)
 	return (Pool_Task(pp, task, prio));
 }
 
+/*--------------------------------------------------------------------
+ * Call func on the live pools other than pp until it returns non-zero.
+ *
+ * This is for work stealing, which is opportunistic, so we rather give
+ * up than wait for pool_mtx, and return -1 if it is busy.
+ */
+
+int
+pool_siblings(const struct pool *pp, pool_sibling_f *func, void *priv)
+{
+	struct pool *qp;
+	int retval = 0;
+
+	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
+	AN(func);
+	if (Lck_Trylock(&pool_mtx))
+		return (-1);
+	VTAILQ_FOREACH(qp, &pools, list) {
+		CHECK_OBJ_NOTNULL(qp, POOL_MAGIC);
+		if (qp == pp || qp->die)
+			continue;
+		retval = func(qp, priv);
+		if (retval)
+			break;
+	}
+	Lck_Unlock(&pool_mtx);
+	return (retval);
+}
+
 /*--------------------------------------------------------------------
  * Helper function to update stats for purges under lock
  */
@@ -141,6 +177,98 @@ pool_stat_summ(struct worker *wrk, void *priv)
 	pp->b_stat = src;
 }
 
+/*--------------------------------------------------------------------
+ * NUMA placement, see thread_pool_numa.
+ *
+ * Pools are bound to the CPUs of the nodes round robin.  Every thread
+ * of a pool is created while its creator is bound to the node, and
+ * inherits that, so the default first touch policy of the kernel puts
+ * the memory of the pool on its node too.
+ */
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+
+#define POOL_NUMA_MAX	64
+
+static cpu_set_t	pool_numa_cpus[POOL_NUMA_MAX];
+static unsigned		pool_numa_nodes;
+
+static int
+pool_numa_cpulist(const char *s, cpu_set_t *cs)
+{
+	unsigned long a, b;
+	char *e;
+
+	CPU_ZERO(cs);
+	while (*s != '\0' && *s != '\n') {
+		a = strtoul(s, &e, 10);
+		if (e == s)
+			return (-1);
+		b = a;
+		if (*e == '-') {
+			s = e + 1;
+			b = strtoul(s, &e, 10);
+			if (e == s || b < a)
+				return (-1);
+		}
+		for (; a <= b && a < CPU_SETSIZE; a++)
+			CPU_SET(a, cs);
+		s = e;
+		if (*s == ',')
+			s++;
+	}
+	return (CPU_COUNT(cs) > 0 ? 0 : -1);
+}
+
+static void
+pool_numa_init(void)
+{
+	char fn[64], *p;
+	unsigned u;
+
+	for (u = 0; u < POOL_NUMA_MAX; u++) {
+		bprintf(fn, "node%u/cpulist", u);
+		p = VFIL_readfile("/sys/devices/system/node", fn, NULL);
+		if (p == NULL)
+			break;
+		/* Skip nodes with memory only */
+		if (!pool_numa_cpulist(p, &pool_numa_cpus[pool_numa_nodes]))
+			pool_numa_nodes++;
+		free(p);
+	}
+}
+
+static int
+pool_numa_bind(unsigned pool_no, cpu_set_t *saved)
+{
+	cpu_set_t *cs;
+	unsigned node;
+
+	if (!cache_param->wthread_numa || pool_numa_nodes == 0)
+		return (0);
+	node = pool_no % pool_numa_nodes;
+	cs = &pool_numa_cpus[node];
+	PTOK(pthread_getaffinity_np(pthread_self(), sizeof *saved, saved));
+	errno = pthread_setaffinity_np(pthread_self(), sizeof *cs, cs);
+	if (errno) {
+		VSL(SLT_Error, NO_VXID, "Pool %u: Cannot bind to NUMA node %u"
+		    " (%d %s)", pool_no, node, errno, VAS_errtxt(errno));
+		return (0);
+	}
+	VSL(SLT_Debug, NO_VXID, "Pool %u bound to NUMA node %u",
+	    pool_no, node);
+	return (1);
+}
+
+static void
+pool_numa_unbind(const cpu_set_t *saved)
+{
+
+	PTOK(pthread_setaffinity_np(pthread_self(), sizeof *saved, saved));
+}
+
+#endif
+
 /*--------------------------------------------------------------------
  * Add a thread pool
  */
@@ -150,10 +278,18 @@ pool_mkpool(unsigned pool_no)
 {
 	struct pool *pp;
 	int i;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t saved;
+	int bound;
+#endif
 
 	ALLOC_OBJ(pp, POOL_MAGIC);
 	if (pp == NULL)
 		return (NULL);
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	/* Threads created from here on inherit the binding */
+	bound = pool_numa_bind(pool_no, &saved);
+#endif
 	pp->a_stat = calloc(1, sizeof *pp->a_stat);
 	AN(pp->a_stat);
 	pp->b_stat = calloc(1, sizeof *pp->b_stat);
@@ -173,6 +309,10 @@ pool_mkpool(unsigned pool_no)
 	SES_NewPool(pp, pool_no);
 	VCA_NewPool(pp);
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (bound)
+		pool_numa_unbind(&saved);
+#endif
 	return (pp);
 }
 
@@ -282,6 +422,9 @@ Pool_Init(void)
 
 	Lck_New(&wstat_mtx, lck_wstat);
 	Lck_New(&pool_mtx, lck_wq);
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	pool_numa_init();
+#endif
 	PTOK(pthread_create(&thr_pool_herder, NULL, pool_poolherder, NULL));
 	while (!VSC_C_main->pools)
 		VTIM_sleep(0.01);
@@ -51,7 +51,14 @@ struct pool {
 	struct taskhead			queues[TASK_QUEUE_RESERVE];
 	unsigned			nthr;
 	unsigned			lqueue;
+	unsigned			lqueue_bo;
 	uintmax_t			ndequeued;
+
+	/* Queue latency, see thread_pool_latency */
+	vtim_dur			qwait;
+	unsigned			nqwait;
+	unsigned			ngrow;
+
 	struct VSC_main_pool		stats[1];
 	struct VSC_main_wrk		*a_stat;
 	struct VSC_main_wrk		*b_stat;
@@ -61,8 +68,12 @@ struct pool {
 	struct waiter			*waiter;
 };
 
+typedef int pool_sibling_f(struct pool *, void *priv);
+
 void *pool_herder(void*);
+int pool_siblings(const struct pool *, pool_sibling_f *, void *priv);
 task_func_t pool_stat_summ;
 extern struct lock			pool_mtx;
+extern unsigned				pool_steal_hint;
 void VCA_NewPool(struct pool *);
 void VCA_DestroyPool(struct pool *);
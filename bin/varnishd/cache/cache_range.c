@@ -101,11 +101,27 @@ vrg_range_bytes(struct vdp_ctx *vdc, enum vdp_action act, void **priv,
 
 /*--------------------------------------------------------------------*/
 
+static void
+vrg_fail(struct req *req, struct vsl_log *vsl, const char *err)
+{
+
+	VSLb(vsl, SLT_Debug, "RANGE_FAIL %s", err);
+	if (req->resp_len >= 0)
+		http_PrintfHeader(req->resp,
+		    "Content-Range: bytes */%jd",
+		    (intmax_t)req->resp_len);
+	http_PutResponse(req->resp, "HTTP/1.1", 416, NULL);
+	/*
+	 * XXX: We ought to produce a body explaining things.
+	 * XXX: That really calls for us to hit vcl_synth{}
+	 */
+	req->resp_len = 0;
+}
+
 static const char *
-vrg_dorange(struct req *req, void **priv)
+vrg_dorange(struct req *req, ssize_t *lo, ssize_t *hi)
 {
 	ssize_t low, high;
-	struct vrg_priv *vrg_priv;
 	const char *err;
 
 	err = http_GetRange(req->http, &low, &high, req->resp_len);
@@ -123,16 +139,8 @@ vrg_dorange(struct req *req, void **priv)
 		http_PrintfHeader(req->resp, "Content-Range: bytes %jd-%jd/*",
 		    (intmax_t)low, (intmax_t)high);
 
-	vrg_priv = WS_Alloc(req->ws, sizeof *vrg_priv);
-	if (vrg_priv == NULL)
-		return ("WS too small");
-
-	INIT_OBJ(vrg_priv, VRG_PRIV_MAGIC);
-	vrg_priv->req = req;
-	vrg_priv->range_off = 0;
-	vrg_priv->range_low = low;
-	vrg_priv->range_high = high + 1;
-	*priv = vrg_priv;
+	*lo = low;
+	*hi = high + 1;
 	http_PutResponse(req->resp, "HTTP/1.1", 206, NULL);
 	return (NULL);
 }
@@ -195,10 +203,36 @@ vrg_ifrange(struct req *req)
 	return (1);
 }
 
+/*
+ * Apply the Range header of req to the response.  Returns 1 if the
+ * bytes [*lo, *hi) of the body are to be sent in a 206 response,
+ * otherwise the response is left alone or turned into a 416.
+ */
+
+int
+VRG_Range(struct req *req, struct vsl_log *vsl, ssize_t *lo, ssize_t *hi)
+{
+	const char *err;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	AN(lo);
+	AN(hi);
+
+	*lo = *hi = -1;
+	if (!vrg_ifrange(req))			// rfc7233,l,455,456
+		return (0);
+	err = vrg_dorange(req, lo, hi);
+	if (err == NULL)
+		return (*lo >= 0);
+	vrg_fail(req, vsl, err);
+	return (0);
+}
+
 static int v_matchproto_(vdp_init_f)
 vrg_range_init(VRT_CTX, struct vdp_ctx *vdc, void **priv)
 {
-	const char *err;
+	struct vrg_priv *vrg_priv;
+	ssize_t low, high;
 
 	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
 	CHECK_OBJ_ORNULL(ctx->req, REQ_MAGIC);
@@ -213,24 +247,22 @@ vrg_range_init(VRT_CTX, struct vdp_ctx *vdc, void **priv)
 
 	// not using vdc->{hd,cl}, because range needs req anyway for Req_Fail()
 
-	if (!vrg_ifrange(ctx->req))		// rfc7233,l,455,456
+	if (!VRG_Range(ctx->req, vdc->vsl, &low, &high))
 		return (1);
-	err = vrg_dorange(ctx->req, priv);
-	if (err == NULL)
-		return (*priv == NULL ? 1 : 0);
 
-	VSLb(vdc->vsl, SLT_Debug, "RANGE_FAIL %s", err);
-	if (ctx->req->resp_len >= 0)
-		http_PrintfHeader(ctx->req->resp,
-		    "Content-Range: bytes */%jd",
-		    (intmax_t)ctx->req->resp_len);
-	http_PutResponse(ctx->req->resp, "HTTP/1.1", 416, NULL);
-	/*
-	 * XXX: We ought to produce a body explaining things.
-	 * XXX: That really calls for us to hit vcl_synth{}
-	 */
-	ctx->req->resp_len = 0;
-	return (1);
+	vrg_priv = WS_Alloc(ctx->req->ws, sizeof *vrg_priv);
+	if (vrg_priv == NULL) {
+		vrg_fail(ctx->req, vdc->vsl, "WS too small");
+		return (1);
+	}
+
+	INIT_OBJ(vrg_priv, VRG_PRIV_MAGIC);
+	vrg_priv->req = ctx->req;
+	vrg_priv->range_off = 0;
+	vrg_priv->range_low = low;
+	vrg_priv->range_high = high;
+	*priv = vrg_priv;
+	return (0);
 }
 
 static int v_matchproto_(vdpio_init_f)
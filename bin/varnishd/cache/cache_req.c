@@ -230,7 +230,8 @@ Req_Release(struct req *req)
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
 	MPL_AssertSane(req);
 	VSL_Flush(req->vsl, 0);
-	MPL_Free(pp->mpl_req, req);
+	/* Nothing expects the workspace to be zero */
+	MPL_FreeDirty(pp->mpl_req, req, pdiff(req, req->ws->s));
 }
 
 /*----------------------------------------------------------------------
@@ -305,11 +306,14 @@ Req_Cleanup(struct sess *sp, struct worker *wrk, struct req *req)
 	req->t_prev = NAN;
 	req->t_req = NAN;
 	req->req_body_status = NULL;
+	req->body_tee = 0;
 
 	req->hash_always_miss = 0;
 	req->hash_ignore_busy = 0;
 	req->hash_ignore_vary = 0;
 	req->esi_level = 0;
+	req->slice = 0;
+	req->slice_size = 0;
 	req->is_hit = 0;
 	req->req_step = R_STP_TRANSPORT;
 	req->vcf = NULL;
@@ -319,6 +323,7 @@ Req_Cleanup(struct sess *sp, struct worker *wrk, struct req *req)
 
 	if (WS_Overflowed(req->ws))
 		wrk->stats->ws_client_overflow++;
+	WS_SizeSample(WS_K_CLIENT, req->ws, pdiff(req, req->ws->s));
 
 	wrk->seen_methods = 0;
 
@@ -336,3 +341,23 @@ Req_Fail(struct req *req, stream_close_t reason)
 	AN(req->transport->req_fail);
 	req->transport->req_fail(req, reason);
 }
+
+/*----------------------------------------------------------------------
+ * Send responses the transport held back, before the request does
+ * something it may have to wait for.  Returns non-zero if there were
+ * any.
+ */
+
+int
+Req_Flush(struct req *req)
+{
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+
+	CHECK_OBJ_NOTNULL(req->htc, HTTP_CONN_MAGIC);
+	if (req->htc->v1l_batch == NULL)
+		return (0);
+	AN(req->transport->req_flush);
+	req->transport->req_flush(req);
+	AZ(req->htc->v1l_batch);
+	return (1);
+}
@@ -42,11 +42,39 @@
 #include "vtim.h"
 #include "storage/storage.h"
 
+/*----------------------------------------------------------------------
+ * A cached req.body has a known length, also for restarts and rollbacks
+ */
+
+static void
+vrb_set_length(struct req *req, ssize_t req_bodybytes)
+{
+
+	assert(req_bodybytes >= 0);
+	if (req_bodybytes == req->htc->content_length)
+		return;
+
+	/* We must update also the "pristine" req.* copy */
+	http_Unset(req->http0, H_Content_Length);
+	http_Unset(req->http0, H_Transfer_Encoding);
+	http_PrintfHeader(req->http0, "Content-Length: %ju",
+	    (uintmax_t)req_bodybytes);
+
+	http_Unset(req->http, H_Content_Length);
+	http_Unset(req->http, H_Transfer_Encoding);
+	http_PrintfHeader(req->http, "Content-Length: %ju",
+	    (uintmax_t)req_bodybytes);
+}
+
 /*----------------------------------------------------------------------
  * Pull the req.body in via/into a objcore
  *
  * This can be called only once per request
  *
+ * With both a func and a maxsize, the body is kept in the objcore while
+ * it is passed on (tee), and ends up cached unless it exceeds maxsize.
+ * The tee runs in the fetch task, while the req waits in VBF_Fetch()
+ * for BOS_REQ_DONE, so the req headers are ours to update.
  */
 
 static ssize_t
@@ -60,6 +88,7 @@ vrb_pull(struct req *req, ssize_t maxsize, objiterate_f *func, void *priv)
 	const struct stevedore *stv;
 	ssize_t req_bodybytes = 0;
 	unsigned flush = OBJ_ITER_FLUSH;
+	unsigned tee;
 
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
 
@@ -115,9 +144,15 @@ vrb_pull(struct req *req, ssize_t maxsize, objiterate_f *func, void *priv)
 		(void)req->transport->minimal_response(req, 100);
 	}
 	yet = vmax_t(ssize_t, yet, 0);
+	tee = func != NULL && maxsize >= 0;
 	do {
 		AZ(vfc->failed);
-		if (maxsize >= 0 && req_bodybytes > maxsize) {
+		if (tee && req_bodybytes > maxsize) {
+			VSLb(req->vsl, SLT_Notice,
+			    "req.body too big to tee, not cached");
+			tee = 0;
+		} else if (func == NULL && maxsize >= 0 &&
+		    req_bodybytes > maxsize) {
 			(void)VFP_Error(vfc, "Request body too big to cache");
 			break;
 		}
@@ -141,6 +176,9 @@ vrb_pull(struct req *req, ssize_t maxsize, objiterate_f *func, void *priv)
 				r = func(priv, flush, ptr, l);
 				if (r)
 					break;
+				if (tee)
+					ObjExtend(req->wrk, req->body_oc, l,
+					    vfps == VFP_END ? 1 : 0);
 			} else {
 				ObjExtend(req->wrk, req->body_oc, l,
 				    vfps == VFP_END ? 1 : 0);
@@ -151,10 +189,19 @@ vrb_pull(struct req *req, ssize_t maxsize, objiterate_f *func, void *priv)
 	req->acct.req_bodybytes += VFP_Close(vfc);
 	VSLb_ts_req(req, "ReqBody", VTIM_real());
 	if (func != NULL) {
-		HSH_DerefBoc(req->wrk, req->body_oc);
-		AZ(HSH_DerefObjCore(req->wrk, &req->body_oc));
 		if (vfps == VFP_END && r == 0 && (flush & OBJ_ITER_END) == 0)
 			r = func(priv, flush | OBJ_ITER_END, NULL, 0);
+		if (tee && vfps == VFP_END && r == 0 &&
+		    req_bodybytes <= maxsize) {
+			AZ(ObjSetU64(req->wrk, req->body_oc, OA_LEN,
+			    req_bodybytes));
+			HSH_DerefBoc(req->wrk, req->body_oc);
+			vrb_set_length(req, req_bodybytes);
+			req->req_body_status = BS_CACHED;
+			return (r);
+		}
+		HSH_DerefBoc(req->wrk, req->body_oc);
+		AZ(HSH_DerefObjCore(req->wrk, &req->body_oc));
 		if (vfps != VFP_END) {
 			req->req_body_status = BS_ERROR;
 			if (r == 0)
@@ -172,20 +219,7 @@ vrb_pull(struct req *req, ssize_t maxsize, objiterate_f *func, void *priv)
 		return (-1);
 	}
 
-	assert(req_bodybytes >= 0);
-	if (req_bodybytes != req->htc->content_length) {
-		/* We must update also the "pristine" req.* copy */
-		http_Unset(req->http0, H_Content_Length);
-		http_Unset(req->http0, H_Transfer_Encoding);
-		http_PrintfHeader(req->http0, "Content-Length: %ju",
-		    (uintmax_t)req_bodybytes);
-
-		http_Unset(req->http, H_Content_Length);
-		http_Unset(req->http, H_Transfer_Encoding);
-		http_PrintfHeader(req->http, "Content-Length: %ju",
-		    (uintmax_t)req_bodybytes);
-	}
-
+	vrb_set_length(req, req_bodybytes);
 	req->req_body_status = BS_CACHED;
 	return (req_bodybytes);
 }
@@ -238,7 +272,8 @@ VRB_Iterate(struct worker *wrk, struct vsl_log *vsl,
 		    "Multiple attempts to access non-cached req.body");
 		return (i);
 	}
-	return (vrb_pull(req, -1, func, priv));
+	return (vrb_pull(req, req->body_tee > 0 ? req->body_tee : -1,
+	    func, priv));
 }
 
 /*----------------------------------------------------------------------
@@ -339,3 +374,34 @@ VRB_Cache(struct req *req, ssize_t maxsize)
 
 	return (vrb_pull(req, maxsize, NULL, NULL));
 }
+
+/*----------------------------------------------------------------------
+ * Cache the req.body while it is sent to the backend, if it is smaller
+ * than the given size.  Unlike VRB_Cache() nothing is read up front, so
+ * the first backend request does not wait for the whole body.  Retries
+ * and restarts after that find the req.body cached.
+ */
+
+ssize_t
+VRB_Tee(struct req *req, ssize_t maxsize)
+{
+	uint64_t u;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	assert (req->req_step == R_STP_RECV);
+	assert(maxsize >= 0);
+
+	if (req->req_body_status == BS_CACHED) {
+		AZ(ObjGetU64(req->wrk, req->body_oc, OA_LEN, &u));
+		return (u);
+	}
+
+	if (req->req_body_status->avail <= 0)
+		return (req->req_body_status->avail);
+
+	if (maxsize == 0 || req->htc->content_length > maxsize)
+		return (-1);
+
+	req->body_tee = maxsize;
+	return (0);
+}
@@ -40,6 +40,8 @@
 
 #include "config.h"
 
+#include <stdio.h>
+
 #include "cache_varnishd.h"
 #include "cache_filter.h"
 #include "cache_objhead.h"
@@ -50,7 +52,6 @@
 #include "storage/storage.h"
 #include "vcl.h"
 #include "vct.h"
-#include "vsha256.h"
 #include "vtim.h"
 
 #define REQ_STEPS \
@@ -549,6 +550,16 @@ cnt_fetch(struct worker *wrk, struct req *req)
 	CHECK_OBJ_NOTNULL(req->objcore, OBJCORE_MAGIC);
 	AZ(req->stale_oc);
 
+	if (req->boc != NULL && VBF_Wait(wrk, req)) {
+		/*
+		 * We parked on the busy object instead of waiting for
+		 * the backend response, and return to STP_FETCH when it
+		 * can be delivered from.
+		 */
+		return (REQ_FSM_DISEMBARK);
+	}
+	AZ(req->boc);
+
 	wrk->stats->s_fetch++;
 	(void)VRB_Ignore(req);
 
@@ -602,6 +613,15 @@ cnt_lookup(struct worker *wrk, struct req *req)
 		 */
 		return (REQ_FSM_DISEMBARK);
 	}
+	if (lr == HSH_FLUSH) {
+		/*
+		 * Send the responses held back by the transport before
+		 * waiting for the busy object, then look again.
+		 */
+		VRY_Finish(req, DISCARD);
+		AN(Req_Flush(req));
+		return (REQ_FSM_MORE);
+	}
 	assert(wrk->strangelove >= 0);
 	if ((unsigned)wrk->strangelove >= cache_param->vary_notice)
 		VSLb(req->vsl, SLT_Notice, "vsl: High number of variants (%d)",
@@ -658,9 +678,14 @@ cnt_lookup(struct worker *wrk, struct req *req)
 			VBF_Fetch(wrk, req, busy, oc, VBF_BACKGROUND);
 			wrk->stats->s_fetch++;
 			wrk->stats->s_bgfetch++;
+			if (lr == HSH_HIT)
+				wrk->stats->s_refresh++;
 		} else {
 			(void)VRB_Ignore(req);// XXX: handle err
 		}
+		/* Delivery may wait for the fetch of a busy hit */
+		if (oc->boc != NULL)
+			(void)Req_Flush(req);
 		wrk->stats->cache_hit++;
 		req->is_hit = 1;
 		if (lr == HSH_GRACE)
@@ -714,10 +739,22 @@ cnt_miss(struct worker *wrk, struct req *req)
 	switch (wrk->vpi->handling) {
 	case VCL_RET_FETCH:
 		wrk->stats->cache_miss++;
-		VBF_Fetch(wrk, req, req->objcore, req->stale_oc, VBF_NORMAL);
+		if (req->slice_prefetch && !req->is_hitmiss) {
+			/* Nothing to deliver, see cache_slice.c */
+			HSH_Ref(req->objcore);
+			VBF_Fetch(wrk, req, req->objcore, req->stale_oc,
+			    VBF_BACKGROUND);
+			wrk->stats->s_fetch++;
+			wrk->stats->s_bgfetch++;
+			req->req_step = R_STP_FINISH;
+		} else {
+			(void)Req_Flush(req);
+			VBF_Fetch(wrk, req, req->objcore, req->stale_oc,
+			    VBF_NORMAL);
+			req->req_step = R_STP_FETCH;
+		}
 		if (req->stale_oc != NULL)
 			(void)HSH_DerefObjCore(wrk, &req->stale_oc);
-		req->req_step = R_STP_FETCH;
 		return (REQ_FSM_MORE);
 	case VCL_RET_FAIL:
 		req->req_step = R_STP_VCLFAIL;
@@ -770,6 +807,7 @@ cnt_pass(struct worker *wrk, struct req *req)
 		wrk->stats->s_pass++;
 		req->objcore = HSH_Private(wrk);
 		CHECK_OBJ_NOTNULL(req->objcore, OBJCORE_MAGIC);
+		(void)Req_Flush(req);
 		VBF_Fetch(wrk, req, req->objcore, NULL, VBF_PASS);
 		req->req_step = R_STP_FETCH;
 		break;
@@ -943,8 +981,9 @@ static enum req_fsm_nxt v_matchproto_(req_state_f)
 cnt_recv(struct worker *wrk, struct req *req)
 {
 	unsigned recv_handling;
-	struct VSHA256Context sha256ctx;
+	struct hsh_ctx hshctx;
 	const char *ci;
+	char slice[20];
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
@@ -1025,13 +1064,18 @@ cnt_recv(struct worker *wrk, struct req *req)
 		}
 	}
 
-	VSHA256_Init(&sha256ctx);
-	VCL_hash_method(req->vcl, wrk, req, NULL, &sha256ctx);
+	HSH_DigestInit(&hshctx);
+	VCL_hash_method(req->vcl, wrk, req, NULL, &hshctx);
 	if (wrk->vpi->handling == VCL_RET_FAIL)
 		recv_handling = wrk->vpi->handling;
 	else
 		assert(wrk->vpi->handling == VCL_RET_LOOKUP);
-	VSHA256_Final(req->digest, &sha256ctx);
+	if (req->slice > 0) {
+		/* Each slice is an object of its own */
+		bprintf(slice, "slice %u", req->slice);
+		HSH_AddString(req, &hshctx, slice);
+	}
+	HSH_DigestFinal(&hshctx, req->digest);
 
 	switch (recv_handling) {
 	case VCL_RET_VCL:
@@ -1190,6 +1234,7 @@ CNT_Request(struct req *req)
 	 */
 	assert(
 	    req->req_step == R_STP_LOOKUP ||
+	    req->req_step == R_STP_FETCH ||
 	    req->req_step == R_STP_FINISH ||
 	    req->req_step == R_STP_TRANSPORT);
 
@@ -274,6 +274,7 @@ HTC_RxInit(struct http_conn *htc, struct ws *ws)
 
 	htc->rxbuf_b = WS_Reservation(ws);
 	htc->rxbuf_e = htc->rxbuf_b + l;
+	htc->rxbuf_scan = NULL;
 	htc->pipeline_b = NULL;
 	htc->pipeline_e = NULL;
 }
@@ -626,6 +627,7 @@ SES_Delete(struct sess *sp, stream_close_t reason, vtim_real now)
 	VSL(SLT_End, sp->vxid, "%s", "");
 	if (WS_Overflowed(sp->ws))
 		VSC_C_main->ws_session_overflow++;
+	WS_SizeSample(WS_K_SESSION, sp->ws, pdiff(sp, sp->ws->s));
 	SES_Rel(sp);
 }
 
@@ -704,10 +706,10 @@ SES_NewPool(struct pool *pp, unsigned pool_no)
 	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
 	bprintf(nb, "req%u", pool_no);
 	pp->mpl_req = MPL_New(nb, &cache_param->pool_req,
-	    &cache_param->workspace_client);
+	    &cache_param->workspace_client, WS_SizeAuto(WS_K_CLIENT));
 	bprintf(nb, "sess%u", pool_no);
 	pp->mpl_sess = MPL_New(nb, &cache_param->pool_sess,
-	    &cache_param->workspace_session);
+	    &cache_param->workspace_session, WS_SizeAuto(WS_K_SESSION));
 
 	bprintf(nb, "pool%u", pool_no);
 	pp->waiter = Waiter_New(nb);
@@ -0,0 +1,659 @@
+/*-
+ * Copyright (c) 2026 Varnish Software AS
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Sliced objects
+ *
+ * With slice_size set, cacheable objects are fetched with a Range request
+ * for their first slice_size bytes.  If the backend answers with a 206
+ * for a larger object, the response is stored as a 200 with the
+ * Content-Length of the whole object, and OA_SLICE marks it as the head
+ * of a sliced object.
+ *
+ * Delivering the head sends its own bytes and then runs a subrequest for
+ * each further slice, much like an ESI include.  The subrequests have the
+ * slice index added to their hash, so every slice is an object of its
+ * own, fetched with a Range request of its own when it is not cached.
+ * Before a slice is sent, a prefetch subrequest is run for the next one:
+ * on a miss it starts a background fetch and is done, if the slice is
+ * already busy it is left on the waiting list.  Either way the slice at
+ * hand is sent right away, and the prefetch is only finished before the
+ * next slice is included.
+ *
+ * A slice which does not belong to the head, because the object changed
+ * on the backend, kills both and aborts the delivery.
+ */
+
+#include "config.h"
+
+#include "cache_varnishd.h"
+#include "cache_filter.h"
+#include "cache_objhead.h"
+#include "cache_transport.h"
+
+#include "vend.h"
+#include "vtim.h"
+
+struct vsli {
+	unsigned		magic;
+#define VSLI_MAGIC		0x5d1ce5a1
+	int			woken;
+	int			failed;
+	unsigned		cur;
+
+	struct req		*preq;
+	struct req		*pfreq;		/* prefetch on waiting list */
+	struct vdp_ctx		*vdc;
+	ssize_t			size;
+	ssize_t			total;
+	ssize_t			lo;
+	ssize_t			hi;
+	ssize_t			off;
+};
+
+static vtr_deliver_f sli_deliver;
+static vtr_reembark_f sli_reembark;
+static vtr_minimal_response_f sli_minimal_response;
+
+static const struct transport SLI_transport = {
+	.magic =		TRANSPORT_MAGIC,
+	.name =			"SLICE",
+	.deliver =		sli_deliver,
+	.reembark =		sli_reembark,
+	.minimal_response =	sli_minimal_response,
+};
+
+/*--------------------------------------------------------------------
+ * OA_SLICE holds the slice size, the length of the whole object and
+ * the index of the slice.
+ */
+
+void
+SLI_SetAttr(const struct busyobj *bo)
+{
+	uint8_t *p;
+
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	assert(bo->slice_total > 0);
+	p = ObjSetAttr(bo->wrk, bo->fetch_objcore, OA_SLICE, 24, NULL);
+	AN(p);
+	vbe64enc(p, bo->slice_size);
+	vbe64enc(p + 8, bo->slice_total);
+	vbe64enc(p + 16, bo->slice);
+}
+
+static int
+sli_getattr(struct worker *wrk, struct objcore *oc, uint64_t *size,
+    uint64_t *total, uint64_t *idx)
+{
+	const uint8_t *p;
+	ssize_t l;
+
+	if (!ObjHasAttr(wrk, oc, OA_SLICE))
+		return (-1);
+	p = ObjGetAttr(wrk, oc, OA_SLICE, &l);
+	AN(p);
+	assert(l == 24);
+	*size = vbe64dec(p);
+	*total = vbe64dec(p + 8);
+	*idx = vbe64dec(p + 16);
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Fetch side
+ */
+
+void
+SLI_Bereq(struct busyobj *bo)
+{
+	uint64_t lo;
+
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	CHECK_OBJ_NOTNULL(bo->req, REQ_MAGIC);
+
+	if (bo->req->slice > 0) {
+		bo->slice = bo->req->slice;
+		bo->slice_size = bo->req->slice_size;
+	} else if (!bo->uncacheable)
+		bo->slice_size = cache_param->slice_size;
+
+	if (bo->slice_size == 0)
+		return;
+	lo = bo->slice * bo->slice_size;
+	http_PrintfHeader(bo->bereq0, "Range: bytes=%ju-%ju",
+	    (uintmax_t)lo, (uintmax_t)(lo + bo->slice_size - 1));
+}
+
+/*
+ * Check the backend response to a slice fetch and turn it into a 200.
+ * Returns -1 if the object should be fetched whole instead and 1 if the
+ * fetch should fail.
+ */
+
+int
+SLI_CheckBo(struct busyobj *bo)
+{
+	ssize_t lo, hi, len, want;
+
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+
+	if (bo->slice_size == 0)
+		return (0);
+
+	len = http_GetContentRange(bo->beresp, &lo, &hi);
+	want = (ssize_t)(bo->slice * bo->slice_size);
+
+	if (bo->slice == 0 && http_IsStatus(bo->beresp, 416)) {
+		VSLb(bo->vsl, SLT_Debug, "Slice: 416, fetching whole object");
+		return (-1);
+	}
+	if (bo->slice == 0 && !http_IsStatus(bo->beresp, 206)) {
+		/* No Range support, this is the whole object */
+		bo->slice_size = 0;
+		return (0);
+	}
+
+	if (!http_IsStatus(bo->beresp, 206) ||
+	    http_GetHdr(bo->beresp, H_Content_Encoding, NULL) ||
+	    len <= want || lo != want ||
+	    hi + 1 != vmin_t(ssize_t, len, want + (ssize_t)bo->slice_size)) {
+		if (bo->slice == 0) {
+			VSLb(bo->vsl, SLT_Debug,
+			    "Slice: unusable 206, fetching whole object");
+			return (-1);
+		}
+		VSLb(bo->vsl, SLT_Error, "Slice %u: unexpected response",
+		    bo->slice);
+		return (1);
+	}
+
+	http_SetStatus(bo->beresp, 200, NULL);
+	http_Unset(bo->beresp, H_Content_Range);
+
+	if (bo->slice == 0) {
+		if (len == hi + 1) {
+			/* Fits in one slice */
+			bo->slice_size = 0;
+			return (0);
+		}
+		/* The head carries the length of the whole object */
+		http_Unset(bo->beresp, H_Content_Length);
+		http_PrintfHeader(bo->beresp, "Content-Length: %jd",
+		    (intmax_t)len);
+	}
+	bo->slice_total = len;
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Slice subrequests
+ */
+
+static int v_matchproto_(vtr_minimal_response_f)
+sli_minimal_response(struct req *req, uint16_t status)
+{
+	struct vsli *sli;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CAST_OBJ_NOTNULL(sli, req->transport_priv, VSLI_MAGIC);
+	VSLb(req->vsl, SLT_Error, "Slice %u: status %u", req->slice, status);
+	if (req->slice == sli->cur)
+		sli->failed = 1;
+	return (-1);
+}
+
+static void v_matchproto_(vtr_reembark_f)
+sli_reembark(struct worker *wrk, struct req *req)
+{
+	struct vsli *sli;
+
+	(void)wrk;
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CAST_OBJ_NOTNULL(sli, req->transport_priv, VSLI_MAGIC);
+	Lck_Lock(&req->sp->mtx);
+	sli->woken = 1;
+	PTOK(pthread_cond_signal(&sli->preq->wrk->cond));
+	Lck_Unlock(&req->sp->mtx);
+}
+
+/*
+ * Run a slice subrequest until it is done, or for a prefetch, until it
+ * first disembarks.  Returns non-zero if the prefetch was left waiting.
+ */
+
+static int
+sli_run(struct vsli *sli, struct req *req, const struct req *creq)
+{
+	struct worker *wrk;
+	struct sess *sp;
+	enum req_fsm_nxt s;
+	int resume;
+
+	CHECK_OBJ_NOTNULL(sli, VSLI_MAGIC);
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CHECK_OBJ_NOTNULL(creq, REQ_MAGIC);
+	sp = req->sp;
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	wrk = creq->wrk;
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+
+	THR_SetRequest(req);
+	resume = sli->pfreq == req;
+	sli->pfreq = NULL;
+	while (1) {
+		if (!resume) {
+			CNT_Embark(wrk, req);
+			sli->woken = 0;
+			s = CNT_Request(req);
+			if (s == REQ_FSM_DONE)
+				break;
+			DSL(DBG_WAITINGLIST, req->vsl->wid,
+			    "waiting for slice (%d)", (int)s);
+			assert(s == REQ_FSM_DISEMBARK);
+			if (req->slice_prefetch) {
+				sli->pfreq = req;
+				THR_SetRequest(creq);
+				return (1);
+			}
+		}
+		resume = 0;
+		Lck_Lock(&sp->mtx);
+		if (!sli->woken)
+			(void)Lck_CondWait(&sli->preq->wrk->cond, &sp->mtx);
+		Lck_Unlock(&sp->mtx);
+		AZ(req->wrk);
+	}
+
+	VCL_Rel(&req->vcl);
+
+	req->wrk = NULL;
+	THR_SetRequest(creq);
+
+	Req_Cleanup(sp, wrk, req);
+	Req_Release(req);
+	return (0);
+}
+
+static void
+sli_prefetch_wait(struct vsli *sli, const struct req *creq)
+{
+
+	CHECK_OBJ_NOTNULL(sli, VSLI_MAGIC);
+	if (sli->pfreq != NULL)
+		AZ(sli_run(sli, sli->pfreq, creq));
+	AZ(sli->pfreq);
+}
+
+static void
+sli_include(struct vsli *sli, unsigned n, const struct req *creq)
+{
+	struct worker *wrk;
+	struct sess *sp;
+	struct req *preq, *req;
+
+	CHECK_OBJ_NOTNULL(sli, VSLI_MAGIC);
+	preq = sli->preq;
+	CHECK_OBJ_NOTNULL(preq, REQ_MAGIC);
+	CHECK_OBJ_NOTNULL(creq, REQ_MAGIC);
+	sp = preq->sp;
+	CHECK_OBJ_NOTNULL(sp, SESS_MAGIC);
+	wrk = creq->wrk;
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	AZ(sli->pfreq);
+
+	req = Req_New(sp, preq);
+	AN(req);
+	assert(IS_NO_VXID(req->vsl->wid));
+	req->vsl->wid = VXID_Get(wrk, VSL_CLIENTMARKER);
+
+	wrk->stats->slice_req++;
+	req->esi_level = preq->esi_level;
+	req->slice = n;
+	req->slice_size = sli->size;
+	req->slice_prefetch = n != sli->cur;
+
+	VSLb(req->vsl, SLT_Begin, "req %ju slice",
+	    (uintmax_t)VXID(preq->vsl->wid));
+	VSLb(preq->vsl, SLT_Link, "req %ju slice",
+	    (uintmax_t)VXID(req->vsl->wid));
+	VSLb(req->vsl, SLT_Debug, "Slice %u%s", n,
+	    n == sli->cur ? "" : " prefetch");
+
+	VSLb_ts_req(req, "Start", W_TIM_real(wrk));
+
+	HTTP_Setup(req->http, req->ws, req->vsl, SLT_ReqMethod);
+	HTTP_Dup(req->http, preq->http0);
+
+	http_ForceField(req->http, HTTP_HDR_METHOD, "GET");
+
+	/* The parent request takes care of conditionals and Range */
+	http_Unset(req->http, H_If_Modified_Since);
+	http_Unset(req->http, H_If_None_Match);
+	http_Unset(req->http, H_If_Range);
+	http_Unset(req->http, H_Range);
+
+	/* Client content already taken care of */
+	http_Unset(req->http, H_Content_Length);
+	http_Unset(req->http, H_Transfer_Encoding);
+	req->req_body_status = BS_NONE;
+
+	AZ(req->vcl);
+	assert(req->top == preq->top);
+	if (req->top->vcl0)
+		req->vcl = req->top->vcl0;
+	else
+		req->vcl = preq->vcl;
+	VCL_Ref(req->vcl);
+
+	assert(req->req_step == R_STP_TRANSPORT);
+	req->t_req = preq->t_req;
+
+	req->transport = &SLI_transport;
+	req->transport_priv = sli;
+
+	VCL_TaskEnter(req->privs);
+
+	(void)sli_run(sli, req, creq);
+}
+
+/*--------------------------------------------------------------------
+ * Send the bytes at offset sli->off which fall into the requested range
+ */
+
+static int
+sli_bytes(struct vsli *sli, enum vdp_action act, const void *ptr,
+    ssize_t len)
+{
+	const char *p = ptr;
+	ssize_t l;
+
+	assert(act != VDP_END);
+	l = sli->lo - sli->off;
+	if (l > 0) {
+		l = vmin(l, len);
+		sli->off += l;
+		p += l;
+		len -= l;
+	}
+	l = vmin(sli->hi - sli->off, len);
+	sli->off += len;
+	if (l > 0)
+		return (VDP_bytes(sli->vdc, act, p, l));
+	if (act == VDP_FLUSH)
+		return (VDP_bytes(sli->vdc, act, NULL, 0));
+	return (0);
+}
+
+static int v_matchproto_(vdp_fini_f)
+sli_fwd_fini(struct vdp_ctx *vdc, void **priv)
+{
+	(void)vdc;
+	*priv = NULL;
+	return (0);
+}
+
+static int v_matchproto_(vdp_bytes_f)
+sli_fwd_bytes(struct vdp_ctx *vdc, enum vdp_action act, void **priv,
+    const void *ptr, ssize_t len)
+{
+	struct vsli *sli;
+
+	(void)vdc;
+	CAST_OBJ_NOTNULL(sli, *priv, VSLI_MAGIC);
+	if (act == VDP_END)
+		act = VDP_FLUSH;
+	return (sli_bytes(sli, act, ptr, len));
+}
+
+static const struct vdp sli_fwd = {
+	.name =		"slice_fwd",
+	.bytes =	sli_fwd_bytes,
+	.fini =		sli_fwd_fini,
+};
+
+static int
+sli_same(struct worker *wrk, struct objcore *a, struct objcore *b,
+    hdr_t hdr)
+{
+	const char *pa, *pb;
+
+	pa = HTTP_GetHdrPack(wrk, a, hdr);
+	pb = HTTP_GetHdrPack(wrk, b, hdr);
+	if (pa == NULL || pb == NULL)
+		return (pa == pb);
+	return (!strcmp(pa, pb));
+}
+
+static void
+sli_kill(struct objcore *oc)
+{
+
+	if (!(oc->flags & OC_F_PRIVATE))
+		HSH_Kill(oc);
+}
+
+static int
+sli_check(struct req *req, const struct vsli *sli)
+{
+	uint64_t size, total, idx;
+	struct objcore *poc;
+
+	poc = sli->preq->objcore;
+	CHECK_OBJ_NOTNULL(poc, OBJCORE_MAGIC);
+
+	if (http_GetStatus(req->resp) != 200) {
+		VSLb(req->vsl, SLT_Error, "Slice %u: status %u", req->slice,
+		    http_GetStatus(req->resp));
+		return (0);
+	}
+	if (sli_getattr(req->wrk, req->objcore, &size, &total, &idx) ||
+	    size != (uint64_t)sli->size || total != (uint64_t)sli->total ||
+	    idx != req->slice ||
+	    !sli_same(req->wrk, req->objcore, poc, H_ETag) ||
+	    !sli_same(req->wrk, req->objcore, poc, H_Last_Modified)) {
+		VSLb(req->vsl, SLT_Error,
+		    "Slice %u: does not match the object", req->slice);
+		sli_kill(req->objcore);
+		sli_kill(poc);
+		return (0);
+	}
+	return (1);
+}
+
+static enum vtr_deliver_e v_matchproto_(vtr_deliver_f)
+sli_deliver(struct req *req, int wantbody)
+{
+	struct vsli *sli;
+	struct vrt_ctx ctx[1];
+	int i;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CHECK_OBJ_ORNULL(req->boc, BOC_MAGIC);
+	CHECK_OBJ_NOTNULL(req->objcore, OBJCORE_MAGIC);
+	CAST_OBJ_NOTNULL(sli, req->transport_priv, VSLI_MAGIC);
+
+	if (req->slice_prefetch) {
+		/* Prefetch of a cached or streaming slice */
+		req->acct.resp_bodybytes +=
+		    VDP_Close(req->vdc, req->objcore, req->boc);
+		return (VTR_D_DONE);
+	}
+
+	if (!wantbody || !sli_check(req, sli)) {
+		sli->failed = 1;
+		req->acct.resp_bodybytes +=
+		    VDP_Close(req->vdc, req->objcore, req->boc);
+		return (VTR_D_DONE);
+	}
+
+	/* A slice we could not cache says little good about the next one */
+	if ((ssize_t)(req->slice + 1) * sli->size < sli->hi &&
+	    !(req->objcore->flags & OC_F_PRIVATE))
+		sli_include(sli, req->slice + 1, req);
+
+	INIT_OBJ(ctx, VRT_CTX_MAGIC);
+	VCL_Req2Ctx(ctx, req);
+
+	i = VDP_Push(ctx, req->vdc, req->ws, &sli_fwd, sli);
+	if (i == 0) {
+		i = VDP_DeliverObj(req->vdc, req->objcore);
+	} else {
+		VSLb(req->vsl, SLT_Error, "Failure to push slice processor");
+		req->doclose = SC_OVERLOAD;
+	}
+	if (i)
+		sli->failed = 1;
+
+	req->acct.resp_bodybytes += VDP_Close(req->vdc, req->objcore, req->boc);
+	return (VTR_D_DONE);
+}
+
+/*--------------------------------------------------------------------
+ * The delivery processor for the head of a sliced object
+ */
+
+static int v_matchproto_(vdp_init_f)
+sli_vdp_init(VRT_CTX, struct vdp_ctx *vdc, void **priv)
+{
+	struct vsli *sli;
+	struct req *req;
+	uint64_t size, total, idx;
+	ssize_t lo, hi;
+
+	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
+	CHECK_OBJ_ORNULL(ctx->req, REQ_MAGIC);
+	CHECK_OBJ_NOTNULL(vdc, VDP_CTX_MAGIC);
+	CHECK_OBJ_ORNULL(vdc->oc, OBJCORE_MAGIC);
+	AN(vdc->clen);
+	AN(priv);
+
+	AZ(*priv);
+	if (vdc->oc == NULL ||
+	    sli_getattr(vdc->wrk, vdc->oc, &size, &total, &idx) || idx != 0)
+		return (1);
+
+	req = ctx->req;
+	if (req == NULL) {
+		VSLb(vdc->vsl, SLT_Error,
+		     "slice can only be used on the client side");
+		return (1);
+	}
+
+	sli = WS_Alloc(req->ws, sizeof *sli);
+	if (sli == NULL) {
+		VSLb(vdc->vsl, SLT_Error, "slice: WS too small");
+		return (-1);
+	}
+	INIT_OBJ(sli, VSLI_MAGIC);
+	sli->preq = req;
+	sli->vdc = vdc;
+	sli->size = (ssize_t)size;
+	sli->total = (ssize_t)total;
+	sli->hi = sli->total;
+
+	if (*vdc->clen != 0)
+		*vdc->clen = sli->total;
+	if (cache_param->http_range_support &&
+	    http_GetStatus(req->resp) == 200 &&
+	    http_GetHdr(req->http, H_Range, NULL) &&
+	    VRG_Range(req, vdc->vsl, &lo, &hi)) {
+		sli->lo = lo;
+		sli->hi = hi;
+	}
+
+	*priv = sli;
+	return (0);
+}
+
+static int v_matchproto_(vdp_fini_f)
+sli_vdp_fini(struct vdp_ctx *vdc, void **priv)
+{
+	struct vsli *sli;
+
+	(void)vdc;
+	AN(priv);
+	if (*priv != NULL) {
+		CAST_OBJ_NOTNULL(sli, *priv, VSLI_MAGIC);
+		sli_prefetch_wait(sli, sli->preq);
+	}
+	/* struct on ws, no need to free */
+	*priv = NULL;
+	return (0);
+}
+
+static int v_matchproto_(vdp_bytes_f)
+sli_vdp_bytes(struct vdp_ctx *vdc, enum vdp_action act, void **priv,
+    const void *ptr, ssize_t len)
+{
+	struct vsli *sli;
+	ssize_t end;
+	unsigned n;
+	int retval;
+
+	CHECK_OBJ_NOTNULL(vdc, VDP_CTX_MAGIC);
+	AN(priv);
+	CAST_OBJ_NOTNULL(sli, *priv, VSLI_MAGIC);
+	assert(sli->vdc == vdc);
+
+	if (len > 0 || act == VDP_FLUSH) {
+		retval = sli_bytes(sli, act == VDP_END ? VDP_NULL : act,
+		    ptr, len);
+		if (retval)
+			return (retval);
+	}
+	if (act != VDP_END)
+		return (0);
+
+	if (sli->off != sli->size) {
+		VSLb(vdc->vsl, SLT_Error, "Slice 0: short object");
+		return (-1);
+	}
+
+	for (n = vmax_t(unsigned, sli->lo / sli->size, 1);
+	    (ssize_t)n * sli->size < sli->hi; n++) {
+		retval = VDP_bytes(vdc, VDP_FLUSH, NULL, 0);
+		if (retval)
+			return (retval);
+		sli_prefetch_wait(sli, sli->preq);
+		sli->off = (ssize_t)n * sli->size;
+		sli->cur = n;
+		sli_include(sli, n, sli->preq);
+		end = vmin((ssize_t)(n + 1) * sli->size, sli->total);
+		if (sli->failed || vdc->retval || sli->off != end) {
+			VSLb(vdc->vsl, SLT_Error, "Slice %u: failed", n);
+			return (-1);
+		}
+	}
+	return (VDP_bytes(vdc, VDP_END, NULL, 0));
+}
+
+const struct vdp VDP_slice = {
+	.name =		"slice",
+	.init =		sli_vdp_init,
+	.bytes =	sli_vdp_bytes,
+	.fini =		sli_vdp_fini,
+};
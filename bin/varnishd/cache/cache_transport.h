@@ -49,6 +49,7 @@ typedef void vtr_req_body_f (struct req *);
 typedef void vtr_sess_panic_f (struct vsb *, const struct sess *);
 typedef void vtr_req_panic_f (struct vsb *, const struct req *);
 typedef void vtr_req_fail_f (struct req *, stream_close_t);
+typedef void vtr_req_flush_f (struct req *);
 typedef void vtr_reembark_f (struct worker *, struct req *);
 typedef int vtr_poll_f (struct req *);
 typedef int vtr_minimal_response_f (struct req *, uint16_t status);
@@ -66,6 +67,7 @@ struct transport {
 	task_func_t			*unwait;
 
 	vtr_req_fail_f			*req_fail;
+	vtr_req_flush_f			*req_flush;
 	vtr_req_body_f			*req_body;
 	vtr_deliver_f			*deliver;
 	vtr_sess_panic_f		*sess_panic;
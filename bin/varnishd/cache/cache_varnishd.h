@@ -53,6 +53,7 @@ struct vfp;
 struct vdp;
 struct cli_proto;
 struct poolparam;
+struct v1l_batch;
 
 /*--------------------------------------------------------------------*/
 
@@ -102,10 +103,12 @@ struct http_conn {
 	struct ws		*ws;
 	char			*rxbuf_b;
 	char			*rxbuf_e;
+	char			*rxbuf_scan;
 	char			*pipeline_b;
 	char			*pipeline_e;
 	ssize_t			content_length;
 	void			*priv;
+	struct v1l_batch	*v1l_batch;
 
 	/* Timeouts */
 	vtim_dur		first_byte_timeout;
@@ -175,6 +178,7 @@ vtim_real BAN_Time(const struct ban *ban);
 /* cache_busyobj.c */
 struct busyobj *VBO_GetBusyObj(const struct worker *, const struct req *);
 void VBO_ReleaseBusyObj(struct worker *wrk, struct busyobj **busyobj);
+int VBO_BereqHome(struct busyobj *);
 void VBO_SetState(struct worker *wrk, struct busyobj *bo,
     enum boc_state_e next);
 
@@ -198,8 +202,10 @@ int VDP_Push(VRT_CTX, struct vdp_ctx *, struct ws *, const struct vdp *,
 int VDP_ObjIterate(void *priv, unsigned flush, const void *ptr, ssize_t len);
 int VDP_DeliverObj(struct vdp_ctx *vdc, struct objcore *oc);
 extern const struct vdp VDP_gunzip;
+extern const struct vdp VDP_identity;
 extern const struct vdp VDP_esi;
 extern const struct vdp VDP_range;
+extern const struct vdp VDP_slice;
 
 uint64_t VDPIO_Close(struct vdp_ctx *, struct objcore *, struct boc *);
 int VDPIO_Upgrade(VRT_CTX, struct vdp_ctx *vdc);
@@ -257,6 +263,7 @@ void BAN_Shutdown(void);
 
 /* From cache_hash.c */
 void BAN_NewObjCore(struct objcore *oc);
+void BAN_InheritObjCore(struct objcore *oc, const struct objcore *from);
 void BAN_DestroyObj(struct objcore *oc);
 int BAN_CheckObject(struct worker *, struct objcore *, struct req *);
 
@@ -280,7 +287,9 @@ enum vbf_fetch_mode_e {
 };
 void VBF_Fetch(struct worker *wrk, struct req *req,
     struct objcore *oc, struct objcore *oldoc, enum vbf_fetch_mode_e);
+int VBF_Wait(struct worker *, struct req *);
 const char *VBF_Get_Filter_List(struct busyobj *);
+int VBF_Gzip_Background(const struct busyobj *);
 void Bereq_Rollback(VRT_CTX);
 
 /* cache_fetch_proc.c */
@@ -300,6 +309,8 @@ extern const struct vfp VFP_esi_gzip;
 
 /* cache_http.c */
 void HTTP_Init(void);
+unsigned HTTP_SetHdrPack(struct worker *, struct objcore *, hdr_t,
+    const char *, uint8_t *, unsigned);
 
 /* cache_http1_proto.c */
 
@@ -331,10 +342,11 @@ void LCK_Init(void);
 /* cache_mempool.c */
 void MPL_AssertSane(const void *item);
 struct mempool * MPL_New(const char *name, volatile struct poolparam *pp,
-    volatile unsigned *cur_size);
+    volatile unsigned *cur_size, const volatile unsigned *auto_size);
 void MPL_Destroy(struct mempool **mpp);
 void *MPL_Get(struct mempool *mpl, unsigned *size);
 void MPL_Free(struct mempool *mpl, void *item);
+void MPL_FreeDirty(struct mempool *mpl, void *item, size_t dirty);
 
 /* cache_obj.c */
 void ObjInit(void);
@@ -347,6 +359,7 @@ uint64_t ObjWaitExtend(const struct worker *, const struct objcore *,
 void ObjSetState(struct worker *, struct objcore *, enum boc_state_e next,
     unsigned broadcast);
 enum boc_state_e ObjWaitState(const struct objcore *, enum boc_state_e want);
+int ObjParkState(const struct objcore *, struct vai_qe *);
 void ObjTouch(struct worker *, struct objcore *, vtim_real now);
 void ObjFreeObj(struct worker *, struct objcore *);
 void ObjSlim(struct worker *, struct objcore *);
@@ -420,6 +433,7 @@ void pan_pool(struct vsb *);
 
 /* cache_range.c */
 int VRG_CheckBo(struct busyobj *);
+int VRG_Range(struct req *, struct vsl_log *, ssize_t *, ssize_t *);
 
 /* cache_req.c */
 struct req *Req_New(struct sess *, const struct req *);
@@ -427,6 +441,7 @@ void Req_Release(struct req *);
 void Req_Rollback(VRT_CTX);
 void Req_Cleanup(struct sess *sp, struct worker *wrk, struct req *req);
 void Req_Fail(struct req *req, stream_close_t reason);
+int Req_Flush(struct req *);
 void Req_AcctLogCharge(struct VSC_main_wrk *, struct req *);
 void Req_LogHit(struct worker *, struct req *, struct objcore *, intmax_t);
 const char *Req_LogStart(const struct worker *, struct req *);
@@ -434,6 +449,7 @@ const char *Req_LogStart(const struct worker *, struct req *);
 /* cache_req_body.c */
 int VRB_Ignore(struct req *);
 ssize_t VRB_Cache(struct req *, ssize_t maxsize);
+ssize_t VRB_Tee(struct req *, ssize_t maxsize);
 void VRB_Free(struct req *);
 
 /* cache_req_fsm.c [CNT] */
@@ -479,6 +495,11 @@ void VSL_ChgId(struct vsl_log *vsl, const char *typ, const char *why,
 void VSL_End(struct vsl_log *vsl);
 void VSL_Flush(struct vsl_log *, int overflow);
 
+/* cache_slice.c */
+void SLI_Bereq(struct busyobj *);
+int SLI_CheckBo(struct busyobj *);
+void SLI_SetAttr(const struct busyobj *);
+
 /* cache_conn_pool.c */
 struct conn_pool;
 void VCP_Init(void);
@@ -570,11 +591,25 @@ WS_IsReserved(const struct ws *ws)
 
 void *WS_AtOffset(const struct ws *ws, unsigned off, unsigned len);
 unsigned WS_ReservationOffset(const struct ws *ws);
+unsigned WS_Used(const struct ws *ws);
 int WS_Pipeline(struct ws *, const void *b, const void *e, unsigned rollback);
 
 /* cache_ws_common.c */
 void WS_Id(const struct ws *ws, char *id);
 void WS_Rollback(struct ws *, uintptr_t);
+unsigned WS_Peak(const struct ws *);
+
+/* cache_ws_size.c */
+enum ws_kind {
+	WS_K_CLIENT,
+	WS_K_BACKEND,
+	WS_K_SESSION,
+	WS_K__MAX
+};
+
+void WS_SizeInit(void);
+void WS_SizeSample(enum ws_kind, const struct ws *, unsigned overhead);
+const volatile unsigned *WS_SizeAuto(enum ws_kind);
 
 /* http1/cache_http1_pipe.c */
 void V1P_Init(void);
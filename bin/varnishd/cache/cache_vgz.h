@@ -56,3 +56,4 @@ enum vgzret_e VGZ_Gzip(struct vgz *, const void **, ssize_t *len,
 enum vgzret_e VGZ_Destroy(struct worker *wrk, struct vgz **);
 
 void VGZ_UpdateObj(const struct vfp_ctx *, struct vgz*, enum vgzret_e);
+void VGZ_Background(struct worker *, struct objcore *);
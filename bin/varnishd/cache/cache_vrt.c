@@ -1006,8 +1006,8 @@ VRT_ban_string(VRT_CTX, VCL_STRING str)
 	return (vrt_ban_error(ctx, err));
 }
 
-VCL_BYTES
-VRT_CacheReqBody(VRT_CTX, VCL_BYTES maxsize)
+static int
+vrt_reqbody_recv(VRT_CTX)
 {
 	const char * const err = "req.body can only be cached in vcl_recv{}";
 
@@ -1019,12 +1019,30 @@ VRT_CacheReqBody(VRT_CTX, VCL_BYTES maxsize)
 			AN(ctx->msg);
 			VSB_printf(ctx->msg, "%s\n", err);
 		};
-		return (-1);
+		return (0);
 	}
 	CHECK_OBJ_NOTNULL(ctx->req, REQ_MAGIC);
+	return (1);
+}
+
+VCL_BYTES
+VRT_CacheReqBody(VRT_CTX, VCL_BYTES maxsize)
+{
+
+	if (!vrt_reqbody_recv(ctx))
+		return (-1);
 	return (VRB_Cache(ctx->req, maxsize));
 }
 
+VCL_BYTES
+VRT_TeeReqBody(VRT_CTX, VCL_BYTES maxsize)
+{
+
+	if (!vrt_reqbody_recv(ctx))
+		return (-1);
+	return (VRB_Tee(ctx->req, maxsize));
+}
+
 /*--------------------------------------------------------------------
  * purges
  */
@@ -43,6 +43,7 @@
 #include "vct.h"
 
 #include "cache_filter.h"
+#include "cache_objhead.h"
 
 /*--------------------------------------------------------------------
  */
@@ -250,6 +251,16 @@ VCL_StackVDP(struct vdp_ctx *vdc, const struct vcl *vcl, const char *fl,
 	else
 		VCL_Bo2Ctx(ctx, bo);
 
+	/*
+	 * The head of a sliced object only holds the first slice, the rest
+	 * can not be delivered without the slice VDP whatever the list says.
+	 * Pushed again from the list, it finds vdc->oc gone and steps aside.
+	 */
+	if (req != NULL && req->slice == 0 && vdc->oc != NULL &&
+	    ObjHasAttr(req->wrk, vdc->oc, OA_SLICE) &&
+	    VDP_Push(ctx, vdc, ctx->ws, &VDP_slice, NULL))
+		return (-1);
+
 	while (1) {
 		vp = vcl_filter_list_iter(0, &vrt_filters, &vcl->filters, &fl);
 		if (vp == NULL)
@@ -274,7 +285,9 @@ VCL_VRT_Init(void)
 	AZ(vrt_addfilter(NULL, &VFP_esi_gzip, NULL));
 	AZ(vrt_addfilter(NULL, NULL, &VDP_esi));
 	AZ(vrt_addfilter(NULL, NULL, &VDP_gunzip));
+	AZ(vrt_addfilter(NULL, NULL, &VDP_identity));
 	AZ(vrt_addfilter(NULL, NULL, &VDP_range));
+	AZ(vrt_addfilter(NULL, NULL, &VDP_slice));
 }
 
 /*--------------------------------------------------------------------
@@ -358,7 +371,7 @@ vbf_default_filter_list(void *arg, struct vsb *vsb)
 		return;
 	}
 
-	if (do_gzip)
+	if (do_gzip && !VBF_Gzip_Background(bo))
 		VSB_cat(vsb, " gzip");
 
 	if (is_gzip && !do_gunzip)
@@ -388,9 +401,17 @@ static void v_matchproto_(filter_list_t)
 resp_default_filter_list(void *arg, struct vsb *vsb)
 {
 	struct req *req;
+	struct boc *boc;
 
 	CAST_OBJ_NOTNULL(req, arg, REQ_MAGIC);
 
+	if (req->slice == 0 && req->objcore != NULL &&
+	    ObjHasAttr(req->wrk, req->objcore, OA_SLICE)) {
+		/* Only the head of a sliced object, which takes Range */
+		VSB_cat(vsb, " slice");
+		return;
+	}
+
 	if (!req->disable_esi && req->objcore != NULL &&
 	    ObjHasAttr(req->wrk, req->objcore, OA_ESIDATA))
 		VSB_cat(vsb, " esi");
@@ -398,8 +419,17 @@ resp_default_filter_list(void *arg, struct vsb *vsb)
 	if (cache_param->http_gzip_support &&
 	    req->objcore != NULL &&
 	    ObjCheckFlag(req->wrk, req->objcore, OF_GZIPED) &&
-	    !RFC2616_Req_Gzip(req->http))
-		VSB_cat(vsb, " gunzip");
+	    !RFC2616_Req_Gzip(req->http)) {
+		/* The uncompressed copy is complete once the fetch is */
+		boc = HSH_RefBoc(req->objcore);
+		if (boc == NULL &&
+		    ObjHasAttr(req->wrk, req->objcore, OA_IDENTITY))
+			VSB_cat(vsb, " identity");
+		else
+			VSB_cat(vsb, " gunzip");
+		if (boc != NULL)
+			HSH_DerefBoc(req->wrk, req->objcore);
+	}
 
 	if (cache_param->http_range_support &&
 	    http_GetStatus(req->resp) == 200 &&
@@ -254,6 +254,93 @@ pool_getidleworker(struct pool *pp, enum task_prio prio)
 	return (wrk);
 }
 
+/*--------------------------------------------------------------------
+ * Work stealing between pools, see thread_pool_steal.
+ *
+ * The peeks at the other pool before trying its lock are racy, they
+ * only save us the lock when there is obviously nothing to steal.
+ *
+ * Likewise pool_steal_hint is set whenever a fetch is queued, and
+ * cleared by an idle worker which walks the pools and finds none, so
+ * idle workers only take pool_mtx while some pool has a queue.  A lost
+ * update only costs a steal, the pool still runs its own queue.
+ */
+
+struct pool_steal {
+	unsigned		magic;
+#define POOL_STEAL_MAGIC	0x1f6a3c59
+	enum task_prio		prio;
+	struct pool_task	*task;
+};
+
+static int v_matchproto_(pool_sibling_f)
+pool_give_task(struct pool *qp, void *priv)
+{
+	struct pool_steal *ps;
+	struct worker *wrk;
+
+	CHECK_OBJ_NOTNULL(qp, POOL_MAGIC);
+	CAST_OBJ_NOTNULL(ps, priv, POOL_STEAL_MAGIC);
+	if (VTAILQ_EMPTY(&qp->idle_queue) || Lck_Trylock(&qp->mtx))
+		return (0);
+	wrk = pool_getidleworker(qp, ps->prio);
+	if (wrk != NULL) {
+		AZ(wrk->task->func);
+		wrk->task->func = ps->task->func;
+		wrk->task->priv = ps->task->priv;
+		qp->stats->pool_stolen++;
+	}
+	Lck_Unlock(&qp->mtx);
+	if (wrk == NULL)
+		return (0);
+	// see signaling_note at the top for explanation
+	PTOK(pthread_cond_signal(&wrk->cond));
+	return (1);
+}
+
+/*--------------------------------------------------------------------
+ * Account for the time a task spent in the queue, see pool_adapt()
+ */
+
+static void
+pool_dequeued(struct pool *pp, const struct pool_task *tp)
+{
+
+	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
+	AN(tp);
+	Lck_AssertHeld(&pp->mtx);
+	if (tp->queued == 0.)
+		return;
+	pp->qwait += VTIM_mono() - tp->queued;
+	pp->nqwait++;
+}
+
+static int v_matchproto_(pool_sibling_f)
+pool_take_task(struct pool *qp, void *priv)
+{
+	struct pool_task **tpp;
+
+	CHECK_OBJ_NOTNULL(qp, POOL_MAGIC);
+	AN(priv);
+	tpp = priv;
+	if (qp->lqueue_bo == 0)
+		return (0);
+	pool_steal_hint = 1;
+	if (Lck_Trylock(&qp->mtx))
+		return (0);
+	*tpp = VTAILQ_FIRST(&qp->queues[TASK_QUEUE_BO]);
+	if (*tpp != NULL) {
+		AN(qp->lqueue_bo);
+		qp->lqueue_bo--;
+		qp->lqueue--;
+		qp->ndequeued--;
+		VTAILQ_REMOVE(&qp->queues[TASK_QUEUE_BO], *tpp, list);
+		pool_dequeued(qp, *tpp);
+	}
+	Lck_Unlock(&qp->mtx);
+	return (*tpp != NULL);
+}
+
 /*--------------------------------------------------------------------
  * Special scheduling:  If no thread can be found, the current thread
  * will be prepared for rescheduling instead.
@@ -302,6 +389,7 @@ Pool_Task_Arg(struct worker *wrk, enum task_prio prio, task_func_t *func,
 int
 Pool_Task(struct pool *pp, struct pool_task *task, enum task_prio prio)
 {
+	struct pool_steal ps;
 	struct worker *wrk;
 	int retval = 0;
 	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
@@ -325,6 +413,18 @@ Pool_Task(struct pool *pp, struct pool_task *task, enum task_prio prio)
 	/* The common case first:  Take an idle thread, do it. */
 
 	wrk = pool_getidleworker(pp, prio);
+	if (wrk == NULL && TASK_QUEUE_STEALABLE(prio) &&
+	    cache_param->wthread_steal) {
+		/* Try an idle thread of another pool before queueing */
+		Lck_Unlock(&pp->mtx);
+		INIT_OBJ(&ps, POOL_STEAL_MAGIC);
+		ps.prio = prio;
+		ps.task = task;
+		if (pool_siblings(pp, pool_give_task, &ps) > 0)
+			return (0);
+		Lck_Lock(&pp->mtx);
+		wrk = pool_getidleworker(pp, prio);
+	}
 	if (wrk != NULL) {
 		AZ(wrk->task->func);
 		wrk->task->func = task->func;
@@ -345,7 +445,14 @@ Pool_Task(struct pool *pp, struct pool_task *task, enum task_prio prio)
 	    cache_param->wthread_queue_limit) {
 		pp->stats->sess_queued++;
 		pp->lqueue++;
+		task->queued = 0.;
+		if (cache_param->wthread_latency > 0.)
+			task->queued = VTIM_mono();
 		VTAILQ_INSERT_TAIL(&pp->queues[prio], task, list);
+		if (prio == TASK_QUEUE_BO) {
+			pp->lqueue_bo++;
+			pool_steal_hint = 1;
+		}
 		PTOK(pthread_cond_signal(&pp->herder_cond));
 	} else {
 		/* NB: This is counter-intuitive but when we drop a REQ
@@ -385,7 +492,7 @@ Pool_Work_Thread(struct pool *pp, struct worker *wrk)
 	struct pool_task *tp;
 	struct pool_task tpx, tps;
 	vtim_real tmo, now;
-	unsigned i, reserve;
+	unsigned i, reserve, steal;
 
 	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
 	wrk->pool = pp;
@@ -399,14 +506,39 @@ Pool_Work_Thread(struct pool *pp, struct worker *wrk)
 		Lck_Lock(&pp->mtx);
 		reserve = pool_reserve();
 
-		for (i = 0; i < TASK_QUEUE_RESERVE; i++) {
-			if (pp->nidle < (reserve * i / TASK_QUEUE_RESERVE))
+		steal = cache_param->wthread_steal && pool_steal_hint;
+		for (; ; steal = 0) {
+			for (i = 0; i < TASK_QUEUE_RESERVE; i++) {
+				if (pp->nidle <
+				    (reserve * i / TASK_QUEUE_RESERVE))
+					break;
+				tp = VTAILQ_FIRST(&pp->queues[i]);
+				if (tp != NULL) {
+					if (i == TASK_QUEUE_BO) {
+						AN(pp->lqueue_bo);
+						pp->lqueue_bo--;
+					}
+					pp->lqueue--;
+					pp->ndequeued--;
+					VTAILQ_REMOVE(&pp->queues[i], tp, list);
+					pool_dequeued(pp, tp);
+					break;
+				}
+			}
+			if (tp != NULL || !steal)
 				break;
-			tp = VTAILQ_FIRST(&pp->queues[i]);
+			/* Take a queued fetch from another pool, and look
+			 * at our own queues again if there is none, since
+			 * something may have been queued meanwhile. */
+			Lck_Unlock(&pp->mtx);
+			pool_steal_hint = 0;
+			if (pool_siblings(pp, pool_take_task, &tp) < 0)
+				pool_steal_hint = 1;
+			Lck_Lock(&pp->mtx);
+			if (pp->lqueue_bo > 0)
+				pool_steal_hint = 1;
 			if (tp != NULL) {
-				pp->lqueue--;
-				pp->ndequeued--;
-				VTAILQ_REMOVE(&pp->queues[i], tp, list);
+				pp->stats->pool_stolen++;
 				break;
 			}
 		}
@@ -574,6 +706,74 @@ pool_breed(struct pool *qp)
 	PTOK(pthread_attr_destroy(&tp_attr));
 }
 
+/*--------------------------------------------------------------------
+ * Size the pool by queue latency, see thread_pool_latency
+ *
+ * Called by the herder every POOL_ADAPT_TICK.  Queue latency is the
+ * larger of the average wait of the tasks dequeued since the last tick
+ * and the age of the oldest task still queued.  Above the target we
+ * create enough threads for everything queued and some slack, and we
+ * also grow ahead of demand when nearly all threads are busy.
+ *
+ * Returns non-zero if idle threads may be destroyed early, shrinking
+ * tells if they already could after the previous tick.
+ */
+
+#define POOL_ADAPT_TICK		0.1
+
+static int
+pool_adapt(struct pool *pp, int shrinking)
+{
+	struct pool_task *tp;
+	vtim_mono now;
+	vtim_dur lat;
+	unsigned i, busy, grow, lqueue, nqwait;
+	int shrink = 0;
+
+	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
+	now = VTIM_mono();
+
+	Lck_Lock(&pp->mtx);
+	lat = 0.;
+	if (pp->nqwait > 0)
+		lat = pp->qwait / pp->nqwait;
+	for (i = 0; i < TASK_QUEUE_RESERVE; i++) {
+		tp = VTAILQ_FIRST(&pp->queues[i]);
+		if (tp != NULL && tp->queued > 0.)
+			lat = vmax(lat, now - tp->queued);
+	}
+	nqwait = pp->nqwait;
+	pp->qwait = 0.;
+	pp->nqwait = 0;
+	lqueue = pp->lqueue;
+	assert(pp->nthr >= pp->nidle);
+	busy = pp->nthr - pp->nidle;
+	Lck_Unlock(&pp->mtx);
+
+	grow = 0;
+	if (lat > cache_param->wthread_latency)
+		grow = lqueue + pp->nthr / 8 + 1;
+	else if (busy * 10 > pp->nthr * 9)
+		grow = vmax_t(unsigned, pp->nthr / 16, 1);
+	else if (nqwait == 0 && lqueue == 0 && busy * 2 < pp->nthr)
+		shrink = 1;
+
+	if (pp->nthr + grow > cache_param->wthread_max)
+		grow = cache_param->wthread_max - vmin_t(unsigned,
+		    pp->nthr, cache_param->wthread_max);
+	if (grow > pp->ngrow) {
+		VSL(SLT_Debug, NO_VXID,
+		    "Pool %p adapt: latency %.6f busy %u/%u queued %u grow %u",
+		    pp, lat, busy, pp->nthr, lqueue, grow);
+		pp->ngrow = grow;
+	}
+	if (shrink && !shrinking)
+		VSL(SLT_Debug, NO_VXID,
+		    "Pool %p adapt: latency %.6f busy %u/%u queued %u shrink",
+		    pp, lat, busy, pp->nthr, lqueue);
+	return (shrink);
+}
+
 /*--------------------------------------------------------------------
  * Herd a single pool
  *
@@ -601,7 +801,8 @@ pool_herder(void *priv)
 	unsigned wthread_min;
 	uintmax_t dq = (1ULL << 31);
 	vtim_mono dqt = 0;
-	int r = 0;
+	vtim_mono t_adapt = 0;
+	int r = 0, shrink = 0, early;
 
 	CAST_OBJ_NOTNULL(pp, priv, POOL_MAGIC);
 
@@ -609,6 +810,7 @@ pool_herder(void *priv)
 	THR_Init();
 
 	while (!pp->die || pp->nthr > 0) {
+		wrk = NULL;
 		/*
 		 * If the worker pool is configured too small, we can
 		 * end up deadlocking it (see #2418 for details).
@@ -640,12 +842,28 @@ pool_herder(void *priv)
 		if (pp->die)
 			wthread_min = 0;
 
+		if (pp->die || cache_param->wthread_latency == 0.) {
+			pp->ngrow = 0;
+			shrink = 0;
+		} else if (VTIM_mono() >= t_adapt) {
+			shrink = pool_adapt(pp, shrink);
+			t_adapt = VTIM_mono() + POOL_ADAPT_TICK;
+		}
+
 		/* Make more threads if needed and allowed */
 		if (pp->nthr < wthread_min ||
-		    (pp->lqueue > 0 && pp->nthr < cache_param->wthread_max)) {
+		    ((pp->lqueue > 0 || pp->ngrow > 0) &&
+		    pp->nthr < cache_param->wthread_max)) {
+			if (pp->ngrow > 0) {
+				pp->ngrow--;
+				Lck_Lock(&pool_mtx);
+				VSC_C_main->threads_adapt_grow++;
+				Lck_Unlock(&pool_mtx);
+			}
 			pool_breed(pp);
 			continue;
 		}
+		pp->ngrow = 0;
 
 		delay = cache_param->wthread_timeout;
 		assert(pp->nthr >= wthread_min);
@@ -653,9 +871,12 @@ pool_herder(void *priv)
 		if (pp->nthr > wthread_min) {
 
 			t_idle = VTIM_real() - cache_param->wthread_timeout;
+			if (shrink)
+				t_idle = vmax(t_idle, VTIM_real() - 1.0);
 
 			Lck_Lock(&pp->mtx);
 			wrk = NULL;
+			early = 0;
 			pt = VTAILQ_LAST(&pp->idle_queue, taskhead);
 			if (pt != NULL) {
 				AN(pp->nidle);
@@ -665,6 +886,10 @@ pool_herder(void *priv)
 				if (pp->die || wrk->lastused < t_idle ||
 				    pp->nthr > cache_param->wthread_max) {
 					/* Give it a kiss on the cheek... */
+					early = !pp->die && shrink &&
+					    pp->nthr <= cache_param->wthread_max &&
+					    wrk->lastused >= VTIM_real() -
+					    cache_param->wthread_timeout;
 					VTAILQ_REMOVE(&pp->idle_queue,
 					    wrk->task, list);
 					pp->nidle--;
@@ -682,7 +907,13 @@ pool_herder(void *priv)
 				Lck_Lock(&pool_mtx);
 				VSC_C_main->threads--;
 				VSC_C_main->threads_destroyed++;
+				if (early)
+					VSC_C_main->threads_adapt_shrink++;
 				Lck_Unlock(&pool_mtx);
+				if (early)
+					VSL(SLT_Debug, NO_VXID,
+					    "Pool %p adapt: destroyed idle "
+					    "thread, %u left", pp, pp->nthr);
 				delay = cache_param->wthread_destroy_delay;
 			} else
 				delay = vmax(delay,
@@ -701,6 +932,9 @@ pool_herder(void *priv)
 		if (pp->lqueue == 0) {
 			if (DO_DEBUG(DBG_VTC_MODE))
 				delay = 0.5;
+			/* Keep destroy_delay between two kills */
+			if (cache_param->wthread_latency > 0. && wrk == NULL)
+				delay = vmin(delay, POOL_ADAPT_TICK);
 			r = Lck_CondWaitTimeout(
 			    &pp->herder_cond, &pp->mtx, delay);
 		} else if (pp->nthr >= cache_param->wthread_max) {
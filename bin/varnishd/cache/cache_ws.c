@@ -126,6 +126,7 @@ WS_Reset(struct ws *ws, uintptr_t pp)
 	assert(ws->r == NULL);
 	assert(p >= ws->s);
 	assert(p <= ws->e);
+	ws->peak = vmax_t(unsigned, ws->peak, pdiff(ws->s, ws->f));
 	ws->f = p;
 	WS_Assert(ws);
 }
@@ -312,6 +313,14 @@ WS_ReservationOffset(const struct ws *ws)
 	return (ws->f - ws->s);
 }
 
+unsigned
+WS_Used(const struct ws *ws)
+{
+
+	WS_Assert(ws);
+	return (pdiff(ws->s, ws->f));
+}
+
 /*--------------------------------------------------------------------*/
 
 unsigned
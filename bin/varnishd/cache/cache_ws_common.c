@@ -77,6 +77,9 @@ WS_Overflowed(const struct ws *ws)
 /*
  * Reset the WS to a cookie or its start and clears any overflow
  *
+ * Rolling back to the start also forgets the peak, the workspace is
+ * about to be reused or freed.
+ *
  * for varnishd internal use only
  */
 
@@ -86,10 +89,30 @@ WS_Rollback(struct ws *ws, uintptr_t pp)
 
 	WS_Assert(ws);
 
-	if (pp == 0)
-		pp = (uintptr_t)ws->s;
+	if (WS_Overflowed(ws))
+		ws->peak = UINT_MAX;
 	ws_ClearOverflow(ws);
-	WS_Reset(ws, pp);
+	if (pp == 0) {
+		WS_Reset(ws, (uintptr_t)ws->s);
+		ws->peak = 0;
+	} else
+		WS_Reset(ws, pp);
+}
+
+/*
+ * The most the workspace has held since it was last rolled back to its
+ * start, including what rollbacks to a snapshot released since.
+ * UINT_MAX if it overflowed in the meantime.
+ */
+
+unsigned
+WS_Peak(const struct ws *ws)
+{
+
+	WS_Assert(ws);
+	if (WS_Overflowed(ws))
+		return (UINT_MAX);
+	return (vmax_t(unsigned, ws->peak, WS_Used(ws)));
 }
 
 /*--------------------------------------------------------------------*/
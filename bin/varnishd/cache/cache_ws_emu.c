@@ -210,6 +210,7 @@ WS_Reset(struct ws *ws, uintptr_t pp)
 	p = (char *)pp;
 	DSLb(DBG_WORKSPACE, "WS_Reset(%p, %p)", ws, p);
 	AZ(ws->r);
+	ws->peak = vmax_t(unsigned, ws->peak, WS_Used(ws));
 
 	we = ws_emu(ws);
 	while ((wa = VTAILQ_LAST(&we->head, ws_alloc_head)) != NULL &&
@@ -489,6 +490,20 @@ WS_ReservationOffset(const struct ws *ws)
 	return (wa->off);
 }
 
+unsigned
+WS_Used(const struct ws *ws)
+{
+	struct ws_emu *we;
+	struct ws_alloc *wa;
+
+	WS_Assert(ws);
+	we = ws_emu(ws);
+	wa = VTAILQ_LAST(&we->head, ws_alloc_head);
+	if (wa == NULL)
+		return (0);
+	return (wa->off + PRNDUP(wa->len));
+}
+
 unsigned
 WS_Dump(const struct ws *ws, char where, size_t off, void *buf, size_t len)
 {
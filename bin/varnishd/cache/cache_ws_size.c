@@ -0,0 +1,211 @@
+/*-
+ * Copyright (c) 2026 Varnish Software AS
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Workspace high-water statistics and automatic sizing
+ *
+ * The client, backend and session workspaces are sampled when the
+ * request, fetch or session they belong to is done with them, which is
+ * where their overflow is counted too.  The high-water mark is the peak
+ * WS_Reset() and WS_Rollback() kept track of, so restarts, retries and
+ * scratch space released before the end are accounted for, and is taken
+ * from the allocation the workspace is carved from, so it compares
+ * directly to the workspace_* parameters.
+ *
+ * With workspace_sizing set, the mempools allocate the given percentile
+ * of the recent high-water marks plus some headroom, but never more
+ * than the parameter.  An overflow while below the parameter goes back
+ * to the parameter and holds off shrinking for a while.
+ */
+
+#include "config.h"
+
+#include "cache_varnishd.h"
+
+#include "VSC_ws.h"
+
+#define WSZ_GRAIN	256		/* histogram resolution */
+#define WSZ_NBUCKET	1024		/* up to 256k */
+#define WSZ_SAMPLE	16		/* sample one in this many */
+#define WSZ_UPDATE	256		/* samples between size updates */
+#define WSZ_DECAY	65536		/* samples before halving history */
+
+struct wsz {
+	unsigned		magic;
+#define WSZ_MAGIC		0x7c2a61d3
+	volatile unsigned	*param;
+	unsigned		tick;
+
+	struct lock		mtx;
+	unsigned		nsample;
+	unsigned		nupdate;
+	unsigned		hold;
+	unsigned		hist[WSZ_NBUCKET + 1];
+	volatile unsigned	size;
+
+	struct vsc_seg		*vsc_seg;
+	struct VSC_ws		*vsc;
+};
+
+static struct wsz wsz[WS_K__MAX];
+
+/*--------------------------------------------------------------------*/
+
+static void
+wsz_update(struct wsz *wz)
+{
+	uint64_t want, sum;
+	unsigned u, sz;
+
+	Lck_AssertHeld(&wz->mtx);
+	wz->nupdate = 0;
+
+	if (wz->nsample >= WSZ_DECAY) {
+		wz->nsample = 0;
+		for (u = 0; u <= WSZ_NBUCKET; u++) {
+			wz->hist[u] /= 2;
+			wz->nsample += wz->hist[u];
+		}
+	}
+
+	sz = 0;
+	if (cache_param->workspace_sizing > 0. && wz->hold == 0 &&
+	    wz->nsample > 0) {
+		want = (uint64_t)(wz->nsample *
+		    cache_param->workspace_sizing / 100.);
+		want = vmax_t(uint64_t, want, 1);
+		sum = 0;
+		for (u = 0; u < WSZ_NBUCKET; u++) {
+			sum += wz->hist[u];
+			if (sum >= want)
+				break;
+		}
+		if (u < WSZ_NBUCKET) {
+			sz = (u + 1) * WSZ_GRAIN;
+			sz += sz / 8;
+			sz = RUP2(sz, WSZ_GRAIN);
+		}
+		if (sz >= *wz->param)
+			sz = 0;
+	}
+	if (wz->hold > 0)
+		wz->hold--;
+	wz->size = sz;
+	wz->vsc->size = sz > 0 ? sz : *wz->param;
+}
+
+void
+WS_SizeSample(enum ws_kind kind, const struct ws *ws, unsigned overhead)
+{
+	struct wsz *wz;
+	unsigned used, ovf;
+
+	assert(kind < WS_K__MAX);
+	wz = &wsz[kind];
+	CHECK_OBJ_NOTNULL(wz, WSZ_MAGIC);
+
+	used = WS_Peak(ws);
+	ovf = used == UINT_MAX;
+	/* Unlocked and racy, this only spreads the samples */
+	if (!ovf && ++wz->tick % WSZ_SAMPLE)
+		return;
+	used += overhead;
+
+	Lck_Lock(&wz->mtx);
+	wz->vsc->samples++;
+	wz->nsample++;
+	if (ovf) {
+		wz->vsc->overflow++;
+		wz->hist[WSZ_NBUCKET]++;
+		if (wz->size > 0) {
+			/* Too small, go back to the parameter for a while */
+			wz->size = 0;
+			wz->vsc->size = *wz->param;
+			wz->hold = WSZ_DECAY / WSZ_UPDATE;
+		}
+	} else {
+		wz->hist[vmin_t(unsigned, used / WSZ_GRAIN, WSZ_NBUCKET - 1)]++;
+		if (used <= 1024)
+			wz->vsc->hw_1k++;
+		else if (used <= 2048)
+			wz->vsc->hw_2k++;
+		else if (used <= 4096)
+			wz->vsc->hw_4k++;
+		else if (used <= 8192)
+			wz->vsc->hw_8k++;
+		else if (used <= 16384)
+			wz->vsc->hw_16k++;
+		else if (used <= 32768)
+			wz->vsc->hw_32k++;
+		else if (used <= 65536)
+			wz->vsc->hw_64k++;
+		else if (used <= 131072)
+			wz->vsc->hw_128k++;
+		else
+			wz->vsc->hw_more++;
+	}
+	if (++wz->nupdate >= WSZ_UPDATE)
+		wsz_update(wz);
+	Lck_Unlock(&wz->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * The automatic size for MPL_New(), zero when there is none.
+ */
+
+const volatile unsigned *
+WS_SizeAuto(enum ws_kind kind)
+{
+
+	assert(kind < WS_K__MAX);
+	CHECK_OBJ(&wsz[kind], WSZ_MAGIC);
+	return (&wsz[kind].size);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void
+wsz_init(enum ws_kind kind, const char *name, volatile unsigned *param)
+{
+	struct wsz *wz;
+
+	wz = &wsz[kind];
+	INIT_OBJ(wz, WSZ_MAGIC);
+	wz->param = param;
+	Lck_New(&wz->mtx, lck_wssize);
+	wz->vsc = VSC_ws_New(NULL, &wz->vsc_seg, "%s", name);
+	AN(wz->vsc);
+	wz->vsc->size = *param;
+}
+
+void
+WS_SizeInit(void)
+{
+
+	wsz_init(WS_K_CLIENT, "client", &cache_param->workspace_client);
+	wsz_init(WS_K_BACKEND, "backend", &cache_param->workspace_backend);
+	wsz_init(WS_K_SESSION, "session", &cache_param->workspace_session);
+}
@@ -0,0 +1,428 @@
+/*-
+ * Copyright (c) 2026 Varnish Software AS
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * A sharded open addressing hash
+ *
+ * The digest selects one of a power-of-two number of shards, each
+ * with its own lock and its own linear probing table.  The table is
+ * made of cache-line sized buckets, and every slot keeps the first
+ * eight bytes of the digest next to the objhead pointer, so a probe
+ * only has to touch the objhead once the prefix matches.
+ *
+ * When a shard fills up, a new table is allocated and the old one is
+ * migrated a few buckets at a time by the following operations on
+ * that shard.  Until the migration is complete both tables are
+ * searched.  Deleted slots are marked with a tombstone, and a shard
+ * with too many tombstones is migrated to a fresh table of the same
+ * size.
+ */
+
+#include "config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache/cache_varnishd.h"
+#include "cache/cache_objhead.h"
+#include "common/heritage.h"
+
+#include "hash/hash_slinger.h"
+
+static struct VSC_lck *lck_hop;
+
+/*--------------------------------------------------------------------*/
+
+#define HOP_CACHELINE		64
+#define HOP_SLOTS		4	/* per bucket */
+#define HOP_MIGRATE		8	/* buckets per operation */
+#define HOP_MINBUCKET		4
+
+struct hop_slot {
+	uint64_t		prefix;
+	struct objhead		*oh;
+};
+
+struct hop_bucket {
+	struct hop_slot		slot[HOP_SLOTS];
+};
+
+struct hop_table {
+	struct hop_bucket	*bucket;
+	uint64_t		mask;
+	unsigned		nbucket;
+};
+
+struct hop_shard {
+	unsigned		magic;
+#define HOP_SHARD_MAGIC		0x5e4a1c37
+	struct lock		mtx;
+	struct hop_table	cur;
+	struct hop_table	old;
+	unsigned		migrate;
+	unsigned		used;
+	unsigned		dead;
+};
+
+static unsigned			hop_nshard = 64;
+static unsigned			hop_shardbits = 6;
+static unsigned			hop_nbucket = HOP_MINBUCKET;
+static struct hop_shard		*hop_shard;
+
+/* Deleted slots point here so probing continues past them */
+static struct objhead		hop_tomb[1];
+
+/*--------------------------------------------------------------------
+ * The ->init method allows the management process to pass arguments
+ */
+
+static void v_matchproto_(hash_init_f)
+hop_init(int ac, char * const *av)
+{
+	unsigned u, n;
+	uint64_t want;
+
+	if (ac == 0)
+		return;
+	if (ac > 2)
+		ARGV_ERR("(-hopen) too many arguments\n");
+	if (sscanf(av[0], "%u", &u) != 1 || u == 0 || u > 65536)
+		ARGV_ERR("(-hopen) shards must be 1...65536\n");
+	for (hop_shardbits = 0; (1U << hop_shardbits) < u; hop_shardbits++)
+		continue;
+	hop_nshard = 1U << hop_shardbits;
+	if (hop_nshard != u)
+		fprintf(stderr,
+		    "NOTE: Open hash: rounding shards up to %u\n", hop_nshard);
+	if (ac < 2)
+		return;
+	if (sscanf(av[1], "%u", &u) != 1)
+		ARGV_ERR("(-hopen) size must be a number of objects\n");
+	/* Aim for tables half full after 'u' objects */
+	want = (uint64_t)u * 2 / (hop_nshard * HOP_SLOTS);
+	for (n = HOP_MINBUCKET; n < want && n < (1U << 30); n <<= 1)
+		continue;
+	hop_nbucket = n;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void
+hop_table_new(struct hop_table *t, unsigned nbucket)
+{
+	void *p;
+
+	assert(nbucket >= HOP_MINBUCKET);
+	AZ(nbucket & (nbucket - 1));
+	AZ(posix_memalign(&p, HOP_CACHELINE,
+	    (size_t)nbucket * sizeof *t->bucket));
+	memset(p, 0, (size_t)nbucket * sizeof *t->bucket);
+	t->bucket = p;
+	t->nbucket = nbucket;
+	t->mask = nbucket - 1;
+}
+
+static void
+hop_table_free(struct hop_table *t)
+{
+
+	free(t->bucket);
+	memset(t, 0, sizeof *t);
+}
+
+static inline uint64_t
+hop_prefix(const void *digest)
+{
+	uint64_t u;
+
+	memcpy(&u, digest, sizeof u);
+	return (u);
+}
+
+static inline struct hop_shard *
+hop_getshard(uint64_t prefix)
+{
+
+	return (&hop_shard[prefix & (hop_nshard - 1)]);
+}
+
+static inline uint64_t
+hop_home(const struct hop_table *t, uint64_t prefix)
+{
+
+	return ((prefix >> hop_shardbits) & t->mask);
+}
+
+/*--------------------------------------------------------------------
+ * Find the slot holding digest, NULL if absent.
+ */
+
+static struct hop_slot *
+hop_find(const struct hop_table *t, uint64_t prefix, const void *digest)
+{
+	struct hop_slot *s;
+	uint64_t b;
+	unsigned n, i;
+
+	if (t->nbucket == 0)
+		return (NULL);
+	b = hop_home(t, prefix);
+	for (n = 0; n < t->nbucket; n++, b = (b + 1) & t->mask) {
+		for (i = 0; i < HOP_SLOTS; i++) {
+			s = &t->bucket[b].slot[i];
+			if (s->oh == NULL)
+				return (NULL);
+			if (s->prefix != prefix || s->oh == hop_tomb)
+				continue;
+			CHECK_OBJ_NOTNULL(s->oh, OBJHEAD_MAGIC);
+			if (!memcmp(s->oh->digest, digest,
+			    sizeof s->oh->digest))
+				return (s);
+		}
+	}
+	return (NULL);
+}
+
+/*--------------------------------------------------------------------
+ * Find a free slot for prefix, reusing the first tombstone on the way.
+ * Returns 1 if a tombstone was reused.
+ */
+
+static int
+hop_place(const struct hop_table *t, uint64_t prefix, struct objhead *oh)
+{
+	struct hop_slot *s;
+	uint64_t b;
+	unsigned n, i;
+	int r;
+
+	b = hop_home(t, prefix);
+	for (n = 0; n < t->nbucket; n++, b = (b + 1) & t->mask) {
+		for (i = 0; i < HOP_SLOTS; i++) {
+			s = &t->bucket[b].slot[i];
+			if (s->oh != NULL && s->oh != hop_tomb)
+				continue;
+			r = (s->oh == hop_tomb);
+			s->prefix = prefix;
+			s->oh = oh;
+			return (r);
+		}
+	}
+	WRONG("Open hash table full");
+}
+
+/*--------------------------------------------------------------------
+ * Move up to 'n' buckets from the old table to the current one.
+ * Migrated slots are tombstoned, so probes in the old table which
+ * started before them still find what is left behind.
+ */
+
+static void
+hop_migrate(struct hop_shard *sh, unsigned n)
+{
+	struct hop_slot *s;
+	unsigned i;
+
+	Lck_AssertHeld(&sh->mtx);
+	while (sh->old.nbucket > 0 && n-- > 0) {
+		for (i = 0; i < HOP_SLOTS; i++) {
+			s = &sh->old.bucket[sh->migrate].slot[i];
+			if (s->oh == NULL || s->oh == hop_tomb)
+				continue;
+			if (hop_place(&sh->cur, s->prefix, s->oh))
+				sh->dead--;
+			s->oh = hop_tomb;
+		}
+		if (++sh->migrate == sh->old.nbucket) {
+			hop_table_free(&sh->old);
+			sh->migrate = 0;
+		}
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Make room for one more entry in the current table.  Tables are
+ * kept at most three quarters full, counting tombstones.  A table
+ * which is more than half full of live entries is doubled, otherwise
+ * it is rebuilt at the same size to get rid of the tombstones.
+ */
+
+static void
+hop_grow(struct hop_shard *sh)
+{
+	unsigned cap, n;
+
+	Lck_AssertHeld(&sh->mtx);
+	cap = sh->cur.nbucket * HOP_SLOTS;
+	if ((sh->used + sh->dead + 1) * 4 <= cap * 3)
+		return;
+
+	/* Finish any migration still in progress */
+	hop_migrate(sh, UINT_MAX);
+	AZ(sh->old.nbucket);
+
+	n = sh->cur.nbucket;
+	if (sh->used * 2 >= cap)
+		n <<= 1;
+	sh->old = sh->cur;
+	sh->migrate = 0;
+	hop_table_new(&sh->cur, n);
+	sh->dead = 0;
+	VSC_C_main->hop_resize++;
+}
+
+/*--------------------------------------------------------------------
+ * The ->start method is called during cache process start and allows
+ * initialization to happen before the first lookup.
+ */
+
+static void v_matchproto_(hash_start_f)
+hop_start(void)
+{
+	struct hop_shard *sh;
+	unsigned u;
+
+	lck_hop = Lck_CreateClass(NULL, "hop");
+	AZ(posix_memalign((void **)&hop_shard, HOP_CACHELINE,
+	    (size_t)hop_nshard * sizeof *hop_shard));
+	memset(hop_shard, 0, (size_t)hop_nshard * sizeof *hop_shard);
+
+	for (u = 0; u < hop_nshard; u++) {
+		sh = &hop_shard[u];
+		sh->magic = HOP_SHARD_MAGIC;
+		Lck_New(&sh->mtx, lck_hop);
+		hop_table_new(&sh->cur, hop_nbucket);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Lookup and possibly insert element.
+ * If nobj != NULL and the lookup does not find key, nobj is inserted.
+ * If nobj == NULL and the lookup does not find key, NULL is returned.
+ * A reference to the returned object is held.
+ */
+
+static struct objhead * v_matchproto_(hash_lookup_f)
+hop_lookup(struct worker *wrk, const void *digest, struct objhead **noh)
+{
+	struct hop_shard *sh;
+	struct hop_slot *s;
+	struct objhead *oh;
+	uint64_t prefix;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	AN(digest);
+	if (noh != NULL)
+		CHECK_OBJ_NOTNULL(*noh, OBJHEAD_MAGIC);
+
+	prefix = hop_prefix(digest);
+	sh = hop_getshard(prefix);
+	CHECK_OBJ(sh, HOP_SHARD_MAGIC);
+
+	Lck_Lock(&sh->mtx);
+	hop_migrate(sh, HOP_MIGRATE);
+
+	s = hop_find(&sh->cur, prefix, digest);
+	if (s == NULL)
+		s = hop_find(&sh->old, prefix, digest);
+	if (s != NULL) {
+		oh = s->oh;
+		oh->refcnt++;
+		Lck_Unlock(&sh->mtx);
+		Lck_Lock(&oh->mtx);
+		return (oh);
+	}
+
+	if (noh == NULL) {
+		Lck_Unlock(&sh->mtx);
+		return (NULL);
+	}
+
+	TAKE_OBJ_NOTNULL(oh, noh, OBJHEAD_MAGIC);
+	memcpy(oh->digest, digest, sizeof oh->digest);
+	oh->hoh_head = sh;
+
+	hop_grow(sh);
+	if (hop_place(&sh->cur, prefix, oh))
+		sh->dead--;
+	sh->used++;
+
+	Lck_Unlock(&sh->mtx);
+	Lck_Lock(&oh->mtx);
+	return (oh);
+}
+
+/*--------------------------------------------------------------------
+ * Dereference and if no references are left, free.
+ */
+
+static int v_matchproto_(hash_deref_f)
+hop_deref(struct worker *wrk, struct objhead *oh)
+{
+	struct hop_shard *sh;
+	struct hop_slot *s;
+	int ret;
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+	Lck_Unlock(&oh->mtx);
+
+	CAST_OBJ_NOTNULL(sh, oh->hoh_head, HOP_SHARD_MAGIC);
+	assert(oh->refcnt > 0);
+	Lck_Lock(&sh->mtx);
+	if (--oh->refcnt == 0) {
+		s = hop_find(&sh->cur, hop_prefix(oh->digest), oh->digest);
+		if (s != NULL) {
+			sh->dead++;
+		} else {
+			/* Tombstones in the old table are not counted */
+			s = hop_find(&sh->old, hop_prefix(oh->digest),
+			    oh->digest);
+		}
+		AN(s);
+		assert(s->oh == oh);
+		s->oh = hop_tomb;
+		sh->used--;
+		ret = 0;
+	} else
+		ret = 1;
+	Lck_Unlock(&sh->mtx);
+	if (!ret)
+		HSH_DeleteObjHead(wrk, oh);
+	return (ret);
+}
+
+/*--------------------------------------------------------------------*/
+
+const struct hash_slinger hop_slinger = {
+	.magic	=	SLINGER_MAGIC,
+	.name	=	"open",
+	.init	=	hop_init,
+	.start	=	hop_start,
+	.lookup =	hop_lookup,
+	.deref	=	hop_deref,
+};
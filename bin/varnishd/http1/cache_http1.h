@@ -35,11 +35,13 @@ struct VSC_vbe;
 int V1F_SendReq(struct worker *, struct busyobj *, uint64_t *ctr_hdrbytes,
     uint64_t *ctr_bodybytes);
 int V1F_FetchRespHdr(struct busyobj *);
-int V1F_Setup_Fetch(struct vfp_ctx *vfc, struct http_conn *htc);
+int V1F_Setup_Fetch(struct vfp_ctx *vfc, struct http_conn *htc,
+    unsigned greedy);
 
 /* cache_http1_fsm.c [HTTP1] */
 extern const int HTTP1_Req[3];
 extern const int HTTP1_Resp[3];
+stream_close_t HTTP1_BatchFlush(struct req *);
 
 /* cache_http1_deliver.c */
 enum vtr_deliver_e V1D_Deliver(struct req *, int sendbody);
@@ -50,6 +52,7 @@ struct v1p_acct {
 	uint64_t        bereq;
 	uint64_t        in;
 	uint64_t        out;
+	uint64_t        spliced;
 };
 
 int V1P_Enter(void);
@@ -64,6 +67,10 @@ void V1L_EndChunk(struct v1l *v1l);
 struct v1l * V1L_Open(struct ws *, int *fd, struct vsl_log *,
     vtim_real deadline, unsigned niov);
 void V1L_NoRollback(struct v1l *v1l);
+void V1L_Batch(struct v1l *v1l, struct v1l_batch **);
+int V1L_Hold(struct v1l *v1l, unsigned space, size_t len);
+stream_close_t V1L_BatchFlush(struct v1l_batch **, int fd, struct vsl_log *,
+    vtim_real deadline);
 stream_close_t V1L_Flush(struct v1l *v1l);
 stream_close_t V1L_Close(struct v1l **v1lp, uint64_t *cnt);
 size_t V1L_Write(struct v1l *v1l, const void *ptr, ssize_t len);
@@ -52,6 +52,7 @@ v1d_error(struct req *req, struct v1l **v1lp, const char *msg)
 	AN(v1lp);
 	if (*v1lp != NULL)
 		(void) V1L_Close(v1lp, &bytes);
+	(void)HTTP1_BatchFlush(req);
 
 	VSLbs(req->vsl, SLT_Error, TOSTRAND(msg));
 	VSLb(req->vsl, SLT_RespProtocol, "HTTP/1.1");
@@ -103,6 +104,10 @@ V1D_Deliver(struct req *req, int sendbody)
 		return (VTR_D_DONE);
 	}
 
+	if (req->htc->v1l_batch != NULL ||
+	    (cache_param->http1_batch > 0 && req->htc->pipeline_b != NULL))
+		V1L_Batch(v1l, &req->htc->v1l_batch);
+
 	if (sendbody) {
 		if (!http_GetHdr(req->resp, H_Content_Length, NULL)) {
 			if (req->http->protover == 11) {
@@ -138,6 +143,17 @@ V1D_Deliver(struct req *req, int sendbody)
 
 	req->acct.resp_hdrbytes += HTTP1_Write(v1l, req->resp, HTTP1_Resp);
 
+	/*
+	 * Hold a complete response back if the next request is already
+	 * here, HTTP1_Session() sends it before waiting for more.
+	 */
+	if (cache_param->http1_batch > 0 && req->htc->pipeline_b != NULL &&
+	    req->doclose == SC_NULL && req->boc == NULL && !chunked &&
+	    (!sendbody || req->resp_len >= 0) && !DO_DEBUG(DBG_FLUSH_HEAD) &&
+	    V1L_Hold(v1l, cache_param->http1_batch,
+	    sendbody ? (size_t)req->resp_len : 0))
+		req->wrk->stats->http1_batched++;
+
 	if (sendbody) {
 		if (DO_DEBUG(DBG_FLUSH_HEAD))
 			(void)V1L_Flush(v1l);
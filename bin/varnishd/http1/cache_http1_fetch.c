@@ -87,7 +87,13 @@ V1F_SendReq(struct worker *wrk, struct busyobj *bo, uint64_t *ctr_hdrbytes,
 
 	if (bo->bereq_body != NULL)
 		cl = ObjGetLen(wrk, bo->bereq_body);
-	else if (bo->req != NULL && !bo->req->req_body_status->length_known)
+	else if (bo->req != NULL && bo->req->req_body_status == BS_CACHED) {
+		/* Cached by VRB_Tee() while sent on a connection which failed */
+		cl = ObjGetLen(wrk, bo->req->body_oc);
+		http_Unset(hp, H_Transfer_Encoding);
+		http_Unset(hp, H_Content_Length);
+		http_PrintfHeader(hp, "Content-Length: %jd", cl);
+	} else if (bo->req != NULL && !bo->req->req_body_status->length_known)
 		cl = -1;
 	else if (bo->req != NULL) {
 		cl = http_GetContentLength(bo->req->http);
@@ -325,7 +331,7 @@ V1F_FetchRespHdr(struct busyobj *bo)
 	assert(bo->vfc->resp == bo->beresp);
 	if (bo->htc->body_status != BS_NONE &&
 	    bo->htc->body_status != BS_ERROR)
-		if (V1F_Setup_Fetch(bo->vfc, bo->htc)) {
+		if (V1F_Setup_Fetch(bo->vfc, bo->htc, 1)) {
 			VSLb(bo->vsl, SLT_FetchError, "overflow");
 			htc->doclose = SC_RX_OVERFLOW;
 			return (-1);
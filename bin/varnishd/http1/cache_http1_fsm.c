@@ -44,6 +44,7 @@
 #include "cache_http1.h"
 
 #include "vtcp.h"
+#include "vtim.h"
 
 static const char H1NEWREQ[] = "HTTP1::NewReq";
 static const char H1PROC[] = "HTTP1::Proc";
@@ -150,12 +151,31 @@ http1_unwait(struct worker *wrk, void *arg)
 	wrk->task->priv = req;
 }
 
+/*----------------------------------------------------------------------
+ * Send the responses V1D_Deliver() held back (http1_batch).  This must
+ * happen before anything else is written to the client, and before we
+ * wait for it.
+ */
+
+stream_close_t
+HTTP1_BatchFlush(struct req *req)
+{
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CHECK_OBJ_NOTNULL(req->sp, SESS_MAGIC);
+	if (req->htc->v1l_batch == NULL)
+		return (SC_NULL);
+	return (V1L_BatchFlush(&req->htc->v1l_batch, req->sp->fd,
+	    IS_NO_VXID(req->vsl->wid) ? NULL : req->vsl,
+	    VTIM_real() + SESS_TMO(req->sp, send_timeout)));
+}
+
 static void v_matchproto_(vtr_req_body_t)
 http1_req_body(struct req *req)
 {
 
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
-	if (V1F_Setup_Fetch(req->vfc, req->htc) != 0)
+	if (V1F_Setup_Fetch(req->vfc, req->htc, 0) != 0)
 		req->req_body_status = BS_ERROR;
 }
 
@@ -178,10 +198,21 @@ http1_req_fail(struct req *req, stream_close_t reason)
 {
 	assert(reason != SC_NULL);
 	assert(req->sp->fd != 0);
+	(void)HTTP1_BatchFlush(req);
 	if (req->sp->fd > 0)
 		SES_Close(req->sp, reason);
 }
 
+static void v_matchproto_(vtr_req_flush_f)
+http1_req_flush(struct req *req)
+{
+	stream_close_t sc;
+
+	sc = HTTP1_BatchFlush(req);
+	if (sc != SC_NULL && req->doclose == SC_NULL)
+		req->doclose = sc;
+}
+
 static int v_matchproto_(vtr_minimal_response_f)
 http1_minimal_response(struct req *req, uint16_t status)
 {
@@ -203,6 +234,11 @@ http1_minimal_response(struct req *req, uint16_t status)
 
 	if (status >= 400)
 		req->err_code = status;
+	if (HTTP1_BatchFlush(req) != SC_NULL) {
+		if (req->doclose == SC_NULL)
+			req->doclose = SC_REM_CLOSE;
+		return (-1);
+	}
 	wl = write(req->sp->fd, buf, l);
 
 	if (wl > 0)
@@ -226,6 +262,7 @@ struct transport HTTP1_transport = {
 	.new_session =		http1_new_session,
 	.req_body =		http1_req_body,
 	.req_fail =		http1_req_fail,
+	.req_flush =		http1_req_flush,
 	.req_panic =		http1_req_panic,
 	.sess_panic =		http1_sess_panic,
 	.unwait =		http1_unwait,
@@ -291,6 +328,7 @@ static void
 HTTP1_Session(struct worker *wrk, struct req *req)
 {
 	enum htc_status_e hs;
+	stream_close_t sc;
 	struct sess *sp;
 	const char *st;
 	int i;
@@ -319,6 +357,16 @@ HTTP1_Session(struct worker *wrk, struct req *req)
 			AZ(req->esi_level);
 			AN(WS_Reservation(req->htc->ws));
 
+			if (req->htc->v1l_batch != NULL &&
+			    HTTP1_Complete(req->htc) != HTC_S_COMPLETE) {
+				sc = HTTP1_BatchFlush(req);
+				if (sc != SC_NULL) {
+					SES_Close(sp, sc);
+					http1_setstate(sp, H1CLEANUP);
+					continue;
+				}
+			}
+
 			hs = HTC_RxStuff(req->htc, HTTP1_Complete,
 			    &req->t_first, &req->t_req,
 			    sp->t_idle + SESS_TMO(sp, timeout_linger),
@@ -334,12 +382,14 @@ HTTP1_Session(struct worker *wrk, struct req *req)
 				req->acct.req_hdrbytes +=
 				    req->htc->rxbuf_e - req->htc->rxbuf_b;
 				Req_AcctLogCharge(wrk->stats, req);
+				(void)HTTP1_BatchFlush(req);
 				Req_Release(req);
 				SES_DeleteHS(sp, hs, NAN);
 				return;
 			}
 			if (hs == HTC_S_IDLE) {
 				wrk->stats->sess_herd++;
+				AZ(req->htc->v1l_batch);
 				Req_Release(req);
 				SES_Wait(sp, &HTTP1_transport);
 				return;
@@ -348,6 +398,7 @@ HTTP1_Session(struct worker *wrk, struct req *req)
 				WRONG("htc_status (nonbad)");
 
 			if (H2_prism_complete(req->htc) == HTC_S_COMPLETE) {
+				(void)HTTP1_BatchFlush(req);
 				if (!FEATURE(FEATURE_HTTP2)) {
 					SES_Close(req->sp, SC_REQ_HTTP20);
 					assert(!WS_IsReserved(req->ws));
@@ -379,6 +430,7 @@ HTTP1_Session(struct worker *wrk, struct req *req)
 					VSLb(req->vsl, SLT_Debug,
 					    "H2 upgrade attempt has body");
 				} else {
+					(void)HTTP1_BatchFlush(req);
 					http1_setstate(sp, NULL);
 					req->err_code = 2;
 					H2_OU_Sess(wrk, sp, req);
@@ -407,10 +459,13 @@ HTTP1_Session(struct worker *wrk, struct req *req)
 			assert(!WS_IsReserved(wrk->aws));
 			assert(!WS_IsReserved(req->ws));
 
-			if (sp->fd >= 0 && req->doclose != SC_NULL)
+			if (sp->fd >= 0 && req->doclose != SC_NULL) {
+				(void)HTTP1_BatchFlush(req);
 				SES_Close(sp, req->doclose);
+			}
 
 			if (sp->fd < 0) {
+				(void)HTTP1_BatchFlush(req);
 				wrk->stats->sess_closed++;
 				Req_Cleanup(sp, wrk, req);
 				Req_Release(req);
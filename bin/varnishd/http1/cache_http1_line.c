@@ -46,6 +46,7 @@
 #include "cache/cache_filter.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "cache_http1.h"
 #include "vtim.h"
@@ -69,6 +70,20 @@ struct v1l {
 	struct ws		*ws;
 	uintptr_t		ws_snap;
 	void			**vdp_priv;
+	struct v1l_batch	**batchp;
+	unsigned		hold;
+};
+
+/*
+ * Responses held back on a connection, see V1L_Batch()
+ */
+
+struct v1l_batch {
+	unsigned		magic;
+#define V1L_BATCH_MAGIC		0x5a3e0c17
+	unsigned		len;
+	unsigned		space;
+	char			buf[];
 };
 
 /*--------------------------------------------------------------------
@@ -126,6 +141,102 @@ V1L_Open(struct ws *ws, int *fd, struct vsl_log *vsl,
 	return (v1l);
 }
 
+/*--------------------------------------------------------------------
+ * Send whatever is held back on the connection in front of the next
+ * flush.  Must be called before anything is written.
+ */
+
+void
+V1L_Batch(struct v1l *v1l, struct v1l_batch **bp)
+{
+
+	CHECK_OBJ_NOTNULL(v1l, V1L_MAGIC);
+	AN(bp);
+	CHECK_OBJ_ORNULL(*bp, V1L_BATCH_MAGIC);
+	AZ(v1l->batchp);
+	AZ(v1l->niov);
+	assert(v1l->ciov == v1l->siov);
+
+	/* Keep one iovec for the held bytes */
+	v1l->siov--;
+	v1l->ciov = v1l->siov;
+	v1l->batchp = bp;
+}
+
+/*
+ * Hold back what is flushed from now on instead of writing it, provided
+ * that it and another len bytes fit the batch.
+ */
+
+int
+V1L_Hold(struct v1l *v1l, unsigned space, size_t len)
+{
+	struct v1l_batch *b;
+
+	CHECK_OBJ_NOTNULL(v1l, V1L_MAGIC);
+	AN(v1l->batchp);
+	AN(space);
+	b = *v1l->batchp;
+	if (b == NULL) {
+		ALLOC_FLEX_OBJ(b, buf, space, V1L_BATCH_MAGIC);
+		AN(b);
+		b->space = space;
+		*v1l->batchp = b;
+	}
+	CHECK_OBJ(b, V1L_BATCH_MAGIC);
+	if (len > b->space || b->len + v1l->liov > b->space - len)
+		return (0);
+	v1l->hold = 1;
+	return (1);
+}
+
+/*
+ * Write out and free what is held back on a connection, vsl can be NULL
+ * between requests.
+ */
+
+stream_close_t
+V1L_BatchFlush(struct v1l_batch **bp, int fd, struct vsl_log *vsl,
+    vtim_real deadline)
+{
+	struct v1l_batch *b;
+	stream_close_t sc = SC_NULL;
+	const char *p;
+	size_t l;
+	ssize_t i;
+
+	TAKE_OBJ_NOTNULL(b, bp, V1L_BATCH_MAGIC);
+	p = b->buf;
+	l = b->len;
+	while (fd >= 0 && l > 0) {
+		if (VTIM_real() > deadline) {
+			if (vsl != NULL)
+				VSLb(vsl, SLT_Debug,
+				    "Hit total send timeout, "
+				    "wrote = %zd/%u; not retrying",
+				    p - b->buf, b->len);
+			sc = SC_TX_ERROR;
+			break;
+		}
+		i = write(fd, p, l);
+		if (i > 0) {
+			p += i;
+			l -= (size_t)i;
+			continue;
+		}
+		if (i < 0 && errno == EWOULDBLOCK)
+			continue;
+		if (vsl != NULL)
+			VSLb(vsl, SLT_Debug,
+			    "Write error, retval = %zd, len = %zu, errno = %s",
+			    i, l, VAS_errtxt(errno));
+		sc = (errno == EPIPE) ? SC_REM_CLOSE : SC_TX_ERROR;
+		break;
+	}
+	FREE_OBJ(b);
+	return (sc);
+}
+
 void
 V1L_NoRollback(struct v1l *v1l)
 {
@@ -188,11 +299,70 @@ v1l_prune(struct v1l *v1l, ssize_t abytes)
 	AZ(v1l->liov);
 }
 
+/*--------------------------------------------------------------------
+ * With V1L_Batch(), either copy the io vectors to the batch if we hold
+ * and they fit, or write the held bytes in front of them.
+ */
+
+static struct v1l_batch *
+v1l_batch(const struct v1l *v1l)
+{
+	struct v1l_batch *b;
+
+	if (v1l->batchp == NULL)
+		return (NULL);
+	b = *v1l->batchp;
+	CHECK_OBJ_ORNULL(b, V1L_BATCH_MAGIC);
+	return (b);
+}
+
+static int
+v1l_hold(struct v1l *v1l)
+{
+	struct v1l_batch *b;
+	int j;
+
+	b = v1l_batch(v1l);
+	if (!v1l->hold || b == NULL || b->len + v1l->liov > b->space)
+		return (0);
+	assert(v1l->ciov == v1l->siov);
+	for (j = 0; j < v1l->niov; j++) {
+		memcpy(b->buf + b->len, v1l->iov[j].iov_base,
+		    v1l->iov[j].iov_len);
+		b->len += v1l->iov[j].iov_len;
+	}
+	v1l->cnt += v1l->liov;
+	v1l->liov = 0;
+	return (1);
+}
+
+static size_t
+v1l_unhold(struct v1l *v1l)
+{
+	struct v1l_batch *b;
+	size_t held;
+
+	b = v1l_batch(v1l);
+	if (b == NULL || b->len == 0)
+		return (0);
+
+	/* V1L_Batch() left room for this */
+	memmove(v1l->iov + 1, v1l->iov, v1l->niov * sizeof *v1l->iov);
+	v1l->iov[0].iov_base = b->buf;
+	v1l->iov[0].iov_len = b->len;
+	v1l->niov++;
+	v1l->liov += b->len;
+	held = b->len;
+	b->len = 0;
+	return (held);
+}
+
 stream_close_t
 V1L_Flush(struct v1l *v1l)
 {
+	struct v1l_batch *b;
 	ssize_t i;
-	size_t sz;
+	size_t sz, held;
 	int err;
 	char cbuf[32];
 
@@ -202,7 +372,12 @@ V1L_Flush(struct v1l *v1l)
 
 	assert(v1l->niov <= v1l->siov);
 
-	if (*v1l->wfd >= 0 && v1l->liov > 0 && v1l->werr == SC_NULL) {
+	if (*v1l->wfd >= 0 && v1l->liov > 0 && v1l->werr == SC_NULL)
+		(void)v1l_hold(v1l);
+	b = v1l_batch(v1l);
+
+	if (*v1l->wfd >= 0 && v1l->werr == SC_NULL && (v1l->liov > 0 ||
+	    (b != NULL && b->len > 0 && !v1l->hold))) {
 		if (v1l->ciov < v1l->siov && v1l->cliov > 0) {
 			/* Add chunk head & tail */
 			bprintf(cbuf, "00%zx\r\n", v1l->cliov);
@@ -219,6 +394,7 @@ V1L_Flush(struct v1l *v1l)
 			v1l->iov[v1l->ciov].iov_base = cbuf;
 			v1l->iov[v1l->ciov].iov_len = 0;
 		}
+		held = v1l_unhold(v1l);
 
 		i = 0;
 		err = 0;
@@ -270,6 +446,8 @@ V1L_Flush(struct v1l *v1l)
 				v1l->werr = SC_TX_ERROR;
 			errno = err;
 		}
+		/* held bytes were counted when held */
+		v1l->cnt -= vmin_t(uint64_t, v1l->cnt, held);
 	}
 	v1l->liov = 0;
 	v1l->cliov = 0;
@@ -317,6 +495,7 @@ V1L_Chunked(struct v1l *v1l)
 
 	assert(v1l->ciov == v1l->siov);
 	assert(v1l->siov >= 3);
+	v1l->hold = 0;
 	/*
 	 * If there is no space for chunked header, a chunk of data and
 	 * a chunk tail, we might as well flush right away.
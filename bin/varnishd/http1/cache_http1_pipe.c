@@ -35,15 +35,53 @@
 
 #include "cache/cache_varnishd.h"
 
+#include <fcntl.h>
 #include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+#ifdef HAVE_EPOLL_CTL
+#  include <sys/epoll.h>
+#endif
+
+#include "cache/cache_pool.h"
 #include "cache_http1.h"
 #include "vtcp.h"
 #include "vtim.h"
+#include "waiter/waiter.h"
 
 #include "VSC_vbe.h"
 
+/*--------------------------------------------------------------------
+ * The two directions of a PIPE session.  fd[0] is the backend and
+ * fd[1] the client connection, kp[n] is the kernel pipe used to
+ * splice(2) data read from fd[n].
+ *
+ * With pipe_park, a session which has been idle in both directions
+ * is handed to the waiter of its pool, so that it no longer holds a
+ * worker thread.  Parked sessions live in a malloc'ed struct v1p_pipe
+ * with dup(2)'ed fds, which outlives the request and the backend
+ * connection it came from, and a private epoll fd which stands in for
+ * both connections in the waiter.
+ */
+
+struct v1p_pipe {
+	unsigned		magic;
+#define V1P_PIPE_MAGIC		0x4b1f0c3d
+	int			fd[2];
+	int			kp[2][2];
+	vtim_real		deadline;
+	vtim_real		t_idle;
+
+	/* Only used by parked sessions */
+	int			epfd;
+	vtim_dur		tmo;
+	struct pool		*pool;
+	struct v1p_acct		acct;
+	struct waited		waited[1];
+	struct pool_task	task[1];
+};
+
 static struct lock pipestat_mtx;
 
 static int
@@ -69,6 +107,315 @@ rdf(int fd0, int fd1, uint64_t *pcnt)
 	return (0);
 }
 
+#ifdef HAVE_SPLICE
+/*--------------------------------------------------------------------
+ * Move data from fd0 to fd1 through a kernel pipe.
+ *
+ * Returns -1 if the sockets do not support splice(2), in which case
+ * nothing was read and the caller should fall back to rdf().
+ */
+
+static int
+spf(int fd0, int fd1, const int *kp, uint64_t *pcnt, uint64_t *pspl)
+{
+	ssize_t i, j;
+
+	i = splice(fd0, NULL, kp[1], NULL, BUFSIZ * 8, SPLICE_F_MOVE);
+	if (i < 0 && errno == EINVAL)
+		return (-1);
+	VTCP_Assert(i);
+	if (i <= 0)
+		return (1);
+	for (; i > 0; i -= j) {
+		j = splice(kp[0], NULL, fd1, NULL, i, SPLICE_F_MOVE);
+		VTCP_Assert(j);
+		if (j <= 0)
+			return (1);
+		assert(j <= i);
+		*pcnt += j;
+		*pspl += j;
+	}
+	return (0);
+}
+
+#endif
+
+/*--------------------------------------------------------------------
+ * Relay one direction, with splice(2) if we have a kernel pipe for it.
+ */
+
+static int
+v1p_relay(int fd0, int fd1, int *kp, uint64_t *pcnt, uint64_t *pspl)
+{
+
+#ifdef HAVE_SPLICE
+	int i;
+
+	if (kp[0] >= 0) {
+		i = spf(fd0, fd1, kp, pcnt, pspl);
+		if (i >= 0)
+			return (i);
+		closefd(&kp[0]);
+		closefd(&kp[1]);
+	}
+#else
+	(void)kp;
+	(void)pspl;
+#endif
+	return (rdf(fd0, fd1, pcnt));
+}
+
+/*--------------------------------------------------------------------
+ * Relay until both directions are closed, or until the session has
+ * been idle in both directions for park seconds, in which case SC_NULL
+ * is returned and the session can be parked.
+ */
+
+static stream_close_t
+v1p_loop(struct v1p_pipe *vp, struct v1p_acct *a, vtim_dur park)
+{
+	struct pollfd fds[2];
+	vtim_dur tmo, tmo_task;
+	stream_close_t sc;
+	int i, parkable;
+
+	CHECK_OBJ_NOTNULL(vp, V1P_PIPE_MAGIC);
+	AN(a);
+
+	memset(fds, 0, sizeof fds);
+	fds[0].fd = vp->fd[0];
+	fds[0].events = POLLIN;
+	fds[1].fd = vp->fd[1];
+	fds[1].events = POLLIN;
+
+	sc = SC_TX_PIPE;
+	while (fds[0].fd > -1 || fds[1].fd > -1) {
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		tmo = cache_param->pipe_timeout;
+		if (tmo == 0.)
+			tmo = INFINITY;
+		if (vp->deadline > 0.) {
+			tmo_task = vp->deadline - VTIM_real();
+			tmo = vmin(tmo, tmo_task);
+		}
+		parkable = park > 0. && park < tmo &&
+		    fds[0].fd > -1 && fds[1].fd > -1;
+		i = poll(fds, 2, VTIM_poll_tmo(parkable ? park : tmo));
+		if (i == 0 && parkable) {
+			vp->t_idle = VTIM_real() - park;
+			sc = SC_NULL;
+			break;
+		}
+		if (i == 0)
+			sc = SC_RX_TIMEOUT;
+		if (i < 1)
+			break;
+		if (fds[0].revents && v1p_relay(vp->fd[0], vp->fd[1],
+		    vp->kp[0], &a->out, &a->spliced)) {
+			if (fds[1].fd == -1)
+				break;
+			(void)shutdown(vp->fd[0], SHUT_RD);
+			(void)shutdown(vp->fd[1], SHUT_WR);
+			fds[0].events = 0;
+			fds[0].fd = -1;
+		}
+		if (fds[1].revents && v1p_relay(vp->fd[1], vp->fd[0],
+		    vp->kp[1], &a->in, &a->spliced)) {
+			if (fds[0].fd == -1)
+				break;
+			(void)shutdown(vp->fd[1], SHUT_RD);
+			(void)shutdown(vp->fd[0], SHUT_WR);
+			fds[1].events = 0;
+			fds[1].fd = -1;
+		}
+	}
+	return (sc);
+}
+
+static void
+v1p_closekp(struct v1p_pipe *vp)
+{
+	int i, j;
+
+	CHECK_OBJ_NOTNULL(vp, V1P_PIPE_MAGIC);
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 2; j++) {
+			if (vp->kp[i][j] >= 0)
+				closefd(&vp->kp[i][j]);
+		}
+	}
+}
+
+#ifdef HAVE_EPOLL_CTL
+/*--------------------------------------------------------------------
+ * Parked sessions
+ *
+ * The waiter only ever sees the epoll fd, which becomes readable when
+ * either connection does.  When it does, a worker relays until the
+ * session is idle again and parks it anew.  Bytes moved while parked
+ * are charged to the global counters only, since the backend may be
+ * gone by the time the session ends.
+ */
+
+static waiter_handle_f v1p_park_handle;
+
+static void
+v1p_park_fini(struct v1p_pipe *vp)
+{
+	const struct v1p_acct *a;
+
+	CHECK_OBJ_NOTNULL(vp, V1P_PIPE_MAGIC);
+	v1p_closekp(vp);
+	closefd(&vp->fd[0]);
+	closefd(&vp->fd[1]);
+	closefd(&vp->epfd);
+
+	a = &vp->acct;
+	Lck_Lock(&pipestat_mtx);
+	VSC_C_main->s_pipe_in += a->in;
+	VSC_C_main->s_pipe_out += a->out;
+	VSC_C_main->s_pipe_spliced += a->spliced;
+	assert(VSC_C_main->n_pipe > 0);
+	VSC_C_main->n_pipe--;
+	Lck_Unlock(&pipestat_mtx);
+	FREE_OBJ(vp);
+}
+
+static int
+v1p_park_wait(struct v1p_pipe *vp)
+{
+	struct waited *wp;
+
+	CHECK_OBJ_NOTNULL(vp, V1P_PIPE_MAGIC);
+	CHECK_OBJ_NOTNULL(vp->pool, POOL_MAGIC);
+
+	vp->tmo = cache_param->pipe_timeout;
+	if (vp->tmo == 0.)
+		vp->tmo = INFINITY;
+	if (vp->deadline > 0.)
+		vp->tmo = vmin(vp->tmo, vp->deadline - vp->t_idle);
+
+	wp = vp->waited;
+	INIT_OBJ(wp, WAITED_MAGIC);
+	wp->fd = vp->epfd;
+	wp->priv1 = vp;
+	wp->func = v1p_park_handle;
+	wp->idle = vp->t_idle;
+	wp->tmo = vp->tmo;
+	return (Wait_Enter(vp->pool->waiter, wp));
+}
+
+static void v_matchproto_(task_func_t)
+v1p_park_task(struct worker *wrk, void *priv)
+{
+	struct v1p_pipe *vp;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CAST_OBJ_NOTNULL(vp, priv, V1P_PIPE_MAGIC);
+
+	if (v1p_loop(vp, &vp->acct, cache_param->pipe_park) == SC_NULL &&
+	    !v1p_park_wait(vp))
+		return;
+	v1p_park_fini(vp);
+}
+
+static void v_matchproto_(waiter_handle_f)
+v1p_park_handle(struct waited *wp, enum wait_event ev, vtim_real now)
+{
+	struct v1p_pipe *vp;
+
+	(void)now;
+	CHECK_OBJ_NOTNULL(wp, WAITED_MAGIC);
+	CAST_OBJ_NOTNULL(vp, wp->priv1, V1P_PIPE_MAGIC);
+	assert(wp == vp->waited);
+	FINI_OBJ(wp);
+
+	switch (ev) {
+	case WAITER_TIMEOUT:
+		assert(!isinf(vp->tmo));
+		v1p_park_fini(vp);
+		break;
+	case WAITER_ACTION:
+	case WAITER_REMCLOSE:
+		/* Let v1p_loop() find out which side has what */
+		vp->task->func = v1p_park_task;
+		vp->task->priv = vp;
+		if (Pool_Task(vp->pool, vp->task, TASK_QUEUE_REQ))
+			v1p_park_fini(vp);
+		break;
+	case WAITER_CLOSE:
+		v1p_park_fini(vp);
+		break;
+	default:
+		WRONG("Wrong event in v1p_park_handle");
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Hand an idle session over to the waiter.  On success the kernel
+ * pipes belong to the parked session, and the caller can close its
+ * own fds as usual.
+ */
+
+static int
+v1p_park(struct v1p_pipe *vp0, struct pool *pp)
+{
+	struct v1p_pipe *vp;
+	struct epoll_event ev;
+	int i;
+
+	CHECK_OBJ_NOTNULL(vp0, V1P_PIPE_MAGIC);
+	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
+
+	ALLOC_OBJ(vp, V1P_PIPE_MAGIC);
+	if (vp == NULL)
+		return (-1);
+	memcpy(vp->kp, vp0->kp, sizeof vp->kp);
+	vp->deadline = vp0->deadline;
+	vp->t_idle = vp0->t_idle;
+	vp->pool = pp;
+	vp->fd[0] = dup(vp0->fd[0]);
+	vp->fd[1] = dup(vp0->fd[1]);
+	vp->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	i = vp->fd[0] < 0 || vp->fd[1] < 0 || vp->epfd < 0;
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	if (!i)
+		i = epoll_ctl(vp->epfd, EPOLL_CTL_ADD, vp->fd[0], &ev) ||
+		    epoll_ctl(vp->epfd, EPOLL_CTL_ADD, vp->fd[1], &ev);
+
+	/* Counts as a pipe session until v1p_park_fini() */
+	if (!i) {
+		Lck_Lock(&pipestat_mtx);
+		VSC_C_main->n_pipe++;
+		Lck_Unlock(&pipestat_mtx);
+		i = v1p_park_wait(vp);
+		Lck_Lock(&pipestat_mtx);
+		if (i)
+			VSC_C_main->n_pipe--;
+		else
+			VSC_C_main->pipe_parked++;
+		Lck_Unlock(&pipestat_mtx);
+		if (!i) {
+			vp0->kp[0][0] = vp0->kp[0][1] = -1;
+			vp0->kp[1][0] = vp0->kp[1][1] = -1;
+			return (0);
+		}
+	}
+
+	if (vp->fd[0] >= 0)
+		closefd(&vp->fd[0]);
+	if (vp->fd[1] >= 0)
+		closefd(&vp->fd[1]);
+	if (vp->epfd >= 0)
+		closefd(&vp->epfd);
+	FREE_OBJ(vp);
+	return (-1);
+}
+#endif
+
 int
 V1P_Enter(void)
 {
@@ -109,6 +456,7 @@ V1P_Charge(struct req *req, const struct v1p_acct *a, struct VSC_vbe *b)
 	VSC_C_main->s_pipe_hdrbytes += a->req;
 	VSC_C_main->s_pipe_in += a->in;
 	VSC_C_main->s_pipe_out += a->out;
+	VSC_C_main->s_pipe_spliced += a->spliced;
 	b->pipe_hdrbytes += a->bereq;
 	b->pipe_out += a->in;
 	b->pipe_in += a->out;
@@ -119,15 +467,23 @@ stream_close_t
 V1P_Process(const struct req *req, int fd, struct v1p_acct *v1a,
     vtim_real deadline)
 {
-	struct pollfd fds[2];
-	vtim_dur tmo, tmo_task;
+	struct v1p_pipe vp[1];
 	stream_close_t sc;
-	int i, j;
+	vtim_dur park = 0.;
+	int j;
 
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
 	CHECK_OBJ_NOTNULL(req->sp, SESS_MAGIC);
 	assert(fd > 0);
 
+	/* Responses held back by V1D_Deliver() go first */
+	if (req->htc->v1l_batch != NULL) {
+		sc = V1L_BatchFlush(&req->htc->v1l_batch, req->sp->fd,
+		    NULL, deadline);
+		if (sc != SC_NULL)
+			return (sc);
+	}
+
 	if (req->htc->pipeline_b != NULL) {
 		j = write(fd,  req->htc->pipeline_b,
 		    req->htc->pipeline_e - req->htc->pipeline_b);
@@ -138,48 +494,39 @@ V1P_Process(const struct req *req, int fd, struct v1p_acct *v1a,
 		req->htc->pipeline_e = NULL;
 		v1a->in += j;
 	}
-	memset(fds, 0, sizeof fds);
-	fds[0].fd = fd;
-	fds[0].events = POLLIN;
-	fds[1].fd = req->sp->fd;
-	fds[1].events = POLLIN;
 
-	sc = SC_TX_PIPE;
-	while (fds[0].fd > -1 || fds[1].fd > -1) {
-		fds[0].revents = 0;
-		fds[1].revents = 0;
-		tmo = cache_param->pipe_timeout;
-		if (tmo == 0.)
-			tmo = INFINITY;
-		if (deadline > 0.) {
-			tmo_task = deadline - VTIM_real();
-			tmo = vmin(tmo, tmo_task);
-		}
-		i = poll(fds, 2, VTIM_poll_tmo(tmo));
-		if (i == 0)
-			sc = SC_RX_TIMEOUT;
-		if (i < 1)
-			break;
-		if (fds[0].revents &&
-		    rdf(fd, req->sp->fd, &v1a->out)) {
-			if (fds[1].fd == -1)
-				break;
-			(void)shutdown(fd, SHUT_RD);
-			(void)shutdown(req->sp->fd, SHUT_WR);
-			fds[0].events = 0;
-			fds[0].fd = -1;
-		}
-		if (fds[1].revents &&
-		    rdf(req->sp->fd, fd, &v1a->in)) {
-			if (fds[0].fd == -1)
-				break;
-			(void)shutdown(req->sp->fd, SHUT_RD);
-			(void)shutdown(fd, SHUT_WR);
-			fds[1].events = 0;
-			fds[1].fd = -1;
-		}
+	INIT_OBJ(vp, V1P_PIPE_MAGIC);
+	vp->fd[0] = fd;
+	vp->fd[1] = req->sp->fd;
+	vp->kp[0][0] = vp->kp[0][1] = -1;
+	vp->kp[1][0] = vp->kp[1][1] = -1;
+	vp->deadline = deadline;
+	vp->epfd = -1;
+
+#ifdef HAVE_SPLICE
+	if (cache_param->pipe_splice &&
+	    pipe2(vp->kp[0], O_CLOEXEC) == 0 &&
+	    pipe2(vp->kp[1], O_CLOEXEC) < 0) {
+		closefd(&vp->kp[0][0]);
+		closefd(&vp->kp[0][1]);
 	}
+#endif
 
+#ifdef HAVE_EPOLL_CTL
+	park = cache_param->pipe_park;
+#endif
+	sc = v1p_loop(vp, v1a, park);
+#ifdef HAVE_EPOLL_CTL
+	if (sc == SC_NULL) {
+		CHECK_OBJ_NOTNULL(req->sp->pool, POOL_MAGIC);
+		if (!v1p_park(vp, req->sp->pool))
+			sc = SC_TX_PIPE;
+		else
+			sc = v1p_loop(vp, v1a, 0.);
+	}
+#endif
+	assert(sc != SC_NULL);
+	v1p_closekp(vp);
 	return (sc);
 }
 
@@ -87,15 +87,21 @@ HTTP1_Complete(struct http_conn *htc)
 	/*
 	 * Here we just look for NL[CR]NL to see that reception
 	 * is completed.  More stringent validation happens later.
+	 *
+	 * Everything up to rxbuf_scan was looked at by an earlier call,
+	 * only a partial NL[CR] at its end can be part of a match.
 	 */
+	if (htc->rxbuf_scan != NULL && htc->rxbuf_scan - p > 2) {
+		assert(htc->rxbuf_scan <= htc->rxbuf_e);
+		p = htc->rxbuf_scan - 2;
+	}
 	while (1) {
 		p = memchr(p, '\n', htc->rxbuf_e - p);
-		if (p == NULL)
-			return (HTC_S_MORE);
-		if (++p == htc->rxbuf_e)
-			return (HTC_S_MORE);
-		if (*p == '\r' && ++p == htc->rxbuf_e)
+		if (p == NULL || ++p == htc->rxbuf_e ||
+		    (*p == '\r' && ++p == htc->rxbuf_e)) {
+			htc->rxbuf_scan = htc->rxbuf_e;
 			return (HTC_S_MORE);
+		}
 		if (*p == '\n')
 			break;
 	}
@@ -124,10 +130,9 @@ http1_dissect_hdrs(struct http *hp, char *p, struct http_conn *htc,
 		if (vct_iscrlf(p, htc->rxbuf_e))
 			break;
 		while (r < htc->rxbuf_e) {
-			if (vct_ishdrval(*r)) {
-				r++;
-				continue;
-			}
+			r += VCT_hdrval_span(r, htc->rxbuf_e);
+			if (r == htc->rxbuf_e)
+				break;
 			i = vct_iscrlf(r, htc->rxbuf_e);
 			if (i == 0) {
 				VSLb(hp->vsl, SLT_BogoHeader,
@@ -180,12 +185,11 @@ http1_dissect_hdrs(struct http *hp, char *p, struct http_conn *htc,
 			q--;
 		*q = '\0';
 
-		for (s = p; *s != ':' && s < q; s++) {
-			if (!vct_istchar(*s)) {
-				VSLb(hp->vsl, SLT_BogoHeader,
-				    "Illegal char 0x%02x in header name", *s);
-				return (400);
-			}
+		s = p + VCT_tchar_span(p, q);
+		if (s < q && *s != ':') {
+			VSLb(hp->vsl, SLT_BogoHeader,
+			    "Illegal char 0x%02x in header name", *s);
+			return (400);
 		}
 		if (*s != ':') {
 			VSLb(hp->vsl, SLT_BogoHeader, "Header without ':' %.*s",
@@ -238,10 +242,9 @@ http1_splitline(struct http *hp, struct http_conn *htc, const int *hf,
 	hp->hd[hf[0]].b = p;
 
 	/* First field cannot contain SP or CTL */
-	for (; !vct_issp(*p); p++) {
-		if (vct_isctl(*p))
-			return (400);
-	}
+	p += VCT_vchar_span(p, htc->rxbuf_e);
+	if (!vct_issp(*p))
+		return (400);
 	hp->hd[hf[0]].e = p;
 	assert(Tlen(hp->hd[hf[0]]));
 	*p++ = '\0';
@@ -254,10 +257,9 @@ http1_splitline(struct http *hp, struct http_conn *htc, const int *hf,
 	hp->hd[hf[1]].b = p;
 
 	/* Second field cannot contain LWS or CTL */
-	for (; !vct_islws(*p); p++) {
-		if (vct_isctl(*p))
-			return (400);
-	}
+	p += VCT_vchar_span(p, htc->rxbuf_e);
+	if (!vct_islws(*p))
+		return (400);
 	hp->hd[hf[1]].e = p;
 	if (!Tlen(hp->hd[hf[1]]))
 		return (400);
@@ -276,10 +278,7 @@ http1_splitline(struct http *hp, struct http_conn *htc, const int *hf,
 
 	/* Third field is optional and cannot contain CTL except TAB */
 	q = p;
-	for (; p < htc->rxbuf_e && !vct_iscrlf(p, htc->rxbuf_e); p++) {
-		if (vct_isctl(*p) && !vct_issp(*p))
-			return (400);
-	}
+	p += VCT_hdrval_span(p, htc->rxbuf_e);
 	if (p > q) {
 		hp->hd[hf[2]].b = q;
 		hp->hd[hf[2]].e = p;
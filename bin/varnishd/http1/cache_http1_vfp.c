@@ -97,93 +97,199 @@ v1f_read(const struct vfp_ctx *vc, struct http_conn *htc, void *d, ssize_t len)
 
 
 /*--------------------------------------------------------------------
- * read (CR)?LF at the end of a chunk
- */
-static enum vfp_status
-v1f_chunk_end(struct vfp_ctx *vc, struct http_conn *htc)
-{
-	char c;
-
-	if (v1f_read(vc, htc, &c, 1) <= 0)
-		return (VFP_Error(vc, "chunked read err"));
-	if (c == '\r' && v1f_read(vc, htc, &c, 1) <= 0)
-		return (VFP_Error(vc, "chunked read err"));
-	if (c != '\n')
-		return (VFP_Error(vc, "chunked tail no NL"));
-	return (VFP_OK);
-}
-
-
-/*--------------------------------------------------------------------
- * Parse a chunk header and, for VFP_OK, return size in a pointer
+ * Chunked decoding
  *
- * XXX: Reading one byte at a time is pretty pessimal.
+ * The socket is read straight into the buffer we were given, and the
+ * chunk framing is stripped from it in place.
+ *
+ * Nothing can follow a backend response, so fetches read as much as
+ * fits in the buffer.  For request bodies, we must not steal bytes from
+ * a pipelined request, so we never read more than the chunked encoding
+ * still guarantees to come, assuming the shortest possible framing
+ * (bare LF and a lone "0" last chunk).  While in the data of a chunk,
+ * that is the rest of the data and the beginning of the next chunk
+ * header, which still saves a read(2) per header byte.
  */
 
-static enum vfp_status
-v1f_chunked_hdr(struct vfp_ctx *vc, struct http_conn *htc, ssize_t *szp)
-{
-	char buf[20];		/* XXX: 20 is arbitrary */
-	unsigned u;
-	uintmax_t cll;
-	ssize_t cl, lr;
-	char *q;
-
-	CHECK_OBJ_NOTNULL(vc, VFP_CTX_MAGIC);
-	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
-	AN(szp);
-	assert(*szp == -1);
+enum v1f_chunked_e {
+	V1F_CH_START,		/* before the chunk size, OWS allowed */
+	V1F_CH_SIZE,		/* in the chunk size */
+	V1F_CH_OWS,		/* after the chunk size, OWS allowed */
+	V1F_CH_HDR_CR,		/* CR seen at the end of the chunk header */
+	V1F_CH_DATA,		/* in the chunk data */
+	V1F_CH_TAIL,		/* after the chunk data */
+	V1F_CH_TAIL_CR,		/* CR seen after the chunk data */
+	V1F_CH_END,		/* done */
+};
 
-	/* Skip leading whitespace */
-	do {
-		lr = v1f_read(vc, htc, buf, 1);
-		if (lr <= 0)
-			return (VFP_Error(vc, "chunked read err"));
-	} while (vct_isows(buf[0]));
+struct v1f_chunked {
+	unsigned		magic;
+#define V1F_CHUNKED_MAGIC	0x2c0a5f3b
+	enum v1f_chunked_e	state;
+	unsigned		greedy;
+	struct http_conn	*htc;
+	ssize_t			len;
+};
 
-	if (!vct_ishex(buf[0]))
-		return (VFP_Error(vc, "chunked header non-hex"));
+/* How much we can read without blocking for more than we need */
 
-	/* Collect hex digits, skipping leading zeros */
-	for (u = 1; u < sizeof buf; u++) {
-		do {
-			lr = v1f_read(vc, htc, buf + u, 1);
-			if (lr <= 0)
-				return (VFP_Error(vc, "chunked read err"));
-		} while (u == 1 && buf[0] == '0' && buf[u] == '0');
-		if (!vct_ishex(buf[u]))
-			break;
+static ssize_t
+v1f_chunked_ahead(const struct v1f_chunked *ch, ssize_t l)
+{
+	const struct http_conn *htc;
+	ssize_t n;
+
+	htc = ch->htc;
+	if (htc->pipeline_b != NULL)
+		l = vmin(l, htc->pipeline_e - htc->pipeline_b);
+	if (ch->greedy)
+		return (l);
+
+	switch (ch->state) {
+	case V1F_CH_START:
+		n = 3;
+		break;
+	case V1F_CH_SIZE:
+	case V1F_CH_OWS:
+	case V1F_CH_HDR_CR:
+		if (ch->len == 0)
+			n = 2;
+		else if (ch->len > l)
+			return (l);
+		else
+			n = ch->len + 5;
+		break;
+	case V1F_CH_DATA:
+		if (ch->len > l)
+			return (l);
+		n = ch->len + 4;
+		break;
+	case V1F_CH_TAIL:
+	case V1F_CH_TAIL_CR:
+		n = ch->len < 0 ? 1 : 4;
+		break;
+	default:
+		WRONG("v1f_chunked state");
 	}
+	assert(n > 0);
+	return (vmin(n, l));
+}
 
-	if (u >= sizeof buf)
-		return (VFP_Error(vc, "chunked header too long"));
+/*
+ * Strip the framing from the n bytes at p, returns the length of the
+ * data left at p, or -1 after a VFP_Error().
+ */
 
-	/* Skip trailing white space */
-	while (vct_isows(buf[u])) {
-		lr = v1f_read(vc, htc, buf + u, 1);
-		if (lr <= 0)
-			return (VFP_Error(vc, "chunked read err"));
+static ssize_t
+v1f_chunked_parse(struct vfp_ctx *vc, struct v1f_chunked *ch, char *p,
+    ssize_t n)
+{
+	char *r, *w, *e;
+	ssize_t l;
+	int d;
+
+	r = w = p;
+	e = p + n;
+	while (r < e) {
+		switch (ch->state) {
+		case V1F_CH_START:
+			if (vct_isows(*r)) {
+				r++;
+				break;
+			}
+			if (!vct_ishex(*r)) {
+				(void)VFP_Error(vc, "chunked header non-hex");
+				return (-1);
+			}
+			AZ(ch->len);
+			ch->state = V1F_CH_SIZE;
+			break;
+		case V1F_CH_SIZE:
+			if (!vct_ishex(*r)) {
+				ch->state = V1F_CH_OWS;
+				break;
+			}
+			if (vct_isdigit(*r))
+				d = *r - '0';
+			else
+				d = (*r | 0x20) - 'a' + 10;
+			if (ch->len > (SSIZE_MAX - d) / 16) {
+				(void)VFP_Error(vc, "bogusly large chunk size");
+				return (-1);
+			}
+			ch->len = ch->len * 16 + d;
+			r++;
+			break;
+		case V1F_CH_OWS:
+			if (vct_isows(*r)) {
+				r++;
+				break;
+			}
+			if (*r == '\r') {
+				ch->state = V1F_CH_HDR_CR;
+				r++;
+				break;
+			}
+			/* FALLTHROUGH */
+		case V1F_CH_HDR_CR:
+			if (*r != '\n') {
+				(void)VFP_Error(vc, "chunked header no NL");
+				return (-1);
+			}
+			r++;
+			if (ch->len == 0) {
+				/* Last chunk, flagged for the tail */
+				ch->len = -1;
+				ch->state = V1F_CH_TAIL;
+			} else
+				ch->state = V1F_CH_DATA;
+			break;
+		case V1F_CH_DATA:
+			assert(ch->len > 0);
+			l = vmin(ch->len, e - r);
+			if (w != r)
+				memmove(w, r, l);
+			w += l;
+			r += l;
+			ch->len -= l;
+			if (ch->len == 0)
+				ch->state = V1F_CH_TAIL;
+			break;
+		case V1F_CH_TAIL:
+			if (*r == '\r') {
+				ch->state = V1F_CH_TAIL_CR;
+				r++;
+				break;
+			}
+			/* FALLTHROUGH */
+		case V1F_CH_TAIL_CR:
+			if (*r != '\n') {
+				(void)VFP_Error(vc, "chunked tail no NL");
+				return (-1);
+			}
+			r++;
+			if (ch->len < 0) {
+				ch->state = V1F_CH_END;
+				if (r == e)
+					break;
+				AN(ch->greedy);
+				VSLb(vc->wrk->vsl, SLT_Notice,
+				    "Junk after chunked body (%zd bytes)",
+				    e - r);
+				ch->htc->doclose = SC_RX_JUNK;
+				return (w - p);
+			} else {
+				ch->len = 0;
+				ch->state = V1F_CH_START;
+			}
+			break;
+		default:
+			WRONG("v1f_chunked state");
+		}
 	}
-
-	if (buf[u] == '\r' && v1f_read(vc, htc, buf + u, 1) <= 0)
-		return (VFP_Error(vc, "chunked read err"));
-	if (buf[u] != '\n')
-		return (VFP_Error(vc, "chunked header no NL"));
-
-	buf[u] = '\0';
-
-	cll = strtoumax(buf, &q, 16);
-	if (q == NULL || *q != '\0')
-		return (VFP_Error(vc, "chunked header number syntax"));
-	cl = (ssize_t)cll;
-	if (cl < 0 || (uintmax_t)cl != cll)
-		return (VFP_Error(vc, "bogusly large chunk size"));
-
-	*szp = cl;
-	return (VFP_OK);
+	return (w - p);
 }
 
-
 /*--------------------------------------------------------------------
  * Read a chunked HTTP object.
  *
@@ -193,40 +299,31 @@ static enum vfp_status v_matchproto_(vfp_pull_f)
 v1f_chunked_pull(struct vfp_ctx *vc, struct vfp_entry *vfe, void *ptr,
     ssize_t *lp)
 {
-	static enum vfp_status vfps;
-	struct http_conn *htc;
+	struct v1f_chunked *ch;
 	ssize_t l, lr;
 
 	CHECK_OBJ_NOTNULL(vc, VFP_CTX_MAGIC);
 	CHECK_OBJ_NOTNULL(vfe, VFP_ENTRY_MAGIC);
-	CAST_OBJ_NOTNULL(htc, vfe->priv1, HTTP_CONN_MAGIC);
+	CAST_OBJ_NOTNULL(ch, vfe->priv1, V1F_CHUNKED_MAGIC);
 	AN(ptr);
 	AN(lp);
 
 	l = *lp;
 	*lp = 0;
-	if (vfe->priv2 == -1) {
-		vfps = v1f_chunked_hdr(vc, htc, &vfe->priv2);
-		if (vfps != VFP_OK)
-			return (vfps);
-	}
-	if (vfe->priv2 > 0) {
-		if (vfe->priv2 < l)
-			l = vfe->priv2;
-		lr = v1f_read(vc, htc, ptr, l);
-		if (lr <= 0)
+	assert(l > 0);
+	do {
+		assert(ch->state != V1F_CH_END);
+		lr = v1f_read(vc, ch->htc, ptr, v1f_chunked_ahead(ch, l));
+		if (lr <= 0 && ch->state == V1F_CH_DATA)
 			return (VFP_Error(vc, "chunked insufficient bytes"));
-		*lp = lr;
-		vfe->priv2 -= lr;
-		if (vfe->priv2 != 0)
-			return (VFP_OK);
-
-		vfe->priv2 = -1;
-		return (v1f_chunk_end(vc, htc));
-	}
-	AZ(vfe->priv2);
-	vfps = v1f_chunk_end(vc, htc);
-	return (vfps == VFP_OK ? VFP_END : vfps);
+		if (lr <= 0)
+			return (VFP_Error(vc, "chunked read err"));
+		lr = v1f_chunked_parse(vc, ch, ptr, lr);
+		if (lr < 0)
+			return (VFP_ERROR);
+	} while (lr == 0 && ch->state != V1F_CH_END);
+	*lp = lr;
+	return (ch->state == V1F_CH_END ? VFP_END : VFP_OK);
 }
 
 static const struct vfp v1f_chunked = {
@@ -306,9 +403,10 @@ static const struct vfp v1f_eof = {
  */
 
 int
-V1F_Setup_Fetch(struct vfp_ctx *vfc, struct http_conn *htc)
+V1F_Setup_Fetch(struct vfp_ctx *vfc, struct http_conn *htc, unsigned greedy)
 {
 	struct vfp_entry *vfe;
+	struct v1f_chunked *ch;
 
 	CHECK_OBJ_NOTNULL(vfc, VFP_CTX_MAGIC);
 	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
@@ -330,7 +428,17 @@ V1F_Setup_Fetch(struct vfp_ctx *vfc, struct http_conn *htc)
 		vfe = VFP_Push(vfc, &v1f_chunked);
 		if (vfe == NULL)
 			return (ENOSPC);
-		vfe->priv2 = -1;
+		ch = WS_Alloc(vfc->resp->ws, sizeof *ch);
+		if (ch == NULL) {
+			(void)VFP_Error(vfc, "Workspace overflow");
+			return (ENOSPC);
+		}
+		INIT_OBJ(ch, V1F_CHUNKED_MAGIC);
+		ch->state = V1F_CH_START;
+		ch->greedy = greedy;
+		ch->htc = htc;
+		vfe->priv1 = ch;
+		return (0);
 	} else {
 		WRONG("Wrong body_status");
 	}
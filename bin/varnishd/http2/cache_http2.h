@@ -226,6 +226,23 @@ vtr_deliver_f h2_deliver;
 vtr_minimal_response_f h2_minimal_response;
 #endif /* TRANSPORT_MAGIC */
 
+/* http2/cache_http2_fetch.c */
+struct h2f_sess;
+struct h2f_stream;
+struct pfd;
+
+struct h2f_sess *H2F_New(struct pfd *);
+int H2F_Reserve(struct h2f_sess *, unsigned max_streams);
+int H2F_Reapable(struct h2f_sess *, vtim_real now, vtim_dur idle);
+void H2F_Close(struct h2f_sess **);
+struct h2f_stream *H2F_Stream(struct h2f_sess *);
+void H2F_Release(struct h2f_stream **);
+struct pfd *H2F_Pfd(const struct h2f_stream *);
+uint64_t H2F_Reused(const struct h2f_stream *);
+int H2F_SendReq(struct worker *, struct busyobj *, uint64_t *ctr_hdrbytes,
+    uint64_t *ctr_bodybytes);
+int H2F_FetchRespHdr(struct busyobj *);
+
 /* http2/cache_http2_hpack.c */
 struct h2h_decode {
 	unsigned			magic;
@@ -244,6 +261,7 @@ struct h2h_decode {
 	struct vhd_decode		vhd[1];
 };
 
+h2_error h2h_checkhdr(struct vsl_log *, txt nm, txt val);
 void h2h_decode_hdr_init(const struct h2_sess *h2);
 h2_error h2h_decode_hdr_fini(const struct h2_sess *h2);
 h2_error h2h_decode_bytes(struct h2_sess *h2, const uint8_t *ptr,
@@ -0,0 +1,1398 @@
+/*-
+ * Copyright (c) 2026 Varnish Software AS
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * HTTP/2 backend fetches over h2c "prior knowledge" connections
+ *
+ * A session owns one backend connection and carries the streams of any
+ * number of busyobjs.  Sessions have no thread of their own: whichever
+ * fetch is waiting for something from the connection (response headers,
+ * body bytes or send window) while nobody else is reading becomes the
+ * reader, pulls one frame off the socket, hands it to the stream it
+ * belongs to and wakes up the other waiters.  Header blocks are decoded
+ * as they arrive, so the HPACK table is always updated in frame order.
+ *
+ * Our own header blocks only use literals without indexing, so the
+ * HEADER_TABLE_SIZE of the peer does not concern us.
+ */
+
+#include "config.h"
+
+#include <sys/uio.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache/cache_varnishd.h"
+#include "cache/cache_filter.h"
+#include "cache/cache_conn_pool.h"
+
+#include "http2/cache_http2.h"
+
+#include "vct.h"
+#include "vend.h"
+#include "vtcp.h"
+#include "vtim.h"
+
+#define H2F_RXBUF		(64 * 1024)
+#define H2F_FRAME_MAX		16384		/* SETTINGS_MAX_FRAME_SIZE */
+#define H2F_WINDOW		(1 << 20)	/* per stream */
+#define H2F_CONN_WINDOW		(1 << 30)
+
+static const char h2f_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+struct h2f_chunk {
+	VTAILQ_ENTRY(h2f_chunk)		list;
+	size_t				len;
+	size_t				off;
+	uint8_t				data[];
+};
+
+struct h2f_stream {
+	unsigned			magic;
+#define H2F_STREAM_MAGIC		0x2f5e7a31
+	uint32_t			id;
+	unsigned			hdr_done:1;
+	unsigned			eos:1;
+	unsigned			reset:1;
+	unsigned			refused:1;
+	unsigned			hdr_bad:1;
+	uint32_t			rst_code;
+
+	struct h2f_sess			*sess;
+	VTAILQ_ENTRY(h2f_stream)	list;
+
+	char				*hdr;
+	size_t				hdr_len;
+
+	VTAILQ_HEAD(, h2f_chunk)	chunks;
+	int64_t				t_window;
+	uint32_t			r_unacked;
+	vtim_dur			tmo;
+};
+
+struct h2f_sess {
+	unsigned			magic;
+#define H2F_SESS_MAGIC			0x4c0e92d7
+
+	struct lock			mtx;
+	struct lock			tx_mtx;
+	pthread_cond_t			cond;
+
+	struct pfd			*pfd;
+	int				fd;
+
+	VTAILQ_HEAD(, h2f_stream)	streams;
+	unsigned			nstreams;
+	uint64_t			nreq;
+	uint32_t			next_id;
+	unsigned			reading:1;
+	unsigned			broken:1;
+	unsigned			goaway:1;
+	uint32_t			goaway_last;
+	vtim_real			t_idle;
+
+	uint32_t			peer_streams;
+	uint32_t			peer_window;
+	uint32_t			peer_frame;
+	int64_t				t_window;
+	uint32_t			r_unacked;
+
+	struct vht_table		dectbl[1];
+
+	/* Reader state, only touched by the current reader */
+	uint8_t				*rxbuf;
+	size_t				rx_b;
+	size_t				rx_e;
+	uint8_t				*hblk;
+	size_t				hblk_len;
+	size_t				hblk_size;
+	uint32_t			hblk_stream;
+	uint8_t				hblk_flags;
+};
+
+/*--------------------------------------------------------------------
+ * Frame output.  Frames of one header block must go out back to back,
+ * so the caller holds tx_mtx.  tx_mtx is taken before mtx, never the
+ * other way around.
+ */
+
+static int
+h2f_write(struct h2f_sess *sess, h2_frame ftyp, uint8_t flags,
+    uint32_t stream, const void *ptr, size_t len)
+{
+	uint8_t hdr[9];
+	struct iovec iov[2];
+	ssize_t l, i;
+	int n;
+
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+	Lck_AssertHeld(&sess->tx_mtx);
+	assert(len <= 0xffffff);
+
+	vbe32enc(hdr, (uint32_t)len << 8);
+	hdr[3] = ftyp->type;
+	hdr[4] = flags;
+	vbe32enc(hdr + 5, stream);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof hdr;
+	iov[1].iov_base = TRUST_ME(ptr);
+	iov[1].iov_len = len;
+	n = len > 0 ? 2 : 1;
+	l = sizeof hdr + len;
+	while (l > 0) {
+		i = writev(sess->fd, iov, n);
+		if (i <= 0)
+			return (-1);
+		l -= i;
+		while (n > 0 && (size_t)i >= iov[0].iov_len) {
+			i -= iov[0].iov_len;
+			iov[0] = iov[1];
+			n--;
+		}
+		if (n > 0) {
+			iov[0].iov_base = (char *)iov[0].iov_base + i;
+			iov[0].iov_len -= i;
+		}
+	}
+	return (0);
+}
+
+static void
+h2f_broken(struct h2f_sess *sess)
+{
+
+	Lck_Lock(&sess->mtx);
+	sess->broken = 1;
+	PTOK(pthread_cond_broadcast(&sess->cond));
+	Lck_Unlock(&sess->mtx);
+}
+
+static int
+h2f_send(struct h2f_sess *sess, h2_frame ftyp, uint8_t flags,
+    uint32_t stream, const void *ptr, size_t len)
+{
+	int i;
+
+	Lck_Lock(&sess->tx_mtx);
+	i = h2f_write(sess, ftyp, flags, stream, ptr, len);
+	Lck_Unlock(&sess->tx_mtx);
+	if (i)
+		h2f_broken(sess);
+	return (i);
+}
+
+static void
+h2f_send_winupd(struct h2f_sess *sess, uint32_t stream, uint32_t incr)
+{
+	uint8_t buf[4];
+
+	vbe32enc(buf, incr);
+	(void)h2f_send(sess, H2_F_WINDOW_UPDATE, 0, stream, buf, sizeof buf);
+}
+
+/*--------------------------------------------------------------------
+ * Frame input
+ */
+
+static struct h2f_stream *
+h2f_find(const struct h2f_sess *sess, uint32_t id)
+{
+	struct h2f_stream *s;
+
+	VTAILQ_FOREACH(s, &sess->streams, list)
+		if (s->id == id)
+			return (s);
+	return (NULL);
+}
+
+/*
+ * Decode a complete header block into "name: value" lines, each with a
+ * NUL terminator.  The output goes to the stream if it is still waiting
+ * for its response headers, otherwise (trailers, 1xx responses, streams
+ * we already gave up on) it is decoded only to keep the table in sync.
+ *
+ * Fields which would not survive this format, a NUL anywhere or a colon
+ * past the first character of the name, mark the header block as bad.
+ * The rest of the validation happens in H2F_FetchRespHdr().
+ */
+
+static int
+h2f_decode(struct h2f_sess *sess, struct vsl_log *vsl)
+{
+	struct vhd_decode vhd[1];
+	enum vhd_ret_e r;
+	struct h2f_stream *s;
+	size_t in_u = 0, out_u = 0, f_u = 0, size;
+	unsigned bad = 0;
+	char *out;
+
+	size = 2 * sess->hblk_len + 256;
+	out = malloc(size);
+	AN(out);
+	VHD_Init(vhd);
+	while (1) {
+		r = VHD_Decode(vhd, sess->dectbl, sess->hblk, sess->hblk_len,
+		    &in_u, out, size - 2, &out_u);
+		if (r < 0) {
+			VSLb(vsl, SLT_FetchError,
+			    "h2: HPACK compression error (%s)", VHD_Error(r));
+			free(out);
+			return (-1);
+		}
+		if (r == VHD_OK || r == VHD_MORE)
+			break;
+		if (r == VHD_NAME || r == VHD_NAME_SEC) {
+			if (out_u == f_u || memchr(out + f_u, '\0',
+			    out_u - f_u) != NULL || memchr(out + f_u + 1, ':',
+			    out_u - f_u - 1) != NULL)
+				bad = 1;
+			out[out_u++] = ':';
+			out[out_u++] = ' ';
+			f_u = out_u;
+		} else if (r == VHD_VALUE || r == VHD_VALUE_SEC) {
+			if (memchr(out + f_u, '\0', out_u - f_u) != NULL)
+				bad = 1;
+			out[out_u++] = '\0';
+			f_u = out_u;
+		}
+		if (out_u > 2 * (size_t)cache_param->http_resp_size) {
+			VSLb(vsl, SLT_FetchError, "h2: header list too big");
+			free(out);
+			return (-1);
+		}
+		if (size - out_u < 64) {
+			size *= 2;
+			out = realloc(out, size);
+			AN(out);
+		}
+	}
+	if (r == VHD_MORE) {
+		VSLb(vsl, SLT_FetchError, "h2: truncated header block");
+		free(out);
+		return (-1);
+	}
+
+	s = h2f_find(sess, sess->hblk_stream);
+	if (s != NULL && !s->hdr_done && !s->eos) {
+		if (out_u > 10 && !strncmp(out, ":status: 1", 10)) {
+			/* 1xx, wait for the real thing */
+		} else {
+			AZ(s->hdr);
+			s->hdr = out;
+			s->hdr_len = out_u;
+			s->hdr_bad = bad;
+			s->hdr_done = 1;
+			out = NULL;
+		}
+	}
+	if (s != NULL && (sess->hblk_flags & H2FF_HEADERS_END_STREAM))
+		s->eos = 1;
+	free(out);
+	return (0);
+}
+
+static void
+h2f_close_streams(struct h2f_sess *sess, uint32_t last)
+{
+	struct h2f_stream *s;
+
+	VTAILQ_FOREACH(s, &sess->streams, list) {
+		if (s->id <= last || s->id == 0)
+			continue;
+		if (!s->hdr_done)
+			s->refused = 1;
+		s->reset = 1;
+	}
+}
+
+static uint8_t *
+h2f_unpad(uint8_t flags, uint8_t padded, uint8_t *p, uint32_t *len)
+{
+
+	if (!(flags & padded))
+		return (p);
+	if (*len < 1 || p[0] >= *len)
+		return (NULL);
+	*len -= 1 + p[0];
+	return (p + 1);
+}
+
+/*
+ * Dispatch one frame, with mtx held.  Replies which can wait until the
+ * lock is dropped are left in the reply argument.
+ */
+
+struct h2f_reply {
+	unsigned	settings_ack;
+	unsigned	ping;
+	uint8_t		ping_data[8];
+	uint32_t	winupd;
+};
+
+static int
+h2f_dispatch(struct h2f_sess *sess, struct vsl_log *vsl, uint8_t ftyp,
+    uint8_t flags, uint32_t stream, uint8_t *p, uint32_t len,
+    struct h2f_reply *rpl)
+{
+	struct h2f_stream *s;
+	struct h2f_chunk *c;
+	uint32_t u, v, dl;
+	int64_t d;
+	uint8_t *q;
+
+	if (sess->hblk_stream != 0 && ftyp != H2_F_CONTINUATION->type) {
+		VSLb(vsl, SLT_FetchError, "h2: CONTINUATION expected");
+		return (-1);
+	}
+
+	if (ftyp == H2_F_DATA->type) {
+		rpl->winupd += len;
+		dl = len;
+		q = h2f_unpad(flags, H2FF_DATA_PADDED, p, &dl);
+		if (q == NULL || stream == 0)
+			return (-1);
+		s = h2f_find(sess, stream);
+		if (s == NULL || s->eos || s->reset)
+			return (0);
+		s->r_unacked += len - dl;
+		if (dl > 0) {
+			c = malloc(sizeof *c + dl);
+			AN(c);
+			c->len = dl;
+			c->off = 0;
+			memcpy(c->data, q, dl);
+			VTAILQ_INSERT_TAIL(&s->chunks, c, list);
+		}
+		if (flags & H2FF_DATA_END_STREAM)
+			s->eos = 1;
+		return (0);
+	}
+
+	if (ftyp == H2_F_HEADERS->type || ftyp == H2_F_CONTINUATION->type) {
+		if (stream == 0)
+			return (-1);
+		if (ftyp == H2_F_HEADERS->type) {
+			if (sess->hblk_stream != 0)
+				return (-1);
+			dl = len;
+			q = h2f_unpad(flags, H2FF_HEADERS_PADDED, p, &dl);
+			if (q == NULL)
+				return (-1);
+			if (flags & H2FF_HEADERS_PRIORITY) {
+				if (dl < 5)
+					return (-1);
+				q += 5;
+				dl -= 5;
+			}
+			sess->hblk_stream = stream;
+			sess->hblk_flags = flags;
+		} else {
+			if (stream != sess->hblk_stream)
+				return (-1);
+			q = p;
+			dl = len;
+		}
+		if (sess->hblk_len + dl > cache_param->http_resp_size) {
+			VSLb(vsl, SLT_FetchError, "h2: header block too big");
+			return (-1);
+		}
+		if (sess->hblk_len + dl > sess->hblk_size) {
+			sess->hblk_size = sess->hblk_len + dl;
+			sess->hblk = realloc(sess->hblk, sess->hblk_size);
+			AN(sess->hblk);
+		}
+		memcpy(sess->hblk + sess->hblk_len, q, dl);
+		sess->hblk_len += dl;
+		if (!(flags & H2FF_HEADERS_END_HEADERS))
+			return (0);
+		if (h2f_decode(sess, vsl))
+			return (-1);
+		sess->hblk_len = 0;
+		sess->hblk_stream = 0;
+		return (0);
+	}
+
+	if (ftyp == H2_F_RST_STREAM->type) {
+		if (stream == 0 || len != 4)
+			return (-1);
+		s = h2f_find(sess, stream);
+		if (s == NULL)
+			return (0);
+		s->rst_code = vbe32dec(p);
+		if (s->rst_code == H2SE_REFUSED_STREAM->val)
+			s->refused = 1;
+		s->reset = 1;
+		return (0);
+	}
+
+	if (ftyp == H2_F_SETTINGS->type) {
+		if (stream != 0 || len % 6)
+			return (-1);
+		if (flags & H2FF_SETTINGS_ACK)
+			return (0);
+		for (; len > 0; len -= 6, p += 6) {
+			u = vbe16dec(p);
+			v = vbe32dec(p + 2);
+			if (u == H2_SET_MAX_CONCURRENT_STREAMS->ident) {
+				sess->peer_streams = v;
+			} else if (u == H2_SET_INITIAL_WINDOW_SIZE->ident) {
+				if (v > 0x7fffffff)
+					return (-1);
+				d = (int64_t)v - sess->peer_window;
+				VTAILQ_FOREACH(s, &sess->streams, list)
+					s->t_window += d;
+				sess->peer_window = v;
+			} else if (u == H2_SET_MAX_FRAME_SIZE->ident) {
+				if (v < 16384 || v > 0xffffff)
+					return (-1);
+				sess->peer_frame = v;
+			}
+		}
+		rpl->settings_ack = 1;
+		return (0);
+	}
+
+	if (ftyp == H2_F_PING->type) {
+		if (stream != 0 || len != 8)
+			return (-1);
+		if (!(flags & H2FF_PING_ACK)) {
+			rpl->ping = 1;
+			memcpy(rpl->ping_data, p, 8);
+		}
+		return (0);
+	}
+
+	if (ftyp == H2_F_WINDOW_UPDATE->type) {
+		if (len != 4)
+			return (-1);
+		u = vbe32dec(p) & 0x7fffffff;
+		if (stream == 0) {
+			sess->t_window += u;
+		} else {
+			s = h2f_find(sess, stream);
+			if (s != NULL)
+				s->t_window += u;
+		}
+		return (0);
+	}
+
+	if (ftyp == H2_F_GOAWAY->type) {
+		if (stream != 0 || len < 8)
+			return (-1);
+		sess->goaway = 1;
+		sess->goaway_last = vbe32dec(p) & 0x7fffffff;
+		h2f_close_streams(sess, sess->goaway_last);
+		return (0);
+	}
+
+	if (ftyp == H2_F_PUSH_PROMISE->type) {
+		VSLb(vsl, SLT_FetchError, "h2: PUSH_PROMISE while disabled");
+		return (-1);
+	}
+
+	/* PRIORITY and unknown frame types are ignored */
+	return (0);
+}
+
+/*
+ * Read and dispatch a single frame.  Called with the reader role but
+ * without mtx.
+ *
+ * Return value:
+ *	 0 frame dispatched
+ *	-1 session broken
+ *	-2 timeout
+ */
+
+static int
+h2f_rxframe(struct h2f_sess *sess, struct vsl_log *vsl, vtim_real deadline)
+{
+	struct h2f_reply rpl[1];
+	uint32_t len;
+	uint8_t *hdr;
+	ssize_t l;
+	int i;
+
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+	AN(sess->reading);
+
+	len = 0;
+	while (1) {
+		l = sess->rx_e - sess->rx_b;
+		if (l >= 9) {
+			len = vbe32dec(sess->rxbuf + sess->rx_b) >> 8;
+			if (len > H2F_FRAME_MAX) {
+				VSLb(vsl, SLT_FetchError,
+				    "h2: frame too big (%u)", len);
+				h2f_broken(sess);
+				return (-1);
+			}
+			if ((size_t)l >= 9 + len)
+				break;
+		}
+		if (sess->rx_b > 0) {
+			memmove(sess->rxbuf, sess->rxbuf + sess->rx_b, l);
+			sess->rx_b = 0;
+			sess->rx_e = l;
+		}
+		i = VTCP_read(sess->fd, sess->rxbuf + sess->rx_e,
+		    H2F_RXBUF - sess->rx_e, vmax(deadline - VTIM_real(), 1e-3));
+		if (i == -2)
+			return (-2);
+		if (i <= 0) {
+			VSLb(vsl, SLT_FetchError, "h2: backend %s",
+			    i == 0 ? "closed" : "read error");
+			h2f_broken(sess);
+			return (-1);
+		}
+		sess->rx_e += i;
+	}
+
+	hdr = sess->rxbuf + sess->rx_b;
+	sess->rx_b += 9 + len;
+	memset(rpl, 0, sizeof rpl);
+	Lck_Lock(&sess->mtx);
+	i = h2f_dispatch(sess, vsl, hdr[3], hdr[4],
+	    vbe32dec(hdr + 5) & 0x7fffffff, hdr + 9, len, rpl);
+	if (i) {
+		VSLb(vsl, SLT_FetchError,
+		    "h2: protocol error, frame type %u", hdr[3]);
+		sess->broken = 1;
+		h2f_close_streams(sess, 0);
+	}
+	sess->r_unacked += rpl->winupd;
+	rpl->winupd = 0;
+	if (sess->r_unacked >= H2F_CONN_WINDOW / 2) {
+		rpl->winupd = sess->r_unacked;
+		sess->r_unacked = 0;
+	}
+	PTOK(pthread_cond_broadcast(&sess->cond));
+	Lck_Unlock(&sess->mtx);
+
+	if (i)
+		return (-1);
+	if (rpl->settings_ack)
+		(void)h2f_send(sess, H2_F_SETTINGS, H2FF_SETTINGS_ACK, 0,
+		    NULL, 0);
+	if (rpl->ping)
+		(void)h2f_send(sess, H2_F_PING, H2FF_PING_ACK, 0,
+		    rpl->ping_data, sizeof rpl->ping_data);
+	if (rpl->winupd)
+		h2f_send_winupd(sess, 0, rpl->winupd);
+	return (0);
+}
+
+/*
+ * Wait for a stream condition, taking turns at reading the connection.
+ * Returns with mtx held, -2 on timeout.
+ */
+
+typedef int h2f_ready_f(const struct h2f_stream *);
+
+static int
+h2f_wait(struct h2f_stream *s, struct vsl_log *vsl, vtim_real deadline,
+    h2f_ready_f *ready)
+{
+	struct h2f_sess *sess;
+	int i;
+
+	CHECK_OBJ_NOTNULL(s, H2F_STREAM_MAGIC);
+	sess = s->sess;
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+
+	Lck_Lock(&sess->mtx);
+	while (!ready(s) && !s->reset && !sess->broken) {
+		if (!sess->reading) {
+			sess->reading = 1;
+			Lck_Unlock(&sess->mtx);
+			i = h2f_rxframe(sess, vsl, deadline);
+			Lck_Lock(&sess->mtx);
+			sess->reading = 0;
+			PTOK(pthread_cond_broadcast(&sess->cond));
+			if (i == -2)
+				return (-2);
+			continue;
+		}
+		i = Lck_CondWaitUntil(&sess->cond, &sess->mtx, deadline);
+		if (i == ETIMEDOUT)
+			return (-2);
+	}
+	return (0);
+}
+
+static int v_matchproto_(h2f_ready_f)
+h2f_ready_hdr(const struct h2f_stream *s)
+{
+
+	return (s->hdr_done || s->eos);
+}
+
+static int v_matchproto_(h2f_ready_f)
+h2f_ready_data(const struct h2f_stream *s)
+{
+
+	return (!VTAILQ_EMPTY(&s->chunks) || s->eos);
+}
+
+static int v_matchproto_(h2f_ready_f)
+h2f_ready_window(const struct h2f_stream *s)
+{
+
+	return (s->t_window > 0 && s->sess->t_window > 0);
+}
+
+/*--------------------------------------------------------------------
+ * Sessions
+ */
+
+struct h2f_sess *
+H2F_New(struct pfd *pfd)
+{
+	struct h2f_sess *sess;
+	uint8_t buf[sizeof h2f_preface - 1 + 9 + 12];
+	int i;
+
+	AN(pfd);
+	ALLOC_OBJ(sess, H2F_SESS_MAGIC);
+	AN(sess);
+	Lck_New(&sess->mtx, lck_h2fetch);
+	Lck_New(&sess->tx_mtx, lck_h2fetch);
+	PTOK(pthread_cond_init(&sess->cond, NULL));
+	VTAILQ_INIT(&sess->streams);
+	sess->pfd = pfd;
+	sess->fd = *PFD_Fd(pfd);
+	sess->next_id = 1;
+	sess->peer_streams = H2_SET_MAX_CONCURRENT_STREAMS->defval;
+	sess->peer_window = H2_SET_INITIAL_WINDOW_SIZE->defval;
+	sess->peer_frame = H2_SET_MAX_FRAME_SIZE->defval;
+	sess->t_window = H2_SET_INITIAL_WINDOW_SIZE->defval;
+	sess->t_idle = VTIM_real();
+	AZ(VHT_Init(sess->dectbl, H2_SET_HEADER_TABLE_SIZE->defval));
+	sess->rxbuf = malloc(H2F_RXBUF);
+	AN(sess->rxbuf);
+
+	VTCP_blocking(sess->fd);
+
+	/* Preface, SETTINGS and the connection window in one write */
+	memcpy(buf, h2f_preface, sizeof h2f_preface - 1);
+	i = sizeof h2f_preface - 1;
+	vbe32enc(buf + i, 12 << 8);
+	buf[i + 3] = H2_F_SETTINGS->type;
+	buf[i + 4] = 0;
+	vbe32enc(buf + i + 5, 0);
+	i += 9;
+	vbe16enc(buf + i, H2_SET_ENABLE_PUSH->ident);
+	vbe32enc(buf + i + 2, 0);
+	vbe16enc(buf + i + 6, H2_SET_INITIAL_WINDOW_SIZE->ident);
+	vbe32enc(buf + i + 8, H2F_WINDOW);
+	i += 12;
+	assert(i == sizeof buf);
+	if (write(sess->fd, buf, sizeof buf) != sizeof buf)
+		sess->broken = 1;
+	else
+		h2f_send_winupd(sess, 0, H2F_CONN_WINDOW -
+		    H2_SET_INITIAL_WINDOW_SIZE->defval);
+	if (sess->broken) {
+		H2F_Close(&sess);
+		return (NULL);
+	}
+	return (sess);
+}
+
+/*
+ * Reserve a stream on the session, if it can take one more.
+ */
+
+int
+H2F_Reserve(struct h2f_sess *sess, unsigned max_streams)
+{
+	int r = 0;
+
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+	Lck_Lock(&sess->mtx);
+	if (!sess->broken && !sess->goaway &&
+	    sess->nstreams < vmin(max_streams, sess->peer_streams) &&
+	    sess->next_id + 2 * sess->nstreams < 0x7fffffff) {
+		sess->nstreams++;
+		r = 1;
+	}
+	Lck_Unlock(&sess->mtx);
+	return (r);
+}
+
+/*
+ * Can the session be closed?  Once this returned true, no streams can
+ * be reserved on it anymore.
+ */
+
+int
+H2F_Reapable(struct h2f_sess *sess, vtim_real now, vtim_dur idle)
+{
+	int r;
+
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+	Lck_Lock(&sess->mtx);
+	r = sess->nstreams == 0 &&
+	    (sess->broken || sess->goaway || now - sess->t_idle > idle);
+	if (r)
+		sess->goaway = 1;
+	Lck_Unlock(&sess->mtx);
+	return (r);
+}
+
+void
+H2F_Close(struct h2f_sess **sessp)
+{
+	struct h2f_sess *sess;
+	uint8_t buf[8];
+
+	TAKE_OBJ_NOTNULL(sess, sessp, H2F_SESS_MAGIC);
+	AZ(sess->nstreams);
+	assert(VTAILQ_EMPTY(&sess->streams));
+	if (!sess->broken) {
+		vbe32enc(buf, 0);
+		vbe32enc(buf + 4, H2CE_NO_ERROR->val);
+		(void)h2f_send(sess, H2_F_GOAWAY, 0, 0, buf, sizeof buf);
+	}
+	VCP_Close(&sess->pfd);
+	AZ(sess->pfd);
+	VHT_Fini(sess->dectbl);
+	free(sess->rxbuf);
+	free(sess->hblk);
+	PTOK(pthread_cond_destroy(&sess->cond));
+	Lck_Delete(&sess->tx_mtx);
+	Lck_Delete(&sess->mtx);
+	FREE_OBJ(sess);
+}
+
+/*--------------------------------------------------------------------
+ * Streams
+ */
+
+struct h2f_stream *
+H2F_Stream(struct h2f_sess *sess)
+{
+	struct h2f_stream *s;
+
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+	ALLOC_OBJ(s, H2F_STREAM_MAGIC);
+	AN(s);
+	s->sess = sess;
+	VTAILQ_INIT(&s->chunks);
+	return (s);
+}
+
+void
+H2F_Release(struct h2f_stream **sp)
+{
+	struct h2f_stream *s;
+	struct h2f_sess *sess;
+	struct h2f_chunk *c;
+	uint8_t buf[4];
+	int cancel;
+
+	TAKE_OBJ_NOTNULL(s, sp, H2F_STREAM_MAGIC);
+	sess = s->sess;
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+
+	Lck_Lock(&sess->mtx);
+	cancel = s->id > 0 && !s->eos && !s->reset && !sess->broken;
+	if (s->id > 0)
+		VTAILQ_REMOVE(&sess->streams, s, list);
+	Lck_Unlock(&sess->mtx);
+
+	if (cancel) {
+		vbe32enc(buf, H2SE_CANCEL->val);
+		(void)h2f_send(sess, H2_F_RST_STREAM, 0, s->id,
+		    buf, sizeof buf);
+	}
+
+	/* Give up the reservation last, the session may be reaped now */
+	Lck_Lock(&sess->mtx);
+	assert(sess->nstreams > 0);
+	sess->nstreams--;
+	if (sess->nstreams == 0)
+		sess->t_idle = VTIM_real();
+	Lck_Unlock(&sess->mtx);
+
+	while ((c = VTAILQ_FIRST(&s->chunks)) != NULL) {
+		VTAILQ_REMOVE(&s->chunks, c, list);
+		free(c);
+	}
+	free(s->hdr);
+	FREE_OBJ(s);
+}
+
+struct pfd *
+H2F_Pfd(const struct h2f_stream *s)
+{
+
+	CHECK_OBJ_NOTNULL(s, H2F_STREAM_MAGIC);
+	CHECK_OBJ_NOTNULL(s->sess, H2F_SESS_MAGIC);
+	return (s->sess->pfd);
+}
+
+uint64_t
+H2F_Reused(const struct h2f_stream *s)
+{
+
+	CHECK_OBJ_NOTNULL(s, H2F_STREAM_MAGIC);
+	CHECK_OBJ_NOTNULL(s->sess, H2F_SESS_MAGIC);
+	return (s->sess->nreq);
+}
+
+/*--------------------------------------------------------------------
+ * Request headers: a literal without indexing for every field
+ */
+
+static void
+h2f_enc_int(struct vsb *vsb, uint8_t first, unsigned bits, size_t v)
+{
+	unsigned max = (1U << bits) - 1;
+
+	if (v < max) {
+		VSB_putc(vsb, first | v);
+		return;
+	}
+	VSB_putc(vsb, first | max);
+	v -= max;
+	while (v >= 0x80) {
+		VSB_putc(vsb, 0x80 | (v & 0x7f));
+		v >>= 7;
+	}
+	VSB_putc(vsb, v);
+}
+
+static void
+h2f_enc_str(struct vsb *vsb, const char *b, size_t l, int lower)
+{
+
+	h2f_enc_int(vsb, 0x00, 7, l);
+	for (; l > 0; l--, b++)
+		VSB_putc(vsb, lower ? tolower(*b) : *b);
+}
+
+static void
+h2f_enc_field(struct vsb *vsb, const char *n, size_t nl, const char *v,
+    size_t vl)
+{
+
+	VSB_putc(vsb, 0x00);
+	h2f_enc_str(vsb, n, nl, 1);
+	h2f_enc_str(vsb, v, vl, 0);
+}
+
+static void
+h2f_enc_req(struct vsb *vsb, const struct http *hp)
+{
+	const char *p, *v, *e;
+	unsigned u;
+
+	h2f_enc_field(vsb, ":method", 7, hp->hd[HTTP_HDR_METHOD].b,
+	    Tlen(hp->hd[HTTP_HDR_METHOD]));
+	h2f_enc_field(vsb, ":scheme", 7, "http", 4);
+	h2f_enc_field(vsb, ":path", 5, hp->hd[HTTP_HDR_URL].b,
+	    Tlen(hp->hd[HTTP_HDR_URL]));
+	if (http_GetHdr(hp, H_Host, &p))
+		h2f_enc_field(vsb, ":authority", 10, p, strlen(p));
+
+	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
+		if (hp->hd[u].b == NULL)
+			continue;
+		/* Connection-specific fields are not allowed [RFC9113 8.2.2] */
+		if (http_IsHdr(&hp->hd[u], H_Host) ||
+		    http_IsHdr(&hp->hd[u], H_Connection) ||
+		    http_IsHdr(&hp->hd[u], H_Keep_Alive) ||
+		    http_IsHdr(&hp->hd[u], H_Transfer_Encoding) ||
+		    http_IsHdr(&hp->hd[u], H_Upgrade) ||
+		    http_IsHdr(&hp->hd[u], H_TE))
+			continue;
+		p = hp->hd[u].b;
+		v = strchr(p, ':');
+		if (v == NULL)
+			continue;
+		e = v + 1;
+		while (vct_islws(*e))
+			e++;
+		h2f_enc_field(vsb, p, v - p, e, strlen(e));
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Request body
+ */
+
+static int v_matchproto_(vdp_bytes_f)
+h2f_bytes(struct vdp_ctx *vdc, enum vdp_action act, void **priv,
+    const void *ptr, ssize_t len)
+{
+	struct h2f_stream *s;
+	struct h2f_sess *sess;
+	const uint8_t *p = ptr;
+	ssize_t l;
+
+	CHECK_OBJ_NOTNULL(vdc, VDP_CTX_MAGIC);
+	CAST_OBJ_NOTNULL(s, *priv, H2F_STREAM_MAGIC);
+	sess = s->sess;
+	(void)act;
+
+	while (len > 0) {
+		if (h2f_wait(s, vdc->vsl, VTIM_real() + s->tmo,
+		    h2f_ready_window) || s->reset || sess->broken) {
+			Lck_Unlock(&sess->mtx);
+			return (-1);
+		}
+		l = vmin_t(ssize_t, len, sess->peer_frame);
+		l = vmin_t(ssize_t, l, s->t_window);
+		l = vmin_t(ssize_t, l, sess->t_window);
+		s->t_window -= l;
+		sess->t_window -= l;
+		Lck_Unlock(&sess->mtx);
+		if (h2f_send(sess, H2_F_DATA, 0, s->id, p, l))
+			return (-1);
+		vdc->bytes_done += l;
+		p += l;
+		len -= l;
+	}
+	return (0);
+}
+
+static int v_matchproto_(vdp_fini_f)
+h2f_fini(struct vdp_ctx *vdc, void **priv)
+{
+
+	CHECK_OBJ_NOTNULL(vdc, VDP_CTX_MAGIC);
+	AN(priv);
+	*priv = NULL;
+	return (0);
+}
+
+static const struct vdp h2f_vdp = {
+	.name =		"H2F",
+	.bytes =	h2f_bytes,
+	.fini =		h2f_fini,
+};
+
+/*--------------------------------------------------------------------
+ * Send request to backend, including any (cached) req.body
+ *
+ * Return value:
+ *	 0 success
+ *	 1 failure, the stream never made it to the backend
+ *	-1 failure
+ */
+
+int
+H2F_SendReq(struct worker *wrk, struct busyobj *bo, uint64_t *ctr_hdrbytes,
+    uint64_t *ctr_bodybytes)
+{
+	struct http_conn *htc;
+	struct h2f_stream *s;
+	struct h2f_sess *sess;
+	struct vsb *vsb;
+	struct vdp_ctx vdc[1] = {{ 0 }};
+	struct vrt_ctx ctx[1];
+	const char *p, *err = NULL;
+	intmax_t cl;
+	ssize_t l, o;
+	int body, i = 0;
+	uint8_t flags;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	htc = bo->htc;
+	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
+	CAST_OBJ_NOTNULL(s, htc->priv, H2F_STREAM_MAGIC);
+	sess = s->sess;
+	CHECK_OBJ_NOTNULL(sess, H2F_SESS_MAGIC);
+	CHECK_OBJ_ORNULL(bo->req, REQ_MAGIC);
+	AN(ctr_hdrbytes);
+	AN(ctr_bodybytes);
+	AZ(s->id);
+
+	body = bo->bereq_body != NULL || (bo->req != NULL &&
+	    bo->req->req_body_status != BS_NONE);
+	if (bo->bereq_body != NULL)
+		cl = ObjGetLen(wrk, bo->bereq_body);
+	else if (bo->req != NULL && !bo->req->req_body_status->length_known)
+		cl = -1;
+	else if (bo->req != NULL)
+		cl = vmax_t(intmax_t, http_GetContentLength(bo->req->http), 0);
+	else
+		cl = 0;
+
+	VDP_Init(vdc, wrk, bo->vsl, NULL, bo, &cl);
+	INIT_OBJ(ctx, VRT_CTX_MAGIC);
+	VCL_Bo2Ctx(ctx, bo);
+	if (bo->vdp_filter_list != NULL &&
+	    VCL_StackVDP(vdc, bo->vcl, bo->vdp_filter_list, NULL, bo))
+		err = "Failure to push processors";
+	else if (VDP_Push(ctx, vdc, ctx->ws, &h2f_vdp, s))
+		err = "Failure to push H2F";
+	if (err != NULL) {
+		(void)VDP_Close(vdc, NULL, NULL);
+		VSLb(bo->vsl, SLT_FetchError, "%s", err);
+		VSLb_ts_busyobj(bo, "Bereq", W_TIM_real(wrk));
+		htc->doclose = SC_OVERLOAD;
+		return (-1);
+	}
+
+	vsb = VSB_new_auto();
+	AN(vsb);
+	h2f_enc_req(vsb, bo->bereq);
+	AZ(VSB_finish(vsb));
+
+	/* Stream ids must hit the wire in order */
+	Lck_Lock(&sess->tx_mtx);
+	Lck_Lock(&sess->mtx);
+	if (sess->broken || sess->goaway) {
+		Lck_Unlock(&sess->mtx);
+		Lck_Unlock(&sess->tx_mtx);
+		VSB_destroy(&vsb);
+		(void)VDP_Close(vdc, NULL, NULL);
+		VSLb(bo->vsl, SLT_FetchError, "h2: session closed");
+		htc->doclose = SC_TX_ERROR;
+		return (1);
+	}
+	s->id = sess->next_id;
+	sess->next_id += 2;
+	sess->nreq++;
+	s->t_window = sess->peer_window;
+	s->tmo = htc->first_byte_timeout;
+	VTAILQ_INSERT_TAIL(&sess->streams, s, list);
+	Lck_Unlock(&sess->mtx);
+
+	p = VSB_data(vsb);
+	l = VSB_len(vsb);
+	flags = body ? 0 : H2FF_HEADERS_END_STREAM;
+	for (o = 0; i == 0 && (o == 0 || o < l); o += sess->peer_frame) {
+		if (l - o <= sess->peer_frame)
+			flags |= H2FF_HEADERS_END_HEADERS;
+		i = h2f_write(sess, o == 0 ? H2_F_HEADERS : H2_F_CONTINUATION,
+		    o == 0 ? flags : flags & H2FF_HEADERS_END_HEADERS, s->id,
+		    p + o, vmin_t(ssize_t, l - o, sess->peer_frame));
+		*ctr_hdrbytes += 9;
+	}
+	Lck_Unlock(&sess->tx_mtx);
+	*ctr_hdrbytes += l;
+	VSB_destroy(&vsb);
+	if (i)
+		h2f_broken(sess);
+
+	if (i == 0 && bo->bereq_body != NULL) {
+		AZ(bo->req);
+		i = ObjIterate(bo->wrk, bo->bereq_body,
+		    vdc, VDP_ObjIterate, 0);
+	} else if (i == 0 && body) {
+		i = VRB_Iterate(wrk, bo->vsl, bo->req, VDP_ObjIterate, vdc);
+
+		if (bo->req->req_body_status != BS_CACHED)
+			bo->no_retry = "req.body not cached";
+
+		if (bo->req->req_body_status == BS_ERROR) {
+			assert(i < 0);
+			VSLb(bo->vsl, SLT_FetchError,
+			    "req.body read error: %d (%s)",
+			    errno, VAS_errtxt(errno));
+			bo->req->doclose = SC_RX_BODY;
+			bo->err_code = 400;
+		}
+	}
+	if (i == 0 && body)
+		i = h2f_send(sess, H2_F_DATA, H2FF_DATA_END_STREAM, s->id,
+		    NULL, 0);
+
+	*ctr_bodybytes += VDP_Close(vdc, NULL, NULL);
+	VSLb_ts_busyobj(bo, "Bereq", W_TIM_real(wrk));
+
+	if (i != 0) {
+		VSLb(bo->vsl, SLT_FetchError, "h2: backend write error");
+		htc->doclose = SC_TX_ERROR;
+		return (-1);
+	}
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Response body
+ */
+
+static enum vfp_status v_matchproto_(vfp_pull_f)
+h2f_pull(struct vfp_ctx *vc, struct vfp_entry *vfe, void *p, ssize_t *lp)
+{
+	struct h2f_stream *s;
+	struct h2f_sess *sess;
+	struct h2f_chunk *c;
+	enum vfp_status vfps = VFP_OK;
+	uint32_t winupd = 0;
+	ssize_t l, n = 0;
+	uint8_t *q = p;
+
+	CHECK_OBJ_NOTNULL(vc, VFP_CTX_MAGIC);
+	CHECK_OBJ_NOTNULL(vfe, VFP_ENTRY_MAGIC);
+	CAST_OBJ_NOTNULL(s, vfe->priv1, H2F_STREAM_MAGIC);
+	sess = s->sess;
+	AN(p);
+	AN(lp);
+
+	l = *lp;
+	*lp = 0;
+	if (h2f_wait(s, vc->wrk->vsl, VTIM_real() + s->tmo, h2f_ready_data)) {
+		Lck_Unlock(&sess->mtx);
+		return (VFP_Error(vc, "h2: between bytes timeout"));
+	}
+	while (n < l && (c = VTAILQ_FIRST(&s->chunks)) != NULL) {
+		if (c->len - c->off > (size_t)(l - n)) {
+			memcpy(q + n, c->data + c->off, l - n);
+			c->off += l - n;
+			n = l;
+			break;
+		}
+		memcpy(q + n, c->data + c->off, c->len - c->off);
+		n += c->len - c->off;
+		VTAILQ_REMOVE(&s->chunks, c, list);
+		free(c);
+	}
+	s->r_unacked += n;
+	if (!s->eos && s->r_unacked >= H2F_WINDOW / 2) {
+		winupd = s->r_unacked;
+		s->r_unacked = 0;
+	}
+	if (VTAILQ_EMPTY(&s->chunks) && s->eos)
+		vfps = VFP_END;
+	else if (n == 0 && (s->reset || sess->broken))
+		vfps = VFP_ERROR;
+	Lck_Unlock(&sess->mtx);
+
+	if (winupd)
+		h2f_send_winupd(sess, s->id, winupd);
+
+	if (vfps == VFP_ERROR)
+		return (VFP_Error(vc, "h2: stream reset (%u)", s->rst_code));
+	if (vfe->priv2 >= 0) {
+		if (n > vfe->priv2 || (vfps == VFP_END && n != vfe->priv2))
+			return (VFP_Error(vc,
+			    "h2: body does not match Content-Length"));
+		vfe->priv2 -= n;
+	}
+	*lp = n;
+	return (vfps);
+}
+
+static const struct vfp h2f_vfp = {
+	.name = "H2F",
+	.pull = h2f_pull,
+};
+
+/*--------------------------------------------------------------------
+ * Check a decoded "name: value" response field like we check them on
+ * the client side, and also reject what an HTTP/1 response could not
+ * carry.  The :status pseudo-header must come first, and only once.
+ */
+
+static const char * const h2f_conn_hdrs[] = {
+	"connection",
+	"keep-alive",
+	"proxy-connection",
+	"te",
+	"transfer-encoding",
+	"upgrade",
+	NULL
+};
+
+static int
+h2f_hdreq(txt nm, const char *s)
+{
+
+	return (Tlen(nm) == strlen(s) && !Tstrcmp(nm, s));
+}
+
+static int
+h2f_checkhdr(struct vsl_log *vsl, const char *b, unsigned *status)
+{
+	const char * const *h;
+	txt nm, val;
+	char *p;
+
+	AN(b);
+	AN(status);
+	nm.b = b;
+	nm.e = strchr(b + 1, ':');
+	AN(nm.e);
+	assert(nm.e[1] == ' ');
+	val.b = nm.e + 2;
+	val.e = strchr(val.b, '\0');
+
+	if (h2h_checkhdr(vsl, nm, val) != NULL) {
+		VSLb(vsl, SLT_FetchError, "h2: bad header field");
+		return (-1);
+	}
+	if (*b == ':') {
+		if (*status != 0 || !h2f_hdreq(nm, ":status")) {
+			VSLb(vsl, SLT_FetchError,
+			    "h2: unexpected pseudo-header %.*s",
+			    (int)Tlen(nm), nm.b);
+			return (-1);
+		}
+		*status = (unsigned)strtoul(val.b, &p, 10);
+		if (p == val.b || *p != '\0' || *status < 100 ||
+		    *status > 999) {
+			VSLb(vsl, SLT_FetchError, "h2: bad :status");
+			return (-1);
+		}
+		return (0);
+	}
+	if (*status == 0) {
+		VSLb(vsl, SLT_FetchError, "h2: :status missing or late");
+		return (-1);
+	}
+	for (h = h2f_conn_hdrs; *h != NULL; h++) {
+		if (h2f_hdreq(nm, *h)) {
+			VSLb(vsl, SLT_FetchError,
+			    "h2: connection-specific header %s", *h);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Receive response headers
+ *
+ * Return value as H2F_SendReq()
+ */
+
+int
+H2F_FetchRespHdr(struct busyobj *bo)
+{
+	struct http_conn *htc;
+	struct h2f_stream *s;
+	struct h2f_sess *sess;
+	struct vfp_entry *vfe;
+	struct http *hp;
+	char *b, *e;
+	unsigned status = 0;
+	int i;
+
+	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
+	htc = bo->htc;
+	CHECK_OBJ_NOTNULL(htc, HTTP_CONN_MAGIC);
+	CAST_OBJ_NOTNULL(s, htc->priv, H2F_STREAM_MAGIC);
+	sess = s->sess;
+	hp = bo->beresp;
+
+	VSC_C_main->backend_req++;
+
+	i = h2f_wait(s, bo->vsl, VTIM_real() + htc->first_byte_timeout,
+	    h2f_ready_hdr);
+	if (i == 0 && !s->hdr_done) {
+		if (s->refused) {
+			VSLb(bo->vsl, SLT_FetchError, "h2: stream refused");
+			i = 1;
+		} else {
+			VSLb(bo->vsl, SLT_FetchError,
+			    "h2: stream closed without headers (%u)",
+			    s->rst_code);
+			i = s->id > 1 && sess->broken ? 1 : -1;
+		}
+	} else if (i) {
+		VSLb(bo->vsl, SLT_FetchError, "first byte timeout");
+		htc->doclose = SC_RX_TIMEOUT;
+		i = -1;
+	}
+	Lck_Unlock(&sess->mtx);
+	if (i) {
+		if (htc->doclose == SC_NULL)
+			htc->doclose = SC_RX_BAD;
+		return (i);
+	}
+	s->tmo = htc->between_bytes_timeout;
+
+	bo->acct.beresp_hdrbytes += s->hdr_len;
+	b = WS_Copy(bo->ws, s->hdr, s->hdr_len);
+	if (b == NULL) {
+		VSLb(bo->vsl, SLT_FetchError, "overflow");
+		htc->doclose = SC_RX_OVERFLOW;
+		return (-1);
+	}
+	if (s->hdr_bad) {
+		VSLb(bo->vsl, SLT_FetchError, "h2: bad header field");
+		htc->doclose = SC_RX_JUNK;
+		return (-1);
+	}
+	for (e = b + s->hdr_len; b < e; b += strlen(b) + 1) {
+		if (h2f_checkhdr(bo->vsl, b, &status)) {
+			htc->doclose = SC_RX_JUNK;
+			return (-1);
+		}
+		if (*b != ':')
+			http_SetHeader(hp, b);
+	}
+	if (status < 100 || status > 999) {
+		VSLb(bo->vsl, SLT_FetchError, "h2: bad :status");
+		htc->doclose = SC_RX_JUNK;
+		return (-1);
+	}
+	http_PutResponse(hp, "HTTP/2.0", status, NULL);
+
+	htc->content_length = http_GetContentLength(hp);
+	if (http_method_eq(bo->bereq->wkm, WKM_HEAD)) {
+		bo->wrk->stats->fetch_head++;
+		htc->body_status = BS_NONE;
+	} else if (status == 204) {
+		bo->wrk->stats->fetch_204++;
+		htc->body_status = BS_NONE;
+	} else if (status == 304) {
+		bo->wrk->stats->fetch_304++;
+		htc->body_status = BS_NONE;
+	} else if (htc->content_length == 0 || (htc->content_length < 0 &&
+	    s->eos && VTAILQ_EMPTY(&s->chunks))) {
+		bo->wrk->stats->fetch_none++;
+		htc->body_status = BS_NONE;
+	} else if (htc->content_length > 0) {
+		bo->wrk->stats->fetch_length++;
+		htc->body_status = BS_LENGTH;
+	} else {
+		bo->wrk->stats->fetch_eof++;
+		htc->body_status = BS_EOF;
+	}
+
+	if (htc->body_status != BS_NONE) {
+		vfe = VFP_Push(bo->vfc, &h2f_vfp);
+		if (vfe == NULL) {
+			VSLb(bo->vsl, SLT_FetchError, "overflow");
+			htc->doclose = SC_RX_OVERFLOW;
+			return (-1);
+		}
+		vfe->priv1 = s;
+		vfe->priv2 = htc->content_length;
+	}
+	return (0);
+}
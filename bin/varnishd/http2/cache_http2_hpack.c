@@ -52,7 +52,7 @@ h2h_assert_ready(const struct h2h_decode *d)
 }
 
 // rfc9113,l,2493,2528
-static h2_error
+h2_error
 h2h_checkhdr(struct vsl_log *vsl, txt nm, txt val)
 {
 	const char *p;
@@ -34,6 +34,8 @@
 
 #include "cache/cache_varnishd.h"
 
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "vbh.h"
@@ -137,7 +139,8 @@ Wait_HeapDue(const struct waiter *w, struct waited **wpp)
 
 	wp = VBH_root(w->heap);
 	CHECK_OBJ_ORNULL(wp, WAITED_MAGIC);
-	if (wp == NULL) {
+	/* An infinite timeout at the root means none are due, ever */
+	if (wp == NULL || isinf(Wait_When(wp))) {
 		if (wpp != NULL)
 			*wpp = NULL;
 		return (0);
@@ -158,6 +161,10 @@ Wait_Enter(const struct waiter *w, struct waited *wp)
 	assert(wp->fd > 0);			// stdin never comes here
 	AN(wp->func);
 	wp->idx = VBH_NOIDX;
+	/* Always the same shard for an fd, the waiter may know it */
+	if (w->nshard > 1)
+		w = w->shard[wp->fd % w->nshard];
+	CHECK_OBJ_NOTNULL(w, WAITER_MAGIC);
 	return (w->impl->enter(w->priv, wp));
 }
 
@@ -173,8 +180,8 @@ Waiter_GetName(void)
 		return ("(No Waiter?)");
 }
 
-struct waiter *
-Waiter_New(const char *name)
+static struct waiter *
+waiter_new(const char *name)
 {
 	struct waiter *w;
 
@@ -201,8 +208,8 @@ Waiter_New(const char *name)
 	return (w);
 }
 
-void
-Waiter_Destroy(struct waiter **wp)
+static void
+waiter_destroy(struct waiter **wp)
 {
 	struct waiter *w;
 
@@ -213,3 +220,46 @@ Waiter_Destroy(struct waiter **wp)
 	w->impl->fini(w);
 	FREE_OBJ(w);
 }
+
+/*
+ * Each waiter has a single thread, with thread_pool_waiters above one
+ * the connections are spread over that many waiters by file descriptor.
+ */
+
+struct waiter *
+Waiter_New(const char *name)
+{
+	struct waiter *w;
+	char nb[64];
+	unsigned u;
+
+	w = waiter_new(name);
+	w->nshard = cache_param->wthread_waiters;
+	if (w->nshard > 1) {
+		w->shard = calloc(w->nshard, sizeof *w->shard);
+		AN(w->shard);
+		w->shard[0] = w;
+		for (u = 1; u < w->nshard; u++) {
+			bprintf(nb, "%s_%u", name, u);
+			w->shard[u] = waiter_new(nb);
+		}
+	}
+	return (w);
+}
+
+void
+Waiter_Destroy(struct waiter **wp)
+{
+	struct waiter *w;
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(*wp, WAITER_MAGIC);
+	w = *wp;
+	if (w->shard != NULL) {
+		assert(w->shard[0] == w);
+		for (u = 1; u < w->nshard; u++)
+			waiter_destroy(&w->shard[u]);
+		free(w->shard);
+	}
+	waiter_destroy(wp);
+}
@@ -39,6 +39,7 @@
 #include <stdlib.h>
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 
 #include "cache/cache_varnishd.h"
@@ -52,6 +53,7 @@
 #endif
 
 #define NEEV	8192
+#define NEXP	64
 
 struct vwe {
 	unsigned		magic;
@@ -60,13 +62,57 @@ struct vwe {
 	struct waiter		*waiter;
 	pthread_t		thread;
 	double			next;
-	int			pipe[2];
+	int			efd;
 	unsigned		nwaited;
 	int			die;
 	struct lock		mtx;
 };
 
-/*--------------------------------------------------------------------*/
+/*--------------------------------------------------------------------
+ * Fds are registered with EPOLLONESHOT, so an event disables the fd
+ * without an EPOLL_CTL_DEL and vwe_enter() rearms it with EPOLL_CTL_MOD
+ * when the connection comes back.  Closing the fd removes it from the
+ * epoll set.
+ */
+
+static void
+vwe_expire(struct vwe *vwe, double now)
+{
+	struct waited *wp, *exp[NEXP];
+	struct waiter *w;
+	double then;
+	int i, n;
+
+	w = vwe->waiter;
+	do {
+		/* Take timeouts off the heap in batches under one lock */
+		Lck_Lock(&vwe->mtx);
+		for (n = 0; n < NEXP; n++) {
+			then = Wait_HeapDue(w, &wp);
+			if (wp == NULL) {
+				vwe->next = now + 100;
+				break;
+			} else if (then > now) {
+				vwe->next = then;
+				break;
+			}
+			CHECK_OBJ_NOTNULL(wp, WAITED_MAGIC);
+			AN(vwe->nwaited);
+			vwe->nwaited--;
+			AN(Wait_HeapDelete(w, wp));
+			exp[n] = wp;
+		}
+		Lck_Unlock(&vwe->mtx);
+		for (i = 0; i < n; i++) {
+			/*
+			 * XXX: We could avoid many syscalls here if we were
+			 * XXX: allowed to just close the fd's on timeout.
+			 */
+			AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_DEL, exp[i]->fd, NULL));
+			Wait_Call(w, exp[i], WAITER_TIMEOUT, now);
+		}
+	} while (n == NEXP);
+}
 
 static void *
 vwe_thread(void *priv)
@@ -75,8 +121,9 @@ vwe_thread(void *priv)
 	struct waited *wp;
 	struct waiter *w;
 	double now, then;
-	int i, n, active;
+	int i, n;
 	struct vwe *vwe;
+	uint64_t u;
 	char c;
 
 	CAST_OBJ_NOTNULL(vwe, priv, VWE_MAGIC);
@@ -89,32 +136,12 @@ vwe_thread(void *priv)
 
 	now = VTIM_real();
 	while (1) {
-		while (1) {
-			Lck_Lock(&vwe->mtx);
-			/*
-			 * XXX: We could avoid many syscalls here if we were
-			 * XXX: allowed to just close the fd's on timeout.
-			 */
-			then = Wait_HeapDue(w, &wp);
-			if (wp == NULL) {
-				vwe->next = now + 100;
-				break;
-			} else if (then > now) {
-				vwe->next = then;
-				break;
-			}
-			CHECK_OBJ_NOTNULL(wp, WAITED_MAGIC);
-			AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_DEL, wp->fd, NULL));
-			AN(vwe->nwaited);
-			vwe->nwaited--;
-			AN(Wait_HeapDelete(w, wp));
-			Lck_Unlock(&vwe->mtx);
-			Wait_Call(w, wp, WAITER_TIMEOUT, now);
-		}
+		vwe_expire(vwe, now);
+		Lck_Lock(&vwe->mtx);
 		then = vwe->next - now;
+		Lck_Unlock(&vwe->mtx);
 		i = (int)ceil(1e3 * then);
 		assert(i > 0);
-		Lck_Unlock(&vwe->mtx);
 		do {
 			/* Due to a linux kernel bug, epoll_wait can
 			   return EINTR when the process is subjected to
@@ -124,25 +151,32 @@ vwe_thread(void *priv)
 		assert(n >= 0);
 		assert(n <= NEEV);
 		now = VTIM_real();
+
+		/* Take all ready fds off the heap under one lock */
+		Lck_Lock(&vwe->mtx);
 		for (ep = ev, i = 0; i < n; i++, ep++) {
-			if (ep->data.ptr == vwe) {
-				assert(read(vwe->pipe[0], &c, 1) == 1);
+			if (ep->data.ptr == vwe)
 				continue;
-			}
 			CAST_OBJ_NOTNULL(wp, ep->data.ptr, WAITED_MAGIC);
-			Lck_Lock(&vwe->mtx);
-			active = Wait_HeapDelete(w, wp);
-			if (active != 0) {
+			if (Wait_HeapDelete(w, wp)) {
 				AN(vwe->nwaited);
 				vwe->nwaited--;
+			} else
+				ep->events = 0;
+		}
+		Lck_Unlock(&vwe->mtx);
+
+		for (ep = ev, i = 0; i < n; i++, ep++) {
+			if (ep->data.ptr == vwe) {
+				assert(read(vwe->efd, &u, sizeof u) == sizeof u);
+				continue;
 			}
-			Lck_Unlock(&vwe->mtx);
-			if (active == 0) {
+			CAST_OBJ_NOTNULL(wp, ep->data.ptr, WAITED_MAGIC);
+			if (ep->events == 0) {
 				VSL(SLT_Debug, NO_VXID,
 				    "epoll: spurious event (%d)", wp->fd);
 				continue;
 			}
-			AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_DEL, wp->fd, NULL));
 			if (ep->events & EPOLLIN) {
 				if (ep->events & EPOLLRDHUP &&
 				    recv(wp->fd, &c, 1, MSG_PEEK) == 0)
@@ -160,31 +194,44 @@ vwe_thread(void *priv)
 			break;
 	}
 	free(ev);
-	closefd(&vwe->pipe[0]);
-	closefd(&vwe->pipe[1]);
+	closefd(&vwe->efd);
 	closefd(&vwe->epfd);
 	return (NULL);
 }
 
 /*--------------------------------------------------------------------*/
 
+static void
+vwe_poke(const struct vwe *vwe)
+{
+	uint64_t u = 1;
+
+	assert(write(vwe->efd, &u, sizeof u) == sizeof u);
+}
+
 static int v_matchproto_(waiter_enter_f)
 vwe_enter(void *priv, struct waited *wp)
 {
 	struct vwe *vwe;
 	struct epoll_event ee;
+	int poke;
 
 	CAST_OBJ_NOTNULL(vwe, priv, VWE_MAGIC);
-	ee.events = EPOLLIN | EPOLLRDHUP;
+	ee.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
 	ee.data.ptr = wp;
 	Lck_Lock(&vwe->mtx);
 	vwe->nwaited++;
 	Wait_HeapInsert(vwe->waiter, wp);
-	AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_ADD, wp->fd, &ee));
-	/* If the epoll isn't due before our timeout, poke it via the pipe */
-	if (Wait_When(wp) < vwe->next)
-		assert(write(vwe->pipe[1], "X", 1) == 1);
+	/* Rearm an fd we have seen before, otherwise add it */
+	if (epoll_ctl(vwe->epfd, EPOLL_CTL_MOD, wp->fd, &ee)) {
+		assert(errno == ENOENT);
+		AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_ADD, wp->fd, &ee));
+	}
+	/* If the epoll isn't due before our timeout, poke it */
+	poke = Wait_When(wp) < vwe->next;
 	Lck_Unlock(&vwe->mtx);
+	if (poke)
+		vwe_poke(vwe);
 	return (0);
 }
 
@@ -204,10 +251,11 @@ vwe_init(struct waiter *w)
 	vwe->epfd = epoll_create(1);
 	assert(vwe->epfd >= 0);
 	Lck_New(&vwe->mtx, lck_waiter);
-	AZ(pipe(vwe->pipe));
-	ee.events = EPOLLIN | EPOLLRDHUP;
+	vwe->efd = eventfd(0, EFD_CLOEXEC);
+	assert(vwe->efd >= 0);
+	ee.events = EPOLLIN;
 	ee.data.ptr = vwe;
-	AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_ADD, vwe->pipe[0], &ee));
+	AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_ADD, vwe->efd, &ee));
 
 	PTOK(pthread_create(&vwe->thread, NULL, vwe_thread, vwe));
 }
@@ -227,8 +275,8 @@ vwe_fini(struct waiter *w)
 
 	Lck_Lock(&vwe->mtx);
 	vwe->die = 1;
-	assert(write(vwe->pipe[1], "Y", 1) == 1);
 	Lck_Unlock(&vwe->mtx);
+	vwe_poke(vwe);
 	PTOK(pthread_join(vwe->thread, &vp));
 	Lck_Delete(&vwe->mtx);
 }
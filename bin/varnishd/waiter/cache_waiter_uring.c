@@ -0,0 +1,472 @@
+/*-
+ * Copyright (c) 2026 Varnish Software AS
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Linux io_uring(7) based waiter, talking to the kernel directly rather
+ * than through liburing.
+ *
+ * Each waited fd gets a single shot IORING_OP_POLL_ADD, which is
+ * submitted by the thread calling Wait_Enter() and comes back as exactly
+ * one completion.  Timeouts cancel the poll with IORING_OP_POLL_REMOVE
+ * and are only reported once that completion arrived, so the kernel
+ * never holds on to a struct waited we have given back.  The waiter
+ * thread itself only calls io_uring_enter(2) to wait, and gets all
+ * completions which piled up in the meantime without further syscalls.
+ */
+
+#include "config.h"
+
+#if defined(HAVE_IO_URING)
+
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+
+#include "cache/cache_varnishd.h"
+
+#include "waiter/waiter.h"
+#include "waiter/waiter_priv.h"
+#include "vtim.h"
+
+#ifndef POLLRDHUP
+#  define POLLRDHUP 0
+#endif
+
+#define NSQE	256
+#define NCQE	8192
+#define NEXP	64
+
+struct vwu_ev {
+	struct waited		*wp;
+	int			res;
+	unsigned		timeout;
+};
+
+struct vwu {
+	unsigned		magic;
+#define VWU_MAGIC		0x5a1b9c3e
+	int			fd;
+	struct waiter		*waiter;
+	pthread_t		thread;
+	double			next;
+	unsigned		nwaited;
+	int			die;
+	struct lock		mtx;
+	pthread_cond_t		cond;
+	unsigned		reaped;
+
+	/* Submission queue, protected by mtx */
+	unsigned		*sq_head;
+	unsigned		*sq_tail;
+	unsigned		sq_mask;
+	unsigned		*sq_array;
+	struct io_uring_sqe	*sqes;
+	unsigned		sq_pending;
+
+	/* Completion queue, only touched by the waiter thread */
+	unsigned		*cq_head;
+	unsigned		*cq_tail;
+	unsigned		cq_mask;
+	struct io_uring_cqe	*cqes;
+
+	void			*sq_ring;
+	size_t			sq_ring_sz;
+	void			*cq_ring;
+	size_t			cq_ring_sz;
+	size_t			sqes_sz;
+};
+
+/*--------------------------------------------------------------------*/
+
+static int
+vwu_setup(unsigned entries, struct io_uring_params *p)
+{
+	return ((int)syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+vwu_syscall(const struct vwu *vwu, unsigned to_submit, unsigned min_complete,
+    unsigned flags, const void *arg, size_t argsz)
+{
+	return ((int)syscall(__NR_io_uring_enter, vwu->fd, to_submit,
+	    min_complete, flags, arg, argsz));
+}
+
+/*--------------------------------------------------------------------
+ * Queue an sqe, must hold vwu->mtx
+ */
+
+static void
+vwu_sqe(struct vwu *vwu, uint8_t op, int fd, uint64_t addr, uint64_t udata)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx;
+
+	Lck_AssertHeld(&vwu->mtx);
+	tail = *vwu->sq_tail;
+	assert(tail - __atomic_load_n(vwu->sq_head, __ATOMIC_ACQUIRE) <=
+	    vwu->sq_mask);
+	idx = tail & vwu->sq_mask;
+	sqe = &vwu->sqes[idx];
+	memset(sqe, 0, sizeof *sqe);
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->addr = addr;
+	sqe->user_data = udata;
+	if (op == IORING_OP_POLL_ADD)
+		sqe->poll_events = POLLIN | POLLRDHUP;
+	vwu->sq_array[idx] = idx;
+	__atomic_store_n(vwu->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	vwu->sq_pending++;
+}
+
+/*--------------------------------------------------------------------
+ * Hand the queued sqes to the kernel, must hold vwu->mtx
+ *
+ * While completions wait for room in the cq ring, the kernel refuses
+ * submissions with EBUSY.  Only the waiter thread makes that room, so
+ * we return non-zero and leave the sqes queued instead of retrying.
+ */
+
+static int
+vwu_submit(struct vwu *vwu)
+{
+	int i;
+
+	Lck_AssertHeld(&vwu->mtx);
+	while (vwu->sq_pending > 0) {
+		i = vwu_syscall(vwu, vwu->sq_pending, 0, 0, NULL, 0);
+		if (i < 0 && errno == EBUSY)
+			return (1);
+		if (i < 0) {
+			assert(errno == EINTR || errno == EAGAIN);
+			continue;
+		}
+		assert((unsigned)i <= vwu->sq_pending);
+		vwu->sq_pending -= i;
+	}
+	return (0);
+}
+
+/*--------------------------------------------------------------------
+ * Submit everything queued, for threads other than the waiter thread.
+ * If the kernel is busy, give up the lock until the waiter thread has
+ * reaped completions and try again.
+ */
+
+static void
+vwu_flush(struct vwu *vwu)
+{
+	unsigned reaped;
+
+	Lck_AssertHeld(&vwu->mtx);
+	AZ(pthread_equal(pthread_self(), vwu->thread));
+	while (vwu_submit(vwu)) {
+		reaped = vwu->reaped;
+		do
+			(void)Lck_CondWait(&vwu->cond, &vwu->mtx);
+		while (reaped == vwu->reaped);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Timeouts are taken off the heap and their poll is cancelled.  The
+ * session is handed back when the cancelled poll completes.
+ *
+ * If the kernel is busy, we leave the rest for after the next reap, so
+ * a new batch is only queued when nothing from us is still pending.
+ */
+
+static void
+vwu_expire(struct vwu *vwu, double now)
+{
+	struct waited *wp;
+	struct waiter *w;
+	double then;
+	int n;
+
+	w = vwu->waiter;
+	Lck_Lock(&vwu->mtx);
+	do {
+		if (vwu_submit(vwu)) {
+			vwu->next = now;
+			break;
+		}
+		for (n = 0; n < NEXP; n++) {
+			then = Wait_HeapDue(w, &wp);
+			if (wp == NULL) {
+				vwu->next = now + 100;
+				break;
+			} else if (then > now) {
+				vwu->next = then;
+				break;
+			}
+			CHECK_OBJ_NOTNULL(wp, WAITED_MAGIC);
+			AN(Wait_HeapDelete(w, wp));
+			vwu_sqe(vwu, IORING_OP_POLL_REMOVE, -1,
+			    (uintptr_t)wp, 0);
+		}
+	} while (n == NEXP || vwu->sq_pending > 0);
+	Lck_Unlock(&vwu->mtx);
+}
+
+static int
+vwu_reap(struct vwu *vwu, struct vwu_ev *ev)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	int n = 0;
+
+	head = *vwu->cq_head;
+	tail = __atomic_load_n(vwu->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail && n < NCQE; head++) {
+		cqe = &vwu->cqes[head & vwu->cq_mask];
+		/* Cancellations and wakeups */
+		if (cqe->user_data == 0 || cqe->user_data == (uintptr_t)vwu)
+			continue;
+		ev[n].wp = (void *)(uintptr_t)cqe->user_data;
+		ev[n].res = cqe->res;
+		ev[n].timeout = 0;
+		n++;
+	}
+	__atomic_store_n(vwu->cq_head, head, __ATOMIC_RELEASE);
+	return (n);
+}
+
+static void *
+vwu_thread(void *priv)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	struct vwu_ev *ev, *ep;
+	struct waited *wp;
+	struct waiter *w;
+	double now, then;
+	int i, n;
+	struct vwu *vwu;
+	char c;
+
+	CAST_OBJ_NOTNULL(vwu, priv, VWU_MAGIC);
+	w = vwu->waiter;
+	CHECK_OBJ_NOTNULL(w, WAITER_MAGIC);
+	THR_SetName("cache-io_uring");
+	THR_Init();
+	ev = malloc(sizeof *ev * NCQE);
+	AN(ev);
+
+	memset(&arg, 0, sizeof arg);
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (uintptr_t)&ts;
+
+	now = VTIM_real();
+	while (1) {
+		vwu_expire(vwu, now);
+		Lck_Lock(&vwu->mtx);
+		then = vmax(vwu->next - now, 0.);
+		Lck_Unlock(&vwu->mtx);
+		ts.tv_sec = (long long)then;
+		ts.tv_nsec = (long long)(1e9 * (then - ts.tv_sec));
+		i = vwu_syscall(vwu, 0, 1,
+		    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		    &arg, sizeof arg);
+		assert(i >= 0 || errno == ETIME || errno == EINTR ||
+		    errno == EBUSY);
+		now = VTIM_real();
+
+		n = vwu_reap(vwu, ev);
+
+		/* Sort out actions from timeouts under one lock */
+		Lck_Lock(&vwu->mtx);
+		vwu->reaped++;
+		PTOK(pthread_cond_broadcast(&vwu->cond));
+		for (ep = ev, i = 0; i < n; i++, ep++) {
+			CAST_OBJ_NOTNULL(wp, ep->wp, WAITED_MAGIC);
+			AN(vwu->nwaited);
+			vwu->nwaited--;
+			/* Not on the heap: vwu_expire() cancelled the poll */
+			if (!Wait_HeapDelete(w, wp))
+				ep->timeout = 1;
+		}
+		Lck_Unlock(&vwu->mtx);
+
+		for (ep = ev, i = 0; i < n; i++, ep++) {
+			wp = ep->wp;
+			if (ep->timeout)
+				Wait_Call(w, wp, WAITER_TIMEOUT, now);
+			else if (ep->res < 0)
+				Wait_Call(w, wp, WAITER_REMCLOSE, now);
+			else if (ep->res & POLLIN) {
+				if (ep->res & POLLRDHUP &&
+				    recv(wp->fd, &c, 1, MSG_PEEK) == 0)
+					Wait_Call(w, wp, WAITER_REMCLOSE, now);
+				else
+					Wait_Call(w, wp, WAITER_ACTION, now);
+			} else
+				Wait_Call(w, wp, WAITER_REMCLOSE, now);
+		}
+		if (vwu->nwaited == 0 && vwu->die)
+			break;
+	}
+	free(ev);
+	return (NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int v_matchproto_(waiter_enter_f)
+vwu_enter(void *priv, struct waited *wp)
+{
+	struct vwu *vwu;
+
+	CAST_OBJ_NOTNULL(vwu, priv, VWU_MAGIC);
+	Lck_Lock(&vwu->mtx);
+	/* Leave room for a batch from vwu_expire() */
+	if (vwu->sq_pending + 2 > vwu->sq_mask + 1 - NEXP)
+		vwu_flush(vwu);
+	vwu->nwaited++;
+	Wait_HeapInsert(vwu->waiter, wp);
+	vwu_sqe(vwu, IORING_OP_POLL_ADD, wp->fd, 0, (uintptr_t)wp);
+	/* If the waiter isn't due before our timeout, wake it up */
+	if (Wait_When(wp) < vwu->next)
+		vwu_sqe(vwu, IORING_OP_NOP, -1, 0, (uintptr_t)vwu);
+	vwu_flush(vwu);
+	Lck_Unlock(&vwu->mtx);
+	return (0);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void v_matchproto_(waiter_init_f)
+vwu_init(struct waiter *w)
+{
+	struct io_uring_params p;
+	struct vwu *vwu;
+	uint8_t *sq, *cq;
+
+	CHECK_OBJ_NOTNULL(w, WAITER_MAGIC);
+	vwu = w->priv;
+	INIT_OBJ(vwu, VWU_MAGIC);
+	vwu->waiter = w;
+
+	memset(&p, 0, sizeof p);
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = NCQE;
+	vwu->fd = vwu_setup(NSQE, &p);
+	assert(vwu->fd >= 0);
+	/* We need ring sizes we can rely on and a timeout for waiting */
+	AN(p.features & IORING_FEAT_NODROP);
+	AN(p.features & IORING_FEAT_EXT_ARG);
+
+	vwu->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	vwu->cq_ring_sz = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (vwu->cq_ring_sz > vwu->sq_ring_sz)
+			vwu->sq_ring_sz = vwu->cq_ring_sz;
+		vwu->cq_ring_sz = 0;
+	}
+	vwu->sq_ring = mmap(NULL, vwu->sq_ring_sz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, vwu->fd, IORING_OFF_SQ_RING);
+	assert(vwu->sq_ring != MAP_FAILED);
+	if (vwu->cq_ring_sz == 0)
+		vwu->cq_ring = vwu->sq_ring;
+	else {
+		vwu->cq_ring = mmap(NULL, vwu->cq_ring_sz,
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		    vwu->fd, IORING_OFF_CQ_RING);
+		assert(vwu->cq_ring != MAP_FAILED);
+	}
+	vwu->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	vwu->sqes = mmap(NULL, vwu->sqes_sz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, vwu->fd, IORING_OFF_SQES);
+	assert(vwu->sqes != MAP_FAILED);
+
+	sq = vwu->sq_ring;
+	vwu->sq_head = (void *)(sq + p.sq_off.head);
+	vwu->sq_tail = (void *)(sq + p.sq_off.tail);
+	vwu->sq_mask = *(unsigned *)(void *)(sq + p.sq_off.ring_mask);
+	vwu->sq_array = (void *)(sq + p.sq_off.array);
+
+	cq = vwu->cq_ring;
+	vwu->cq_head = (void *)(cq + p.cq_off.head);
+	vwu->cq_tail = (void *)(cq + p.cq_off.tail);
+	vwu->cq_mask = *(unsigned *)(void *)(cq + p.cq_off.ring_mask);
+	vwu->cqes = (void *)(cq + p.cq_off.cqes);
+
+	Lck_New(&vwu->mtx, lck_waiter);
+	PTOK(pthread_cond_init(&vwu->cond, NULL));
+
+	PTOK(pthread_create(&vwu->thread, NULL, vwu_thread, vwu));
+}
+
+/*--------------------------------------------------------------------
+ * It is the callers responsibility to trigger all fd's waited on to
+ * fail somehow.
+ */
+
+static void v_matchproto_(waiter_fini_f)
+vwu_fini(struct waiter *w)
+{
+	struct vwu *vwu;
+	void *vp;
+
+	CAST_OBJ_NOTNULL(vwu, w->priv, VWU_MAGIC);
+
+	Lck_Lock(&vwu->mtx);
+	vwu->die = 1;
+	if (vwu->sq_pending + 1 > vwu->sq_mask + 1 - NEXP)
+		vwu_flush(vwu);
+	vwu_sqe(vwu, IORING_OP_NOP, -1, 0, (uintptr_t)vwu);
+	vwu_flush(vwu);
+	Lck_Unlock(&vwu->mtx);
+	PTOK(pthread_join(vwu->thread, &vp));
+	PTOK(pthread_cond_destroy(&vwu->cond));
+	Lck_Delete(&vwu->mtx);
+	AZ(munmap(vwu->sqes, vwu->sqes_sz));
+	if (vwu->cq_ring != vwu->sq_ring)
+		AZ(munmap(vwu->cq_ring, vwu->cq_ring_sz));
+	AZ(munmap(vwu->sq_ring, vwu->sq_ring_sz));
+	closefd(&vwu->fd);
+}
+
+/*--------------------------------------------------------------------*/
+
+#include "waiter/mgt_waiter.h"
+
+const struct waiter_impl waiter_io_uring = {
+	.name =		"io_uring",
+	.init =		vwu_init,
+	.fini =		vwu_fini,
+	.enter =	vwu_enter,
+	.size =		sizeof(struct vwu),
+};
+
+#endif /* defined(HAVE_IO_URING) */
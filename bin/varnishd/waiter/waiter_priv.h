@@ -45,6 +45,10 @@ struct waiter {
 	void				*priv;
 	struct vbh			*heap;
 	struct VSC_waiter		*vsc;
+
+	/* Connections are spread over nshard waiters, shard[0] is us */
+	unsigned			nshard;
+	struct waiter			**shard;
 };
 
 typedef void waiter_init_f(struct waiter *);
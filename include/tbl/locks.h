@@ -36,6 +36,7 @@ LOCK(busyobj)
 LOCK(cli)
 LOCK(director)
 LOCK(exp)
+LOCK(h2fetch)
 LOCK(hcb)
 LOCK(lru)
 LOCK(mempool)
@@ -54,6 +55,7 @@ LOCK(vxid)
 LOCK(waiter)
 LOCK(wq)
 LOCK(wstat)
+LOCK(wssize)
 #undef LOCK
 
 /*lint -restore */
@@ -38,6 +38,7 @@
   OBJ_FIXATTR(FLAGS, flags, 1)
   OBJ_FIXATTR(GZIPBITS, gzipbits, 32)
   OBJ_FIXATTR(LASTMODIFIED, lastmodified, sizeof(double))
+  OBJ_FIXATTR(SLICE, slice, 24)
   #undef OBJ_FIXATTR
 #endif
 
@@ -51,6 +52,7 @@
 /* upper, lower */
 #ifdef OBJ_AUXATTR
   OBJ_AUXATTR(ESIDATA, esidata)
+  OBJ_AUXATTR(IDENTITY, identity)
   #undef OBJ_AUXATTR
 #endif
 
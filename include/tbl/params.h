@@ -265,6 +265,23 @@ PARAM_SIMPLE(
 	"This parameter does not apply to pipe'ed requests."
 )
 
+PARAM_SIMPLE(
+	/* name */	backend_h2_streams,
+	/* type */	uint,
+	/* min */	"1",
+	/* max */	"2147483647",
+	/* def */	"100",
+	/* units */	"streams",
+	/* descr */
+	"Maximum number of concurrent fetches multiplexed over one "
+	"connection to a backend with .h2c enabled.  A lower "
+	"SETTINGS_MAX_CONCURRENT_STREAMS from the backend takes "
+	"precedence.\n"
+	"Further connections are opened as needed, within the "
+	".max_connections limit of the backend.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	backend_idle_timeout,
 	/* type */	duration,
@@ -345,6 +362,25 @@ PARAM_SIMPLE(
 	/* flags */	EXPERIMENTAL
 )
 
+PARAM_SIMPLE(
+	/* name */	bereq_borrow,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Let the backend request of a fetch which a client request waits "
+	"for refer to the client request's headers instead of copying them "
+	"to the backend workspace. Only headers set from VCL or by varnish "
+	"take backend workspace.\n"
+	"Before the response starts streaming, the backend request is "
+	"copied to the backend workspace, because the client request goes "
+	"on while fetch processors still see the backend request. If the "
+	"response does not stream, the backend request is cleared once the "
+	"fetch is done.",
+	/* flags */	EXPERIMENTAL
+)
 
 PARAM_SIMPLE(
 	/* name */	cli_limit,
@@ -433,6 +469,24 @@ PARAM_SIMPLE(
 	/* flags */	WIZARD
 )
 
+PARAM_SIMPLE(
+	/* name */	hash_fast_digest,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Use a faster, non-cryptographic 256 bit digest of the hash_data() "
+	"input instead of SHA256 for cache lookups.\n\n"
+	"The digest is keyed with a random seed chosen when the child "
+	"process starts, which makes deliberate collisions impractical, "
+	"but it is not a cryptographic hash. Objects in persistent storage "
+	"will not be found again after a restart with this enabled, and "
+	"req.hash no longer is the SHA256 of the hash input.",
+	/* flags */	MUST_RESTART | EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	default_grace,
 	/* type */	duration,
@@ -516,6 +570,25 @@ PARAM_SIMPLE(
 	/* flags */	WIZARD
 )
 
+PARAM_SIMPLE(
+	/* name */	http1_batch,
+	/* type */	bytes_u,
+	/* min */	"0b",
+	/* max */	"1M",
+	/* def */	"0b",
+	/* units */	"bytes",
+	/* descr */
+	"Hold back HTTP1 responses of up to this many bytes while further "
+	"pipelined requests are already received, and send them together "
+	"with the following responses in one write. Only complete "
+	"responses with a known length are held, and everything held is "
+	"sent before the connection waits for more requests.\n"
+	"A held response is also delayed by a following request which has "
+	"to wait for a busy object or a fetch.\n"
+	"Zero disables.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	fetch_chunksize,
 	/* type */	bytes,
@@ -544,6 +617,39 @@ PARAM_SIMPLE(
 	/* flags */	EXPERIMENTAL
 )
 
+PARAM_SIMPLE(
+	/* name */	gzip_background,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Store objects with beresp.do_gzip uncompressed and have a "
+	"background task replace them with a copy gzip'ed at "
+	"gzip_background_level once they are complete.\n"
+	"This keeps compression out of the fetch, clients are served the "
+	"uncompressed object until the gzip'ed copy replaces it.\n"
+	"Does not apply to ESI processed, uncacheable or short lived "
+	"objects, nor to objects stored in Transient. If no idle worker "
+	"thread is available when their fetch completes, the fetch "
+	"worker compresses them itself.",
+	/* flags */	EXPERIMENTAL
+)
+
+PARAM_SIMPLE(
+	/* name */	gzip_background_level,
+	/* type */	uint,
+	/* min */	"0",
+	/* max */	"9",
+	/* def */	"9",
+	/* units */	NULL,
+	/* descr */
+	"Gzip compression level used by gzip_background: 0=debug, "
+	"1=fast, 9=best",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	gzip_buffer,
 	/* type */	bytes_u,
@@ -562,6 +668,22 @@ PARAM_SIMPLE(
 	/* flags */	EXPERIMENTAL
 )
 
+PARAM_SIMPLE(
+	/* name */	gzip_identity_max,
+	/* type */	bytes,
+	/* min */	"0k",
+	/* max */	NULL,
+	/* def */	"0k",
+	/* units */	"bytes",
+	/* descr */
+	"Largest uncompressed body for which a copy is stored alongside "
+	"gzip'ed objects while they are fetched. Clients which do not "
+	"accept gzip are then served the copy instead of gunzip'ing the "
+	"object for every delivery, at the cost of the additional storage.\n"
+	"Zero disables the uncompressed copies.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	gzip_level,
 	/* type */	uint,
@@ -860,6 +982,30 @@ PARAM_SIMPLE(
 	/* flags */	MUST_RESTART
 )
 
+#if defined(HAVE_EPOLL_CTL)
+#  define PLATFORM_FLAGS EXPERIMENTAL
+#else
+#  define PLATFORM_FLAGS NOT_IMPLEMENTED
+#endif
+PARAM_SIMPLE(
+	/* name */	pipe_park,
+	/* type */	timeout,
+	/* min */	"0.000",
+	/* max */	NULL,
+	/* def */	"0s",
+	/* units */	"seconds",
+	/* descr */
+	"Hand PIPE sessions which have been idle in both directions for "
+	"this many seconds to the waiter, so that they no longer hold a "
+	"worker thread. A worker picks the session up again when either "
+	"side sends data. Bytes moved after a session was parked are "
+	"only accounted in the global counters, and a parked session no "
+	"longer counts as a backend connection.\n"
+	"Zero disables parking.",
+	/* flags */	PLATFORM_DEPENDENT | PLATFORM_FLAGS
+)
+#undef PLATFORM_FLAGS
+
 PARAM_SIMPLE(
 	/* name */	pipe_sess_max,
 	/* type */	uint,
@@ -871,6 +1017,27 @@ PARAM_SIMPLE(
 	"Maximum number of sessions dedicated to pipe transactions."
 )
 
+#if defined(HAVE_SPLICE)
+#  define PLATFORM_FLAGS EXPERIMENTAL
+#else
+#  define PLATFORM_FLAGS NOT_IMPLEMENTED
+#endif
+PARAM_SIMPLE(
+	/* name */	pipe_splice,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Move PIPE traffic between the client and backend connections "
+	"with splice(2) through a kernel pipe instead of copying it "
+	"through a buffer in varnishd. This uses two additional pairs of "
+	"file descriptors per PIPE session.",
+	/* flags */	PLATFORM_DEPENDENT | PLATFORM_FLAGS
+)
+#undef PLATFORM_FLAGS
+
 PARAM_SIMPLE(
 	/* name */	pipe_task_deadline,
 	/* type */	timeout,
@@ -907,6 +1074,50 @@ PARAM_SIMPLE(
 	"IPv4 and IPv6 addresses."
 )
 
+PARAM_SIMPLE(
+	/* name */	refresh_ahead,
+	/* type */	duration,
+	/* min */	"0.000",
+	/* max */	NULL,
+	/* def */	"0s",
+	/* units */	"seconds",
+	/* descr */
+	"A cache hit on an object with less than this much TTL left "
+	"starts a background fetch to refresh it, provided the object "
+	"has been hit at least refresh_ahead_hits times and no fetch for "
+	"it is already in progress.  The hit itself is delivered from the "
+	"object, which therefore gets replaced before it goes stale.\n"
+	"Zero disables refreshing ahead of expiry."
+)
+
+PARAM_SIMPLE(
+	/* name */	refresh_ahead_hits,
+	/* type */	uint,
+	/* min */	"1",
+	/* max */	NULL,
+	/* def */	"10",
+	/* units */	"hits",
+	/* descr */
+	"How many hits an object needs before refresh_ahead refreshes it."
+)
+
+PARAM_SIMPLE(
+	/* name */	req_park,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Park requests waiting for the response of a backend fetch instead "
+	"of holding on to their worker thread. A parked request is "
+	"rescheduled on any thread of its pool once the response headers "
+	"are available or the fetch failed, like requests leaving the "
+	"waiting list. Requests still sending their body to the backend "
+	"and ESI includes are not parked.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	rush_exponent,
 	/* type */	uint,
@@ -920,10 +1131,32 @@ PARAM_SIMPLE(
 	"NB: Even with the implicit delay of delivery, this parameter "
 	"controls an exponential increase in number of worker threads. "
 	"A value of 1 will instead serialize requests resumption and is "
-	"only useful for testing purposes.",
+	"only useful for testing purposes.\n"
+	"Parked requests are all started at once when the object turns "
+	"out to be uncacheable, or when it is streamed and has no Vary "
+	"header.",
 	/* flags */	EXPERIMENTAL
 )
 
+PARAM_SIMPLE(
+	/* name */	uncacheable_threshold,
+	/* type */	uint,
+	/* min */	"0",
+	/* max */	NULL,
+	/* def */	"3",
+	/* units */	"fetches",
+	/* descr */
+	"After this many consecutive uncacheable fetches for the same hash "
+	"key, requests no longer wait on the waiting list for a fetch in "
+	"progress on it, and go to the backend on their own as if they had "
+	"found a hit-for-miss object.  The hit-for-miss objects these "
+	"fetches leave behind are kept for at least uncacheable_ttl, "
+	"the TTL of those created from VCL is left alone.  A cacheable "
+	"fetch for the hash key starts the count over.\n"
+	"Zero disables this, so that only hit-for-miss and hit-for-pass "
+	"objects created from VCL avoid the waiting list."
+)
+
 PARAM_SIMPLE(
 	/* name */	send_timeout,
 	/* type */	timeout,
@@ -966,6 +1199,28 @@ PARAM_SIMPLE(
 	/* flags */	MUST_RESTART
 )
 
+PARAM_SIMPLE(
+	/* name */	slice_size,
+	/* type */	bytes_u,
+	/* min */	"0b",
+	/* max */	"1G",
+	/* def */	"0b",
+	/* units */	"bytes",
+	/* descr */
+	"Fetch cacheable objects from the backend in slices of this many "
+	"bytes using Range requests, and cache each slice as an object of "
+	"its own. The first slice is fetched as usual and, if the backend "
+	"reports a larger object, carries the headers of the whole object. "
+	"The remaining slices are fetched on delivery when they are not "
+	"cached, one slice ahead of the one being sent.\n"
+	"Backends which do not support Range requests, and responses "
+	"with a Content-Encoding, are fetched whole.\n"
+	"VCL can opt out of slicing by unsetting bereq.http.Range in "
+	"vcl_backend_fetch{}.\n"
+	"Zero disables.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	syslog_cli_traffic,
 	/* type */	boolean,
@@ -1264,6 +1519,26 @@ PARAM_SIMPLE(
 	/* flags */	DELAYED_EFFECT
 )
 
+PARAM_SIMPLE(
+	/* name */	workspace_sizing,
+	/* type */	double,
+	/* min */	"0",
+	/* max */	"100",
+	/* def */	"0",
+	/* units */	"percent",
+	/* descr */
+	"Size the client, backend and session workspaces automatically. "
+	"Zero disables this.\n"
+	"The high-water mark of one in 16 workspaces is sampled when it is "
+	"released, see the WS.* counters. When set, new workspaces are "
+	"allocated for this percentile of the recent samples plus an "
+	"eighth, but never larger than workspace_client, workspace_backend "
+	"or workspace_session, which become upper bounds. An overflow "
+	"below the upper bound goes back to it and suspends the automatic "
+	"sizing of that workspace for a while.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_SIMPLE(
 	/* name */	workspace_thread,
 	/* type */	bytes_u,
@@ -1495,6 +1770,24 @@ PARAM_MEMPOOL(
 		"Parameters for backend object fetch memory pool.\n\n"
 )
 
+PARAM_SIMPLE(
+	/* name */	pool_magazine,
+	/* type */	uint,
+	/* min */	"0",
+	/* max */	"32",
+	/* def */	"8",
+	/* units */	"items",
+	/* descr */
+	"How many free items each CPU may keep in front of the pool_req, "
+	"pool_sess and pool_vbo memory pools.\n"
+	"These magazines are refilled from and drained to the shared "
+	"pool half at a time, so that most allocations and frees only "
+	"take an uncontended per-CPU lock. Items in magazines are not "
+	"counted against max_pool and do not age.\n"
+	"Zero disables the magazines.",
+	/* flags */	EXPERIMENTAL
+)
+
 /*--------------------------------------------------------------------
  * Thread pool parameters
  */
@@ -1692,6 +1985,89 @@ PARAM_THREAD(
 	/* flags */	EXPERIMENTAL
 )
 
+PARAM_THREAD(
+	/* name */	thread_pool_waiters,
+	/* field */	waiters,
+	/* type */	uint,
+	/* min */	"1",
+	/* max */	"64",
+	/* def */	"1",
+	/* units */	"waiters",
+	/* descr */
+	"Number of waiters per thread pool, each with its own thread.\n"
+	"\n"
+	"Idle connections are spread over the waiters by file "
+	"descriptor, which splits the waiter lock and spreads the "
+	"wakeups of many idle connections over several threads.",
+	/* flags */	EXPERIMENTAL | MUST_RESTART
+)
+
+PARAM_THREAD(
+	/* name */	thread_pool_latency,
+	/* field */	latency,
+	/* type */	duration,
+	/* min */	"0",
+	/* max */	NULL,
+	/* def */	"0",
+	/* units */	"seconds",
+	/* descr */
+	"Target for the time tasks wait in the queue of a thread pool. "
+	"Zero disables the latency controller.\n"
+	"\n"
+	"When set, the herder of each pool looks at the queue wait time "
+	"and the share of busy threads ten times a second. If tasks "
+	"waited longer than the target, it creates one thread for each "
+	"queued task plus an eighth of the pool at once, and if more "
+	"than 90% of the threads are busy, it creates a sixteenth of "
+	"the pool ahead of demand. When nothing was queued and fewer "
+	"than half of the threads are busy, idle threads are destroyed "
+	"after one second rather than thread_pool_timeout.\n"
+	"Decisions are logged as Debug records and counted in "
+	"threads_adapt_grow and threads_adapt_shrink.",
+	/* flags */	EXPERIMENTAL
+)
+
+PARAM_THREAD(
+	/* name */	thread_pool_numa,
+	/* field */	numa,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Bind each thread pool to the CPUs of one NUMA node, round "
+	"robin over the nodes, so set thread_pools to a multiple of "
+	"the number of nodes.\n"
+	"\n"
+	"All threads of a pool, including its waiters and memory pool "
+	"threads, run on the node and the memory they first touch, "
+	"such as workspaces, requests, sessions and, with most "
+	"allocators, malloc storage, is allocated there by the kernel.\n"
+	"Only has an effect on Linux with more than one node.",
+	/* flags */	EXPERIMENTAL | MUST_RESTART
+)
+
+PARAM_THREAD(
+	/* name */	thread_pool_steal,
+	/* field */	steal,
+	/* type */	boolean,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* def */	"off",
+	/* units */	"bool",
+	/* descr */
+	"Let thread pools share backend fetch and background tasks.\n"
+	"\n"
+	"When a pool has no idle thread for such a task, it is handed "
+	"to an idle thread of another pool instead of being queued or, "
+	"for background tasks, failed. Threads about to go idle also "
+	"take queued backend fetches from other pools.\n"
+	"This evens out pools which receive uneven shares of the "
+	"connections, at the cost of some cross pool locking.",
+	/* flags */	EXPERIMENTAL
+)
+
 PARAM_THREAD(
 	/* name */	thread_stats_rate,
 	/* field */	stats_rate,
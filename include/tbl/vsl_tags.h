@@ -494,7 +494,8 @@ SLTM(Gzip, 0, "G(un)zip performed on object",
 	"\t|  |  |  |  +---------- Bytes output\n"
 	"\t|  |  |  +------------- Bytes input\n"
 	"\t|  |  +---------------- 'E': ESI, '-': Plain object\n"
-	"\t|  +------------------- 'F': Fetch, 'D': Deliver\n"
+	"\t|  +------------------- 'F': Fetch, 'D': Deliver,"
+	" 'B': Background\n"
 	"\t+---------------------- 'G': Gzip, 'U': Gunzip, 'u': Gunzip-test\n"
 	"\n"
 	"Examples::\n\n"
@@ -647,6 +648,10 @@ SLTM(HitMiss, 0, "Hit for miss object in cache.",
 	"\t|  +- Remaining TTL\n"
 	"\t+---- VXID of the object\n"
 	"\n"
+	"Both fields are zero when there is no such object, but the hash "
+	"key has been producing uncacheable objects, see the "
+	"uncacheable_threshold parameter.\n"
+	"\n"
 )
 
 SLTM(Filters, 0, "Body filters",
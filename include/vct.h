@@ -57,6 +57,9 @@ extern const uint16_t vct_typtab[256];
 extern const uint8_t vct_lowertab[256];
 
 const char *VCT_invalid_name(const char *b, const char *e);
+size_t VCT_hdrval_span(const char *b, const char *e);
+size_t VCT_vchar_span(const char *b, const char *e);
+size_t VCT_tchar_span(const char *b, const char *e);
 
 static inline int
 vct_is(int x, uint16_t y)
@@ -87,6 +90,7 @@ vct_is(int x, uint16_t y)
 #define vct_istchar(x) vct_is(x, VCT_ALPHA | VCT_DIGIT | VCT_TCHAR)
 #define vct_ishdrval(x) \
     (((uint8_t)(x) >= 0x20 && (uint8_t)(x) != 0x7f) ||(uint8_t)(x) == 0x09)
+#define vct_isvchar(x) ((uint8_t)(x) > 0x20 && (uint8_t)(x) != 0x7f)
 
 static inline int
 vct_iscrlf(const char* p, const char* end)
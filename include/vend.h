@@ -78,7 +78,6 @@ vle32dec(const void *pp)
 	return (((unsigned)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0]);
 }
 
-#if 0
 static __inline uint64_t
 vle64dec(const void *pp)
 {
@@ -86,7 +85,6 @@ vle64dec(const void *pp)
 
 	return (((uint64_t)vle32dec(p + 4) << 32) | vle32dec(p));
 }
-#endif
 
 static __inline void
 vbe16enc(void *pp, uint16_t u)
@@ -137,7 +135,6 @@ vle32enc(void *pp, uint32_t u)
 	p[3] = (u >> 24) & 0xff;
 }
 
-#if 0
 static __inline void
 vle64enc(void *pp, uint64_t u)
 {
@@ -146,6 +143,5 @@ vle64enc(void *pp, uint64_t u)
 	vle32enc(p, (uint32_t)(u & 0xffffffffU));
 	vle32enc(p + 4, (uint32_t)(u >> 32));
 }
-#endif
 
 #endif
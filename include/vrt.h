@@ -58,8 +58,12 @@
  * binary/load-time compatible, increment MAJOR version
  *
  * 22.1 (trunk)
+ *	"h2c" member added to vrt_backend{}
+ *	"min_idle_connections" member added to vrt_backend{}
  *	"vcl_name" member added to vrt_backend_probe{}
  *	VRT_PROBE_string() added
+ *	VRT_TeeReqBody() added
+ *	[cache.h] (struct ws).peak added
  * 22.0 (2025-09-15)
  *	VRT_r_obj_stale_age() added
  *	VRT_r_obj_stale_can_esi() added
@@ -665,7 +669,9 @@ struct vrt_endpoint {
 	vtim_dur			backend_wait_timeout;	\
 	unsigned			max_connections;	\
 	unsigned			proxy_header;		\
-	unsigned			backend_wait_limit;
+	unsigned			backend_wait_limit;	\
+	unsigned			h2c;			\
+	unsigned			min_idle_connections;
 
 #define VRT_BACKEND_INIT(be)					\
 	do {							\
@@ -688,6 +694,8 @@ struct vrt_endpoint {
 		DN(max_connections);		\
 		DN(proxy_header);		\
 		DN(backend_wait_limit);		\
+		DN(h2c);			\
+		DN(min_idle_connections);	\
 	} while(0)
 
 struct vrt_backend {
@@ -800,6 +808,7 @@ enum lbody_e {
 #define LBODY_ADD LBODY_ADD_STRING
 
 VCL_BYTES VRT_CacheReqBody(VRT_CTX, VCL_BYTES maxsize);
+VCL_BYTES VRT_TeeReqBody(VRT_CTX, VCL_BYTES maxsize);
 
 VCL_STRING VRT_ban_string(VRT_CTX, VCL_STRING);
 VCL_INT VRT_purge(VRT_CTX, VCL_DURATION, VCL_DURATION, VCL_DURATION);
@@ -60,6 +60,22 @@
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__x86_64__) && defined(HAVE_CPUID_H) && defined(__GNUC__)
+#  define VSHA256_X86 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(HAVE_SYS_AUXV_H) && \
+    defined(HAVE_GETAUXVAL) && defined(__GNUC__)
+#  define VSHA256_ARM 1
+#  include <sys/auxv.h>
+#  include <arm_neon.h>
+#  ifndef HWCAP_SHA2
+#    define HWCAP_SHA2 (1 << 6)
+#  endif
+#endif
+
 #include "vdef.h"
 
 #include "vas.h"
@@ -165,7 +181,7 @@ static const uint32_t K[64] = {
  * the 512-bit input block to produce a new state.
  */
 static void
-VSHA256_Transform(uint32_t * state, const unsigned char block[64])
+vsha256_transform_c(uint32_t * state, const unsigned char block[64])
 {
 	uint32_t W[64];
 	uint32_t S[8];
@@ -221,6 +237,150 @@ VSHA256_Transform(uint32_t * state, const unsigned char block[64])
 		state[i] += S[i];
 }
 
+/*
+ * Transform nblk consecutive blocks.  Implementations using CPU
+ * instructions are picked by VSHA256_Test() if the CPU has them and
+ * they pass the test-vectors.
+ */
+
+typedef void vsha256_xform_f(uint32_t *, const unsigned char *, size_t);
+
+static void v_matchproto_(vsha256_xform_f)
+vsha256_xform_c(uint32_t *state, const unsigned char *block, size_t nblk)
+{
+
+	for (; nblk > 0; nblk--, block += 64)
+		vsha256_transform_c(state, block);
+}
+
+#ifdef VSHA256_X86
+static int
+vsha256_probe_x86(void)
+{
+	unsigned a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return (0);
+	if (!(c & bit_SSSE3) || !(c & bit_SSE4_1))
+		return (0);
+	if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+		return (0);
+	return ((b & (1U << 29)) != 0);		/* SHA extensions */
+}
+
+static void __attribute__((target("sha,sse4.1,ssse3")))
+vsha256_xform_x86(uint32_t *state, const unsigned char *block, size_t nblk)
+{
+	const __m128i mask = _mm_set_epi64x(
+	    0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i s0, s1, tmp, msg, abef, cdgh;
+	__m128i w[16];
+	int i;
+
+	/* Shuffle the state into the ABEF/CDGH layout of the instructions */
+	tmp = _mm_loadu_si128((const void *)&state[0]);
+	s1 = _mm_loadu_si128((const void *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);
+	s1 = _mm_shuffle_epi32(s1, 0x1b);
+	s0 = _mm_alignr_epi8(tmp, s1, 8);
+	s1 = _mm_blend_epi16(s1, tmp, 0xf0);
+
+	for (; nblk > 0; nblk--, block += 64) {
+		abef = s0;
+		cdgh = s1;
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+				    (const void *)(block + i * 16)), mask);
+			} else {
+				tmp = _mm_sha256msg1_epu32(w[i - 4], w[i - 3]);
+				tmp = _mm_add_epi32(tmp,
+				    _mm_alignr_epi8(w[i - 1], w[i - 2], 4));
+				w[i] = _mm_sha256msg2_epu32(tmp, w[i - 1]);
+			}
+			msg = _mm_add_epi32(w[i],
+			    _mm_loadu_si128((const void *)&K[i * 4]));
+			s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			s0 = _mm_sha256rnds2_epu32(s0, s1, msg);
+		}
+		s0 = _mm_add_epi32(s0, abef);
+		s1 = _mm_add_epi32(s1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(s0, 0x1b);
+	s1 = _mm_shuffle_epi32(s1, 0xb1);
+	s0 = _mm_blend_epi16(tmp, s1, 0xf0);
+	s1 = _mm_alignr_epi8(s1, tmp, 8);
+	_mm_storeu_si128((void *)&state[0], s0);
+	_mm_storeu_si128((void *)&state[4], s1);
+}
+#endif
+
+#ifdef VSHA256_ARM
+static int
+vsha256_probe_arm(void)
+{
+
+	return ((getauxval(AT_HWCAP) & HWCAP_SHA2) != 0);
+}
+
+static void __attribute__((target("+crypto")))
+vsha256_xform_arm(uint32_t *state, const unsigned char *block, size_t nblk)
+{
+	uint32x4_t s0, s1, abcd, efgh, tmp, prev;
+	uint32x4_t w[16];
+	int i;
+
+	s0 = vld1q_u32(&state[0]);
+	s1 = vld1q_u32(&state[4]);
+
+	for (; nblk > 0; nblk--, block += 64) {
+		abcd = s0;
+		efgh = s1;
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				w[i] = vreinterpretq_u32_u8(
+				    vrev32q_u8(vld1q_u8(block + i * 16)));
+			} else {
+				tmp = vsha256su0q_u32(w[i - 4], w[i - 3]);
+				w[i] = vsha256su1q_u32(tmp, w[i - 2], w[i - 1]);
+			}
+			tmp = vaddq_u32(w[i], vld1q_u32(&K[i * 4]));
+			prev = s0;
+			s0 = vsha256hq_u32(s0, s1, tmp);
+			s1 = vsha256h2q_u32(s1, prev, tmp);
+		}
+		s0 = vaddq_u32(s0, abcd);
+		s1 = vaddq_u32(s1, efgh);
+	}
+
+	vst1q_u32(&state[0], s0);
+	vst1q_u32(&state[4], s1);
+}
+#endif
+
+static const struct vsha256_impl {
+	const char		*name;
+	int			(*probe)(void);
+	vsha256_xform_f		*xform;
+} vsha256_impl[] = {
+#ifdef VSHA256_X86
+	{ "x86_sha",	vsha256_probe_x86,	vsha256_xform_x86 },
+#endif
+#ifdef VSHA256_ARM
+	{ "armv8_sha2",	vsha256_probe_arm,	vsha256_xform_arm },
+#endif
+	{ "c",		NULL,			vsha256_xform_c },
+	{ NULL,		NULL,			NULL }
+};
+
+static const struct vsha256_impl *vsha256_cur =
+    &vsha256_impl[vcountof(vsha256_impl) - 2];
+
+#define VSHA256_Transform(state, block) \
+	vsha256_cur->xform(state, block, 1)
+
 static const unsigned char PAD[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -306,10 +466,10 @@ VSHA256_Update(VSHA256_CTX * ctx, const void *in, size_t len)
 	len -= 64 - r;
 
 	/* Perform complete blocks */
-	while (len >= 64) {
-		VSHA256_Transform(ctx->state, src);
-		src += 64;
-		len -= 64;
+	if (len >= 64) {
+		vsha256_cur->xform(ctx->state, src, len / 64);
+		src += len & ~(size_t)0x3f;
+		len &= 0x3f;
 	}
 
 	/* Copy left over data into buffer */
@@ -359,8 +519,8 @@ static const struct sha256test {
 };
 
 
-void
-VSHA256_Test(void)
+static int
+vsha256_test_vectors(void)
 {
 	struct VSHA256Context c;
 	const struct sha256test *p;
@@ -370,6 +530,89 @@ VSHA256_Test(void)
 		VSHA256_Init(&c);
 		VSHA256_Update(&c, p->input, strlen(p->input));
 		VSHA256_Final(o, &c);
-		AZ(memcmp(o, p->output, 32));
+		if (memcmp(o, p->output, 32))
+			return (-1);
 	}
+	return (0);
 }
+
+/*
+ * Select the fastest implementation the CPU supports and which passes
+ * the test-vectors, then make sure we still have a working one.
+ */
+
+void
+VSHA256_Test(void)
+{
+	const struct vsha256_impl *vi;
+
+	for (vi = vsha256_impl; vi->name != NULL; vi++) {
+		if (vi->probe != NULL && !vi->probe())
+			continue;
+		vsha256_cur = vi;
+		if (!vsha256_test_vectors())
+			break;
+	}
+	AN(vi->name);
+	AZ(vsha256_test_vectors());
+}
+
+const char *
+VSHA256_Impl(void)
+{
+
+	return (vsha256_cur->name);
+}
+
+#ifdef TEST_DRIVER
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Compare every implementation available on this CPU against the
+ * portable one, across block boundaries and misaligned updates.
+ */
+
+int
+main(void)
+{
+	const struct vsha256_impl *vi, *ref;
+	unsigned char buf[1024 + 7], d0[32], d1[32];
+	struct VSHA256Context c;
+	size_t l, o, n;
+
+	for (l = 0; l < sizeof buf; l++)
+		buf[l] = (unsigned char)random();
+
+	ref = &vsha256_impl[vcountof(vsha256_impl) - 2];
+	for (vi = vsha256_impl; vi->name != NULL; vi++) {
+		if (vi->probe != NULL && !vi->probe()) {
+			printf("%s: not supported\n", vi->name);
+			continue;
+		}
+		vsha256_cur = vi;
+		AZ(vsha256_test_vectors());
+		n = 0;
+		for (o = 0; o < 8; o++) {
+			for (l = 0; l < sizeof buf - o; l += 13) {
+				vsha256_cur = ref;
+				VSHA256_Init(&c);
+				VSHA256_Update(&c, buf + o, l);
+				VSHA256_Final(d0, &c);
+				vsha256_cur = vi;
+				VSHA256_Init(&c);
+				VSHA256_Update(&c, buf + o, l / 3);
+				VSHA256_Update(&c, buf + o + l / 3, l - l / 3);
+				VSHA256_Final(d1, &c);
+				AZ(memcmp(d0, d1, sizeof d0));
+				n++;
+			}
+		}
+		printf("%s: %zu tests OK\n", vi->name, n);
+	}
+	VSHA256_Test();
+	printf("selected: %s\n", VSHA256_Impl());
+	return (0);
+}
+#endif
@@ -389,6 +389,8 @@ vcc_ParseHostDef(struct vcc *tl, struct symbol *sym,
 	const struct token *t_authority = NULL;
 	const struct token *t_did = NULL;
 	const struct token *t_preamble = NULL;
+	const struct token *t_proxy = NULL;
+	const struct token *t_h2c = NULL;
 	struct symbol *pb;
 	struct fld_spec *fs;
 	struct inifin *ifp;
@@ -442,6 +444,8 @@ vcc_ParseHostDef(struct vcc *tl, struct symbol *sym,
 	    "?authority",
 	    "?wait_timeout",
 	    "?wait_limit",
+	    "?h2c",
+	    "?min_idle_connections",
 	    NULL);
 
 	tl->fb = VSB_new_auto();
@@ -521,7 +525,7 @@ vcc_ParseHostDef(struct vcc *tl, struct symbol *sym,
 			SkipToken(tl, ';');
 			Fb(tl, 0, "\t.max_connections = %u,\n", u);
 		} else if (vcc_IdIs(t_field, "proxy_header")) {
-			t_val = tl->t;
+			t_val = t_proxy = tl->t;
 			u = vcc_UintVal(tl);
 			ERRCHK(tl);
 			if (u != 1 && u != 2) {
@@ -606,6 +610,19 @@ vcc_ParseHostDef(struct vcc *tl, struct symbol *sym,
 			ERRCHK(tl);
 			SkipToken(tl, ';');
 			Fb(tl, 0, "\t.backend_wait_limit = %u,\n", u);
+		} else if (vcc_IdIs(t_field, "h2c")) {
+			t_val = tl->t;
+			u = vcc_BoolVal(tl);
+			ERRCHK(tl);
+			SkipToken(tl, ';');
+			if (u)
+				t_h2c = t_val;
+			Fb(tl, 0, "\t.h2c = %u,\n", u);
+		} else if (vcc_IdIs(t_field, "min_idle_connections")) {
+			u = vcc_UintVal(tl);
+			ERRCHK(tl);
+			SkipToken(tl, ';');
+			Fb(tl, 0, "\t.min_idle_connections = %u,\n", u);
 		} else {
 			ErrInternal(tl);
 			VSB_destroy(&tl->fb);
@@ -636,6 +653,13 @@ vcc_ParseHostDef(struct vcc *tl, struct symbol *sym,
 		return;
 	}
 
+	if (t_h2c != NULL && t_proxy != NULL) {
+		VSB_cat(tl->sb, "Cannot combine .h2c and .proxy_header.\n");
+		vcc_ErrWhere(tl, t_h2c);
+		VSB_destroy(&tl->fb);
+		return;
+	}
+
 	if (via != NULL && t_path != NULL) {
 		VSB_cat(tl->sb, "Cannot set both .via and .path.\n");
 		vcc_ErrWhere(tl, t_be);
@@ -28,6 +28,7 @@
 #endif /* MAKECRCH */
 
 #include "zutil.h"      /* for Z_U4, Z_U8, z_crc_t, and FAR definitions */
+#include "crc32_simd.h"
 
  /*
   A CRC of a message is computed on N braids of words in the message, where
@@ -703,6 +704,13 @@ unsigned long ZEXPORT crc32_z(unsigned long crc, const unsigned char FAR *buf,
     /* Pre-condition the CRC */
     crc = (~crc) & 0xffffffff;
 
+    /* Use CPU instructions for the bulk of longer inputs, if present. */
+    if (len >= CRC32_SIMD_MIN) {
+        z_size_t done = crc32_simd(&crc, buf, len);
+        buf += done;
+        len -= done;
+    }
+
 #ifdef W
 
     /* If provided enough bytes, do a braided CRC calculation. */
@@ -0,0 +1,194 @@
+/* crc32_simd.c -- runtime dispatched CRC-32 using CPU instructions
+ *
+ * This is a libvgz addition, it is not part of zlib.
+ *
+ * On x86-64 with PCLMULQDQ, 64 byte blocks are folded four at a time
+ * with carry-less multiplication and reduced with Barrett reduction, as
+ * described in "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction", Intel, 2009.  On ARMv8 with the CRC32
+ * extension the crc32 instructions are used on eight bytes at a time.
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "zutil.h"
+#include "crc32_simd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#  define CRC32_SIMD_X86
+#  include <stdint.h>
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#  define CRC32_SIMD_ARM
+#  include <stdint.h>
+#  include <sys/auxv.h>
+#  include <arm_acle.h>
+#  ifndef HWCAP_CRC32
+#    define HWCAP_CRC32 (1 << 7)
+#  endif
+#endif
+
+#ifdef CRC32_SIMD_X86
+
+local int crc32_simd_probe(void) {
+    unsigned a, b, c, d;
+
+    if (!__get_cpuid(1, &a, &b, &c, &d))
+        return 0;
+    return (c & bit_PCLMUL) && (c & bit_SSE4_1);
+}
+
+/* Constants for the reflected polynomial 0xedb88320 */
+static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+    { 0x0154442bd4ULL, 0x01c6e41596ULL };
+static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+    { 0x01751997d0ULL, 0x00ccaa009eULL };
+static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+    { 0x0163cd6124ULL, 0x0000000000ULL };
+static const uint64_t poly[2] __attribute__((aligned(16))) =
+    { 0x01db710641ULL, 0x01f7011641ULL };
+
+/* len must be at least 64 and a multiple of 16, crc is pre-conditioned */
+local __attribute__((target("pclmul,sse4.1")))
+uint32_t crc32_fold(uint32_t crc, const unsigned char FAR *buf, z_size_t len) {
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i *)(const void *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* Fold four 128 bit lanes in parallel */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one */
+    x0 = _mm_load_si128((const __m128i *)(const void *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Fold in the remaining 16 byte blocks */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)(const void *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* Fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)(const void *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)(const void *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+z_size_t ZLIB_INTERNAL crc32_simd(unsigned long *crc,
+                                  const unsigned char FAR *buf, z_size_t len) {
+    static volatile int have = -1;
+
+    if (len < CRC32_SIMD_MIN)
+        return 0;
+    if (have < 0)
+        have = crc32_simd_probe();
+    if (!have)
+        return 0;
+    len &= ~(z_size_t)15;
+    *crc = crc32_fold((uint32_t)*crc, buf, len);
+    return len;
+}
+
+#elif defined(CRC32_SIMD_ARM)
+
+local int crc32_simd_probe(void) {
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+local __attribute__((target("+crc")))
+uint32_t crc32_arm(uint32_t crc, const unsigned char FAR *buf, z_size_t len) {
+    uint64_t w;
+
+    while (len && ((z_size_t)buf & 7) != 0) {
+        crc = __crc32b(crc, *buf++);
+        len--;
+    }
+    for (; len >= 8; len -= 8, buf += 8) {
+        zmemcpy((Bytef *)&w, buf, 8);
+        crc = __crc32d(crc, w);
+    }
+    while (len--)
+        crc = __crc32b(crc, *buf++);
+    return crc;
+}
+
+z_size_t ZLIB_INTERNAL crc32_simd(unsigned long *crc,
+                                  const unsigned char FAR *buf, z_size_t len) {
+    static volatile int have = -1;
+
+    if (len < CRC32_SIMD_MIN)
+        return 0;
+    if (have < 0)
+        have = crc32_simd_probe();
+    if (!have)
+        return 0;
+    *crc = crc32_arm((uint32_t)*crc, buf, len);
+    return len;
+}
+
+#else
+
+z_size_t ZLIB_INTERNAL crc32_simd(unsigned long *crc,
+                                  const unsigned char FAR *buf, z_size_t len) {
+    (void)crc;
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+#endif
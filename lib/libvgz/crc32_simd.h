@@ -0,0 +1,17 @@
+/* crc32_simd.h -- runtime dispatched CRC-32 using CPU instructions
+ *
+ * This is a libvgz addition, it is not part of zlib.
+ *
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* Shorter inputs are not worth the dispatch */
+#define CRC32_SIMD_MIN 64
+
+/*
+ * Advance the pre-conditioned CRC *crc over a prefix of buf and return
+ * the number of bytes consumed, zero if no suitable instructions are
+ * available on this CPU.
+ */
+z_size_t ZLIB_INTERNAL crc32_simd(unsigned long *crc,
+                                  const unsigned char FAR *buf, z_size_t len);
@@ -245,6 +245,22 @@ void ZLIB_INTERNAL inflate_fast(z_streamp strm, unsigned start) {
                             *out++ = *from++;
                     }
                 }
+                else if (dist >= 8 &&
+                         (unsigned)(end - out) + 257 >= len + 7) {
+                    /* libvgz: copy eight bytes at a time.  The source of
+                       each chunk does not overlap its destination, and the
+                       up to seven bytes written past the match are still
+                       within the space given by avail_out. */
+                    unsigned char FAR *stop = out + len;
+
+                    from = out - dist;          /* copy direct from output */
+                    do {
+                        zmemcpy(out, from, 8);
+                        out += 8;
+                        from += 8;
+                    } while (out < stop);
+                    out = stop;
+                }
                 else {
                     from = out - dist;          /* copy direct from output */
                     do {                        /* minimum length is three */
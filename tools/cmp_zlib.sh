@@ -17,7 +17,9 @@ do
 	if [ "$b" == "vgz.h" ] ; then
 		b="zlib.h"
 	fi
-	if [ -f ${LZ}/$b ] ; then
+	if [ "$b" = "crc32_simd.c" -o "$b" = "crc32_simd.h" ] ; then
+		echo "#### $b #### libvgz only ####"
+	elif [ -f ${LZ}/$b ] ; then
 		echo "#################################### $b"
 		sed '
 		s/vgz.h/zlib.h/
@@ -249,6 +249,16 @@ vmod_cache_req_body(VRT_CTX, VCL_BYTES size)
 	return (1);
 }
 
+VCL_BOOL v_matchproto_(td_std_tee_req_body)
+vmod_tee_req_body(VRT_CTX, VCL_BYTES size)
+{
+	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
+	size = vmax_t(VCL_BYTES, size, 0);
+	if (VRT_TeeReqBody(ctx, (size_t)size) < 0)
+		return (0);
+	return (1);
+}
+
 VCL_STRING v_matchproto_(td_std_strstr)
 vmod_strstr(VRT_CTX, VCL_STRING s1, VCL_STRING s2)
 {